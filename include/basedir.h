@@ -66,6 +66,79 @@ typedef struct /*_xdgHandle*/ {
   * @return a pointer to the handle if initialization was successful, else 0 */
 xdgHandle * xdgInitHandle(xdgHandle *handle);
 
+/** Keep a descriptor of every searchable directory open in the handle.
+  * Lookups then open files relative to these descriptors, so the kernel
+  * does not walk the path of the base directory again on every lookup,
+  * and directories which did not exist when the handle was updated are
+  * skipped by reads without any system call, though files opened for
+  * writing are still created in them. Use xdgRevalidateHandle() when base
+  * directories may have been created, removed or replaced. */
+#define XDG_HANDLE_DIRECTORY_FDS 0x1
+
+/** Compute every directory of the handle on first use instead of when the
+  * handle is initialized or updated. Tools which only need one directory
+  * then do not pay for the others. Initialization still fails if the
+  * home directories cannot be determined, but running out of memory is
+  * only reported by the first query, which then returns @c NULL. Queries
+  * may be made from several threads at once. The variables which determine
+  * the directories are still read when the handle is initialized or
+  * updated, so that changes to the environment in between, and calls to
+  * setenv() racing with the first queries, do not affect them. */
+#define XDG_HANDLE_LAZY 0x2
+
+/** Open files for reading in every searchable directory at once.
+  * xdgDataOpen() and xdgConfigOpen() hand the candidates after the first
+  * to a small pool of threads shared by all handles, and return the file
+  * of the highest priority directory containing it as soon as every
+  * directory before it is known not to. This hides the latency of
+  * directories on network filesystems, at the cost of opening files which
+  * are then closed again. Modes other than reading still probe one
+  * directory after another, since they may create files. */
+#define XDG_HANDLE_PARALLEL_OPEN 0x4
+
+/** Initialize a handle to an XDG data cache with optional behaviour.
+  * @param handle Handle to initialize.
+  * @param flags Bitwise or of @c XDG_HANDLE_* flags. The flags are kept
+  * 	when the cache is updated with xdgUpdateData().
+  * @return a pointer to the handle if initialization was successful, else 0 */
+xdgHandle * xdgInitHandleWithFlags(xdgHandle *handle, unsigned int flags);
+
+/** Pool of strings and directory lists shared between handles.
+  * Pools are initialized with xdgInitHandlePool() and freed with
+  * xdgWipeHandlePool(). */
+typedef struct /*_xdgHandlePool*/ {
+	/** Reserved for internal use, do not modify. */
+	void *reserved;
+} xdgHandlePool;
+
+/** Initialize a pool of strings and directory lists shared between handles.
+  * Handles initialized from the pool with xdgInitHandleFromEnv() share
+  * the strings they have in common, such as the system data and config
+  * directories, instead of each holding its own copies. Handles with the
+  * same directories also share the searchable directory lists and the lists
+  * prepared for lookups; a handle which opens descriptors of its
+  * directories or sets a lookup deadline copies its prepared lists first.
+  * @return a pointer to the pool if initialization was successful, else 0 */
+xdgHandlePool * xdgInitHandlePool(xdgHandlePool *pool);
+
+/** Wipe a pool of shared strings and directory lists.
+  * All handles initialized from the pool must be wiped first. */
+void xdgWipeHandlePool(xdgHandlePool *pool);
+
+/** Initialize a handle from an explicit environment.
+  * The handle is initialized as by xdgInitHandleWithFlags(), but the
+  * variables are read from @p environment instead of the environment of
+  * the process. The variables used are copied into the handle, and are read
+  * again by xdgUpdateData().
+  * @param handle Handle to initialize.
+  * @param environment Null-terminated list of @c NAME=value strings, in the
+  * 	format of @c environ.
+  * @param flags Bitwise or of @c XDG_HANDLE_* flags.
+  * @param pool Pool to share strings and directory lists in, initialized with
+  * 	xdgInitHandlePool(), or @c NULL. The pool must outlive the handle.
+  * @return a pointer to the handle if initialization was successful, else 0 */
+xdgHandle * xdgInitHandleFromEnv(xdgHandle *handle, const char * const *environment, unsigned int flags, xdgHandlePool *pool);
+
 /** Wipe handle of XDG data cache.
   * Wipe handle initialized using xdgInitHandle(). */
 void xdgWipeHandle(xdgHandle *handle);
@@ -77,6 +150,14 @@ void xdgWipeHandle(xdgHandle *handle);
   * @return 0 if update failed, non-0 if successful.*/
 int xdgUpdateData(xdgHandle *handle);
 
+/** Check whether the searchable directories of a handle were replaced.
+  * Only has an effect on handles initialized with
+  * @c XDG_HANDLE_DIRECTORY_FDS: the descriptor of every directory which was
+  * created, removed or replaced since it was opened is reopened. This is
+  * much cheaper than xdgUpdateData() but does not re-read the environment.
+  * @return The number of directories whose descriptor changed. */
+int xdgRevalidateHandle(xdgHandle *handle);
+
 /*@}*/
 /** @name Basic XDG Base Directory Queries */
 /*@{*/
@@ -131,6 +212,53 @@ const char * xdgCacheHome(xdgHandle *handle);
   * set. */
 const char * xdgRuntimeDirectory(xdgHandle *handle);
 
+/*@}*/
+/** @name Reverse lookups */
+/*@{*/
+
+/** Kinds of base directories reported by xdgClassifyPath(). */
+enum
+{
+	/** The path is not in any base directory. */
+	XDG_BASE_NONE = 0,
+	/** One of xdgSearchableDataDirectories(). */
+	XDG_BASE_DATA,
+	/** One of xdgSearchableConfigDirectories(). */
+	XDG_BASE_CONFIG,
+	/** xdgCacheHome(). */
+	XDG_BASE_CACHE,
+	/** xdgRuntimeDirectory(). */
+	XDG_BASE_RUNTIME
+};
+
+/** Base directory containing a path, as found by xdgClassifyPath(). */
+typedef struct /*_xdgPathClass*/ {
+	/** One of the @c XDG_BASE_* values. */
+	int base;
+	/** Index of the directory in its searchable list, 0 for the cache
+	  * home and the runtime directory. */
+	unsigned int index;
+	/** Remainder of the path relative to the base directory, pointing into
+	  * the classified path. Empty if the path is the base directory itself. */
+	const char *relativePath;
+} xdgPathClass;
+
+/** Find the base directory containing an absolute path.
+  * The directories of the handle are kept in a trie, so the cost depends
+  * on the depth of the path and not on the number of base directories.
+  * If several base directories contain the path, the deepest one is
+  * reported. A directory which is listed several times is reported with
+  * its highest priority kind and index: data before config before cache
+  * before runtime, then the lowest index. Paths are compared component by
+  * component without resolving @c . or @c .. or symbolic links.
+  * @param path Absolute path, such as one reported by a file watcher.
+  * 	Relative paths are not in any base directory.
+  * @param result Receives the base directory and the relative path.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return The @c XDG_BASE_* value stored in @p result, @c XDG_BASE_NONE if
+  * 	no base directory contains the path or an error occured. */
+int xdgClassifyPath(const char *path, xdgPathClass *result, xdgHandle *handle);
+
 /*@}*/
 
 #ifdef __cplusplus
@@ -0,0 +1,103 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file basedir.hpp
+  * C++20 lookups of relative paths known when compiling.
+  *
+  * The relative path is a template argument, so its length is computed and
+  * the path is checked by the compiler, and the lookup calls the functions
+  * of basedir_fs.h which take an explicit length:
+  * @code
+  * FILE *file = xdg::config_open<"myapp/main.conf">(&handle);
+  * @endcode */
+
+#ifndef XDG_BASEDIR_HPP
+#define XDG_BASEDIR_HPP
+
+#include <basedir_fs.h>
+#include <cstddef>
+
+#if __cplusplus >= 202002L
+
+namespace xdg {
+
+/** Relative path used as a template argument.
+  * Constructed from a string literal, which must not contain null characters. */
+template<std::size_t N>
+struct fixed_string
+{
+	/** The characters of the path, null-terminated. */
+	char value[N];
+
+	/** Length of the path without the terminating null character. */
+	static constexpr std::size_t length = N - 1;
+
+	consteval fixed_string(const char (&string)[N])
+	{
+		for (std::size_t i = 0; i < N; ++i)
+		{
+			if (i < length && !string[i])
+				throw "relative paths cannot contain null characters";
+			value[i] = string[i];
+		}
+	}
+};
+
+/** Find all existing data files corresponding to Path.
+  * @see xdgDataFind() */
+template<fixed_string Path>
+inline char * data_find(xdgHandle *handle)
+{
+	return xdgDataFindN(Path.value, Path.length, handle);
+}
+
+/** Find all existing config files corresponding to Path.
+  * @see xdgConfigFind() */
+template<fixed_string Path>
+inline char * config_find(xdgHandle *handle)
+{
+	return xdgConfigFindN(Path.value, Path.length, handle);
+}
+
+/** Open first possible data file corresponding to Path.
+  * @see xdgDataOpen() */
+template<fixed_string Path>
+inline FILE * data_open(xdgHandle *handle, const char *mode = "r")
+{
+	return xdgDataOpenN(Path.value, Path.length, mode, handle);
+}
+
+/** Open first possible config file corresponding to Path.
+  * @see xdgConfigOpen() */
+template<fixed_string Path>
+inline FILE * config_open(xdgHandle *handle, const char *mode = "r")
+{
+	return xdgConfigOpenN(Path.value, Path.length, mode, handle);
+}
+
+} // namespace xdg
+
+#endif
+
+#endif /*XDG_BASEDIR_HPP*/
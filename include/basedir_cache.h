@@ -0,0 +1,141 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file basedir_cache.h
+  * Size-bounded key/value store inside the XDG cache directory. */
+
+#ifndef XDG_BASEDIR_CACHE_H
+#define XDG_BASEDIR_CACHE_H
+
+#include <basedir.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @name Cache store */
+/*@{*/
+
+/** Handle to a cache store.
+  * A cache store keeps values by key in hashed, sharded files below
+  * <tt>xdgCacheHome()/name</tt>. The total size of all values is kept in a
+  * small index file so that opening a store does not need to scan it, and
+  * the least recently used values are evicted whenever the store grows
+  * beyond its size budget. The time each value was last stored or
+  * retrieved is kept in the index, so the eviction order survives reopening
+  * the store.
+  * Stores are opened with xdgCacheStoreOpen() and closed with
+  * xdgCacheStoreClose(). A store must not be used by several threads at
+  * once, and should not be opened by several processes at once. */
+typedef struct /*_xdgCacheStore*/ {
+	/** Reserved for internal use, do not modify. */
+	void *reserved;
+} xdgCacheStore;
+
+/** Value retrieved from a cache store with xdgCacheStoreGet().
+  * The value is mapped into memory and must be released with
+  * xdgCacheStoreRelease(). */
+typedef struct {
+	/** Contents of the value. */
+	const void *data;
+	/** Size of the value in bytes. */
+	size_t size;
+	/** Reserved for internal use, do not modify. */
+	void *reserved;
+	/** Reserved for internal use, do not modify. */
+	size_t reservedSize;
+} xdgCacheItem;
+
+/** Open a cache store, creating it if it does not exist.
+  * @param store Store handle to initialize.
+  * @param name Name of the store, usually the application name. The store
+  * 	is kept in a directory of this name below xdgCacheHome().
+  * @param budget Maximum total size of all values in bytes, or 0 for no limit.
+  * @param maxAge Maximum number of seconds since a value was last used
+  * 	before it is evicted, or 0 for no limit.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return a pointer to the store if successful, else 0 */
+xdgCacheStore * xdgCacheStoreOpen(xdgCacheStore *store, const char *name,
+	unsigned long long budget, unsigned long maxAge, xdgHandle *handle);
+
+/** Write the index of a cache store and close it. */
+void xdgCacheStoreClose(xdgCacheStore *store);
+
+/** Write the index of a cache store.
+  * This is done automatically by xdgCacheStoreClose(); changes made since
+  * the last flush are recovered from a journal if the process exits without
+  * closing the store.
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately) */
+int xdgCacheStoreFlush(xdgCacheStore *store);
+
+/** Store a value, replacing any value with the same key.
+  * Up to a few of the least recently used values are evicted afterwards if
+  * the store is over budget.
+  * @param store Store opened with xdgCacheStoreOpen().
+  * @param key Key of the value.
+  * @param keySize Size of @p key in bytes.
+  * @param data Contents of the value.
+  * @param size Size of @p data in bytes.
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately) */
+int xdgCacheStorePut(xdgCacheStore *store, const void *key, size_t keySize,
+	const void *data, size_t size);
+
+/** Map a value into memory.
+  * Retrieving a value makes it the most recently used one.
+  * @param store Store opened with xdgCacheStoreOpen().
+  * @param key Key of the value.
+  * @param keySize Size of @p key in bytes.
+  * @param item Receives the value, must be released with xdgCacheStoreRelease().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately, to @c ENOENT if the key is not in the store) */
+int xdgCacheStoreGet(xdgCacheStore *store, const void *key, size_t keySize, xdgCacheItem *item);
+
+/** Release a value retrieved with xdgCacheStoreGet(). */
+void xdgCacheStoreRelease(xdgCacheItem *item);
+
+/** Remove a value from the store.
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately, to @c ENOENT if the key is not in the store) */
+int xdgCacheStoreRemove(xdgCacheStore *store, const void *key, size_t keySize);
+
+/** Evict values which are over the budget or the maximum age.
+  * Eviction is incremental: at most @p maxCount values are evicted, so that
+  * a large backlog can be worked off in small steps.
+  * @return The number of values evicted. */
+unsigned int xdgCacheStoreEvict(xdgCacheStore *store, unsigned int maxCount);
+
+/** Total size of all values in the store in bytes, including the per-value
+  * overhead. */
+unsigned long long xdgCacheStoreSize(xdgCacheStore *store);
+
+/*@}*/
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /*XDG_BASEDIR_CACHE_H*/
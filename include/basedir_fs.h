@@ -79,6 +79,34 @@ FILE * xdgDataOpen(const char* relativePath, const char* mode, xdgHandle *handle
   */
 FILE * xdgConfigOpen(const char* relativePath, const char* mode, xdgHandle *handle);
 
+/** Find all existing data files corresponding to a relative path of known length.
+  * Same as xdgDataFind(), for callers which already know the length of the
+  * path, such as the templates of basedir.hpp, or which look up part of a
+  * longer string.
+  * @param relativePath Path to scan for, which need not be null-terminated
+  * 	but must not contain a null character in its first @p length bytes.
+  * @param length Length of relativePath.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @see xdgDataFind() */
+char * xdgDataFindN(const char* relativePath, size_t length, xdgHandle *handle);
+
+/** Find all existing config files corresponding to a relative path of known length.
+  * @see xdgDataFindN(), xdgConfigFind() */
+char * xdgConfigFindN(const char* relativePath, size_t length, xdgHandle *handle);
+
+/** Open first possible data file corresponding to a relative path of known length.
+  * @param relativePath Path to scan for, which need not be null-terminated
+  * 	but must not contain a null character in its first @p length bytes.
+  * @param length Length of relativePath.
+  * @param mode Mode with which to attempt to open files (see fopen modes).
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @see xdgDataOpen() */
+FILE * xdgDataOpenN(const char* relativePath, size_t length, const char* mode, xdgHandle *handle);
+
+/** Open first possible config file corresponding to a relative path of known length.
+  * @see xdgDataOpenN(), xdgConfigOpen() */
+FILE * xdgConfigOpenN(const char* relativePath, size_t length, const char* mode, xdgHandle *handle);
+
 /** Create path by recursively creating directories.
   * This utility function is not part of the XDG specification, but
   * nevertheless useful in context of directory manipulation.
@@ -91,6 +119,412 @@ FILE * xdgConfigOpen(const char* relativePath, const char* mode, xdgHandle *hand
   */
 int xdgMakePath(const char * path, mode_t mode);
 
+/*@}*/
+/** @name Reading all matching files */
+/*@{*/
+
+/** Return files in search order, i.e. the highest-priority file first. */
+#define XDG_READ_PRIORITY_ORDER 0
+/** Return files in reverse search order, i.e. the highest-priority file
+  * last, so that applying them in sequence lets user files override system
+  * files. */
+#define XDG_READ_OVERRIDE_ORDER 1
+
+/** Location of a single file within an xdgFileSet. */
+typedef struct {
+	/** Offset of the file's contents within xdgFileSet::buffer. */
+	size_t offset;
+	/** Length of the file's contents in bytes, not including the null
+	  * byte appended after the contents. */
+	size_t length;
+	/** Index of the base directory containing the file, within the list
+	  * returned by xdgSearchableDataDirectories() or
+	  * xdgSearchableConfigDirectories(). */
+	unsigned int directory;
+} xdgFileExtent;
+
+/** Contents of all files matching a relative path.
+  * Filled by xdgDataReadAll() or xdgConfigReadAll() and freed with
+  * xdgFreeFileSet(). */
+typedef struct {
+	/** Contents of all files, each followed by a null byte. */
+	char *buffer;
+	/** Table of @c count file extents within @c buffer. */
+	xdgFileExtent *files;
+	/** Number of files read. */
+	unsigned int count;
+} xdgFileSet;
+
+/** Read all existing data files corresponding to relativePath.
+  * Every regular file found in the searchable data directories is read into
+  * a single buffer using one allocation for all files.
+  * @param relativePath Path to scan for.
+  * @param order Either @c XDG_READ_PRIORITY_ORDER or @c XDG_READ_OVERRIDE_ORDER.
+  * @param files File set to fill. Must be freed with xdgFreeFileSet() on success.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgDataReadAll(const char * relativePath, int order, xdgFileSet *files, xdgHandle *handle);
+
+/** Read all existing config files corresponding to relativePath.
+  * Every regular file found in the searchable config directories is read
+  * into a single buffer using one allocation for all files.
+  * @param relativePath Path to scan for.
+  * @param order Either @c XDG_READ_PRIORITY_ORDER or @c XDG_READ_OVERRIDE_ORDER.
+  * @param files File set to fill. Must be freed with xdgFreeFileSet() on success.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgConfigReadAll(const char * relativePath, int order, xdgFileSet *files, xdgHandle *handle);
+
+/** Free the memory used by a file set filled by xdgDataReadAll() or
+  * xdgConfigReadAll(). */
+void xdgFreeFileSet(xdgFileSet *files);
+
+/*@}*/
+/** @name Fingerprints */
+/*@{*/
+
+/** Hash the identity of every candidate location of data files.
+  * For every relative path and every searchable data directory, the hash
+  * covers whether the file exists and its device, inode, size, mode and
+  * modification and change times, as well as the directories themselves.
+  * Contents are not read. The hash is stable across processes, so
+  * applications can key a cache of their parsed files by it, for example
+  * under xdgCacheHome(), and skip parsing when it has not changed.
+  * @param relativePaths Paths of the files.
+  * @param count Number of paths in @p relativePaths.
+  * @param fingerprint Receives the hash.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgDataFingerprint(const char * const * relativePaths, unsigned int count, unsigned long long *fingerprint, xdgHandle *handle);
+
+/** Hash the identity of every candidate location of config files.
+  * @see xdgDataFingerprint()
+  * @param relativePaths Paths of the files.
+  * @param count Number of paths in @p relativePaths.
+  * @param fingerprint Receives the hash.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgConfigFingerprint(const char * const * relativePaths, unsigned int count, unsigned long long *fingerprint, xdgHandle *handle);
+
+/*@}*/
+/** @name Existence matrices */
+/*@{*/
+
+/** Which searchable directories contain each of a list of paths.
+  * Filled by xdgDataProbeMatrix() or xdgConfigProbeMatrix() and freed with
+  * xdgFreeProbeMatrix(). */
+typedef struct {
+	/** One row of @c words words per path, in the order of the paths. Bit
+	  * @c d of a row is set if directory @c d contains the path. */
+	unsigned long long *bits;
+	/** Number of paths. */
+	unsigned int count;
+	/** Number of searchable directories. */
+	unsigned int directories;
+	/** Number of words in a row. */
+	unsigned int words;
+} xdgProbeMatrix;
+
+/** Check whether a directory contains a path of a probe matrix.
+  * @param matrix Filled probe matrix.
+  * @param path Index of the path.
+  * @param directory Index of the directory, within the list returned by
+  * 	xdgSearchableDataDirectories() or xdgSearchableConfigDirectories(). */
+#define XDG_PROBE_MATRIX_HAS(matrix, path, directory) \
+	((int)(((matrix)->bits[(path)*(matrix)->words + (directory)/64] >> ((directory)%64)) & 1))
+
+/** Find which searchable data directories contain each of a list of paths.
+  * Paths are grouped by their parent directory, which is read once in
+  * every data directory instead of probing every path in every directory;
+  * many distinct parents are read by several threads. A directory contains
+  * a path if the parent lists its name, whatever the type of the entry.
+  * Parents which can be searched but not read are probed for each name.
+  * While the handle has a lookup deadline, paths in slow directories are
+  * probed within it like xdgDataFind() does instead of reading the
+  * parents, and directories which do not answer in time contain none.
+  * @param relativePaths Paths to look for.
+  * @param count Number of paths in @p relativePaths.
+  * @param matrix Matrix to fill. Must be freed with xdgFreeProbeMatrix() on success.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgDataProbeMatrix(const char * const * relativePaths, unsigned int count, xdgProbeMatrix *matrix, xdgHandle *handle);
+
+/** Find which searchable config directories contain each of a list of paths.
+  * @see xdgDataProbeMatrix() */
+int xdgConfigProbeMatrix(const char * const * relativePaths, unsigned int count, xdgProbeMatrix *matrix, xdgHandle *handle);
+
+/** Free the memory used by a matrix filled by xdgDataProbeMatrix() or
+  * xdgConfigProbeMatrix(). */
+void xdgFreeProbeMatrix(xdgProbeMatrix *matrix);
+
+/*@}*/
+/** @name Atomic writes */
+/*@{*/
+
+/** Handle to a batch of atomic writes.
+  * Batches are initialized with xdgInitWriteBatch() and committed with
+  * xdgCommitWriteBatch() or discarded with xdgWipeWriteBatch(). */
+typedef struct /*_xdgWriteBatch*/ {
+	/** Reserved for internal use, do not modify. */
+	void *reserved;
+} xdgWriteBatch;
+
+/** Initialize a batch of atomic writes.
+  * Files written into a batch are not visible under their final names and
+  * are not synced to disk until xdgCommitWriteBatch() is called.
+  * @return a pointer to the batch if initialization was successful, else 0 */
+xdgWriteBatch * xdgInitWriteBatch(xdgWriteBatch *batch);
+
+/** Commit all writes in a batch.
+  * All written files are synced with one syncfs() per filesystem where
+  * available, moved to their final names, and the containing directories are
+  * synced again. The batch is wiped afterwards, even if an error occurs.
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgCommitWriteBatch(xdgWriteBatch *batch);
+
+/** Discard all uncommitted writes in a batch and free the batch. */
+void xdgWipeWriteBatch(xdgWriteBatch *batch);
+
+/** Atomically replace a file relative to the user's data directory.
+  * Missing parent directories are created with permissions 0700. The data is
+  * written to a temporary file in the destination directory which is then
+  * renamed over the destination. The new file keeps the permissions of the
+  * file it replaces. If the destination is a symbolic link, the file it
+  * points to is replaced, unless the link is dangling, in which case the
+  * link itself is replaced.
+  * @param relativePath Path of the file relative to xdgDataHome().
+  * @param data Contents to write.
+  * @param size Number of bytes in @p data.
+  * @param batch Batch to add the write to, or @c NULL to sync and rename the
+  * 	file immediately.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgDataWriteAtomic(const char * relativePath, const void * data, size_t size, xdgWriteBatch *batch, xdgHandle *handle);
+
+/** Atomically replace a file relative to the user's config directory.
+  * @see xdgDataWriteAtomic()
+  * @param relativePath Path of the file relative to xdgConfigHome().
+  * @param data Contents to write.
+  * @param size Number of bytes in @p data.
+  * @param batch Batch to add the write to, or @c NULL to sync and rename the
+  * 	file immediately.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgConfigWriteAtomic(const char * relativePath, const void * data, size_t size, xdgWriteBatch *batch, xdgHandle *handle);
+
+/** Atomically replace a file relative to the user's cache directory.
+  * @see xdgDataWriteAtomic()
+  * @param relativePath Path of the file relative to xdgCacheHome().
+  * @param data Contents to write.
+  * @param size Number of bytes in @p data.
+  * @param batch Batch to add the write to, or @c NULL to sync and rename the
+  * 	file immediately.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgCacheWriteAtomic(const char * relativePath, const void * data, size_t size, xdgWriteBatch *batch, xdgHandle *handle);
+
+/*@}*/
+/** @name Shared resolution cache */
+/*@{*/
+
+/** Attach a resolution cache shared with other processes to a handle.
+  * Once attached, xdgDataFind(), xdgConfigFind(), and xdgDataOpen() and
+  * xdgConfigOpen() in read modes, first look up which directories contain
+  * the relative path in the shared cache, and publish the result of their
+  * probes to it. Results are keyed by the searchable directory lists, so
+  * processes with different environments can share a cache.
+  *
+  * The handle watches the parent directory of each path it looked up with
+  * inotify, where available, and invalidates all results of the cache
+  * when a file is created, removed or renamed in one of them, so that
+  * lookups use results without any system call. Writes through the handle
+  * and xdgInvalidateSharedCache() invalidate the cache as well. Results
+  * also expire after @p ttl seconds, which bounds how long changes go
+  * unnoticed which no attached process watched, such as changes in slow
+  * directories, which lookups with a deadline do not watch.
+  * The cache stays attached across xdgUpdateData().
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @param fd File descriptor of a shared cache created with
+  * 	xdgCreateSharedCache(), or -1 to use a cache file in
+  * 	xdgRuntimeDirectory() shared by all processes of the user.
+  * @param ttl Number of seconds for which results are trusted, or 0 for
+  * 	the default of 5 seconds.
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgAttachSharedCache(xdgHandle *handle, int fd, unsigned int ttl);
+
+/** Create an anonymous shared resolution cache.
+  * The returned file descriptor can be inherited by child processes and
+  * passed to xdgAttachSharedCache(), so that only a process tree shares the
+  * cache.
+  * @return A file descriptor, or -1 if an error occured (in which case
+  * 	errno will be set appropriately)
+  */
+int xdgCreateSharedCache(void);
+
+/** Invalidate all results in the shared resolution cache attached to a
+  * handle, for all processes using the cache. */
+void xdgInvalidateSharedCache(xdgHandle *handle);
+
+/*@}*/
+/** @name Prefetching */
+/*@{*/
+
+/** Start resolving data files in the background.
+  * Each relative path is looked up as by xdgDataOpen() on a background
+  * thread, and the kernel is asked to read the winning file ahead, so
+  * that later lookups find warm directory and page caches. If a shared
+  * resolution cache is attached to the handle, the results are published
+  * to it as well. The call returns immediately; the handle may be updated
+  * or wiped while the lookups are still running.
+  * @param relativePaths Paths to resolve.
+  * @param count Number of paths in @p relativePaths.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgDataPrefetch(const char * const * relativePaths, unsigned int count, xdgHandle *handle);
+
+/** Start resolving config files in the background.
+  * @see xdgDataPrefetch()
+  * @param relativePaths Paths to resolve.
+  * @param count Number of paths in @p relativePaths.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgConfigPrefetch(const char * const * relativePaths, unsigned int count, xdgHandle *handle);
+
+/*@}*/
+/** @name Bounded lookups */
+/*@{*/
+
+/** Bound the time lookups wait for base directories on slow filesystems.
+  * Base directories on network and FUSE filesystems, such as NFS, SMB or
+  * sshfs, are detected when the handle is updated. Lookups of the handle
+  * then probe these directories on a separate thread and give up on them
+  * once @p milliseconds have passed since the lookup started, treating
+  * the file as absent. A directory which did not answer in time is
+  * skipped by all lookups of the handle for the next 30 seconds. Other
+  * directories are probed as usual. The deadline is kept when the cache
+  * is updated with xdgUpdateData(). Must not be called concurrently with
+  * lookups of the same handle.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @param milliseconds Time a lookup may wait for slow directories, or 0
+  * 	to wait as long as they take, which is the default.
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgSetLookupDeadline(xdgHandle *handle, unsigned int milliseconds);
+
+/*@}*/
+/** @name Listing caches */
+/*@{*/
+
+/** Answer lookups under a data subdirectory from cached listings.
+  * When @p relativeDirectory is first looked up in, such as by
+  * @code xdgDataFind("icons/hicolor/48x48/apps/app.png", handle) @endcode
+  * for the subdirectory @c icons/hicolor/48x48/apps, the subdirectory is
+  * listed in every searchable data directory and the names are kept in
+  * memory. Lookups of paths under the subdirectory then skip the
+  * directories which do not contain the first component of the rest of the
+  * path without any system call, which saves most of the cost of misses
+  * when there are hundreds of data directories. The listings are compared
+  * to the modification times of the subdirectories at most once per
+  * second, so files created since may be missed for up to a second. The
+  * listings are kept by xdgUpdateData(). Must not be called concurrently
+  * with lookups of the same handle.
+  * @param relativeDirectory Relative path of the subdirectory.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgDataCacheListing(const char * relativeDirectory, xdgHandle *handle);
+
+/** Answer lookups under a config subdirectory from cached listings.
+  * @see xdgDataCacheListing()
+  * @param relativeDirectory Relative path of the subdirectory.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately)
+  */
+int xdgConfigCacheListing(const char * relativeDirectory, xdgHandle *handle);
+
+/*@}*/
+/** @name Handle snapshots */
+/*@{*/
+
+/** Environment variable holding the descriptor of a handle snapshot made
+  * with xdgExportHandleFd(). xdgInitHandle() and xdgInitHandleWithFlags()
+  * import the snapshot instead of computing the directories if the
+  * variable is set and the snapshot was made from the same values of
+  * @c \$HOME and the @c XDG_* variables as the environment of the process.
+  * Otherwise the variable is ignored. */
+#define XDG_HANDLE_FD_VARIABLE "XDG_BASEDIR_HANDLE_FD"
+
+/** Serialise the directories of a handle into a snapshot.
+  * The snapshot is a single position-independent block which can be
+  * passed to other processes, such as workers spawned by a supervisor,
+  * which import it with xdgImportHandle() instead of computing the
+  * directories again. It also records the shared resolution cache
+  * attached to the handle, if any.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @param size Receives the size of the snapshot.
+  * @return The snapshot, to be freed with free(), or @c NULL if an error
+  * 	occured (in which case errno will be set). */
+void * xdgExportHandle(xdgHandle *handle, size_t *size);
+
+/** Serialise the directories of a handle into a snapshot in memory that
+  * child processes inherit.
+  * The snapshot is written to an anonymous file whose descriptor is not
+  * closed on exec. Put its number in @c XDG_BASEDIR_HANDLE_FD in the
+  * environment of child processes, or pass it to xdgImportHandleFd().
+  * Only available on systems with memfd_create().
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return The descriptor, or -1 if an error occured (in which case errno
+  * 	will be set). */
+int xdgExportHandleFd(xdgHandle *handle);
+
+/** Initialize a handle from a snapshot made by xdgExportHandle().
+  * The environment is not read, but xdgUpdateData() later reads the
+  * environment of the process as for any other handle. A shared
+  * resolution cache recorded in the snapshot is attached again if it can
+  * be mapped.
+  * @param handle Handle to initialize.
+  * @param snapshot Snapshot, which is only read during the call.
+  * @param size Size of the snapshot.
+  * @param flags Bitwise or of @c XDG_HANDLE_* flags.
+  * @return a pointer to the handle if initialization was successful, else 0 */
+xdgHandle * xdgImportHandle(xdgHandle *handle, const void *snapshot, size_t size, unsigned int flags);
+
+/** Initialize a handle from a snapshot made by xdgExportHandleFd().
+  * The snapshot is mapped read-only for the duration of the call.
+  * @see xdgImportHandle()
+  * @param handle Handle to initialize.
+  * @param fd Descriptor of the snapshot, which is not closed.
+  * @param flags Bitwise or of @c XDG_HANDLE_* flags.
+  * @return a pointer to the handle if initialization was successful, else 0 */
+xdgHandle * xdgImportHandleFd(xdgHandle *handle, int fd, unsigned int flags);
+
 /*@}*/
 
 #ifdef __cplusplus
@@ -0,0 +1,115 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file basedir_keyfile.h
+  * Merged key files in the format of desktop entries and INI files. */
+
+#ifndef XDG_BASEDIR_KEYFILE_H
+#define XDG_BASEDIR_KEYFILE_H
+
+#include <stddef.h>
+#include <basedir.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @name Key files */
+/*@{*/
+
+/** Handle to the merged contents of every key file matching a relative path.
+  * Every matching file is mapped, and its groups, keys and values are
+  * slices of the mappings instead of copies. Lines are either @c [group]
+  * headers, @c key=value pairs, comments starting with @c # or @c ; or
+  * blank. Whitespace around keys and values is not part of them, but
+  * escape sequences are left in the values. Pairs before the first header
+  * belong to a group with an empty name, and pairs after a malformed
+  * header are ignored up to the next header.
+  * Key files are opened with xdgDataOpenKeyFile() or xdgConfigOpenKeyFile()
+  * and closed with xdgCloseKeyFile(). An open key file is never modified,
+  * so it can be read by several threads at once. */
+typedef struct /*_xdgKeyFile*/ {
+	/** Reserved for internal use, do not modify. */
+	void *reserved;
+} xdgKeyFile;
+
+/** Bytes within a mapped key file, which are not null-terminated. */
+typedef struct {
+	const char *data;
+	size_t length;
+} xdgSlice;
+
+/** Value of a key in a group, from the file of highest priority setting it. */
+typedef struct {
+	xdgSlice group;
+	xdgSlice key;
+	xdgSlice value;
+	/** Index of the base directory containing the file, within the list
+	  * returned by xdgSearchableDataDirectories() or
+	  * xdgSearchableConfigDirectories(). */
+	unsigned int directory;
+} xdgKeyFileEntry;
+
+/** Open every data file corresponding to relativePath as a key file.
+  * A key set in several files takes its value from the file of highest
+  * priority, so that user files override system files. If a file sets a
+  * key several times, the last value is used.
+  * @param relativePath Path to scan for.
+  * @param keyFile Key file to fill. Must be closed with xdgCloseKeyFile()
+  * 	on success, even if no file was found.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set appropriately) */
+int xdgDataOpenKeyFile(const char *relativePath, xdgKeyFile *keyFile, xdgHandle *handle);
+
+/** Open every config file corresponding to relativePath as a key file.
+  * @see xdgDataOpenKeyFile() */
+int xdgConfigOpenKeyFile(const char *relativePath, xdgKeyFile *keyFile, xdgHandle *handle);
+
+/** Close a key file, unmapping its files.
+  * The slices of its entries become invalid. */
+void xdgCloseKeyFile(xdgKeyFile *keyFile);
+
+/** Entries of a key file, sorted by group and then by key, compared byte
+  * by byte. Every key of a group appears once.
+  * @param keyFile Open key file.
+  * @param count Receives the number of entries.
+  * @return The entries, valid until the key file is closed. */
+const xdgKeyFileEntry * xdgKeyFileEntries(xdgKeyFile *keyFile, unsigned int *count);
+
+/** Look up the value of a key in a group of a key file.
+  * @param keyFile Open key file.
+  * @param group Name of the group, empty for keys before the first group.
+  * @param key Name of the key.
+  * @return The entry, valid until the key file is closed, or @c NULL if the
+  * 	key is not set. */
+const xdgKeyFileEntry * xdgKeyFileLookup(xdgKeyFile *keyFile, const char *group, const char *key);
+
+/*@}*/
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /*XDG_BASEDIR_KEYFILE_H*/
@@ -0,0 +1,115 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file basedir_watch.h
+  * Notifications of changes to the effective data and config files. */
+
+#ifndef XDG_BASEDIR_WATCH_H
+#define XDG_BASEDIR_WATCH_H
+
+#include <basedir.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @name Change notification */
+/*@{*/
+
+/** Handle to a set of watched files.
+  * A watcher reports when the file a lookup would find changes: when it is
+  * modified or replaced, when a file is created in a directory of higher
+  * priority, or when it is deleted so that a file of lower priority takes
+  * over. Changes to files which are hidden by a file of higher priority are
+  * not reported.
+  * Watchers are initialized with xdgInitWatcher() and freed with
+  * xdgWipeWatcher(). A watcher must not be used by several threads at once. */
+typedef struct /*_xdgWatcher*/ {
+	/** Reserved for internal use, do not modify. */
+	void *reserved;
+} xdgWatcher;
+
+/** Function called when the effective file of a watch changes.
+  * @param relativePath Relative path which is watched.
+  * @param path Path of the file a lookup now finds, or @c NULL if there is
+  * 	none. Only valid during the call.
+  * @param userData Pointer passed when the watch was added. */
+typedef void (*xdgWatchCallback)(const char *relativePath, const char *path, void *userData);
+
+/** Initialize a watcher.
+  * @return a pointer to the watcher if successful, else 0 (in which case
+  * 	errno will be set, to @c ENOSYS if change notification is not
+  * 	supported on the system) */
+xdgWatcher * xdgInitWatcher(xdgWatcher *watcher);
+
+/** Wipe a watcher, removing all of its watches. */
+void xdgWipeWatcher(xdgWatcher *watcher);
+
+/** File descriptor of a watcher.
+  * The descriptor becomes readable when changes are pending, so that it can
+  * be added to poll() or epoll. Call xdgDispatchWatcher() when it does. */
+int xdgWatcherFd(xdgWatcher *watcher);
+
+/** Process pending changes and call the callbacks of all watches whose
+  * effective file changed. Does not block.
+  * @return The number of callbacks called, or -1 if an error occured (in
+  * 	which case errno will be set) */
+int xdgDispatchWatcher(xdgWatcher *watcher);
+
+/** Watch the effective data file for a relative path.
+  * Every location of the path in the searchable data directories is
+  * watched, including locations whose directories do not exist yet.
+  * @param relativePath Relative path to watch.
+  * @param callback Function called when the effective file changes.
+  * @param userData Pointer passed to the callback.
+  * @param watcher Watcher to add the watch to.
+  * @param handle Handle to data cache, initialized with xdgInitHandle().
+  * 	The directories are copied, later updates of the handle do not
+  * 	affect the watch.
+  * @return An identifier of the watch for xdgUnwatch(), or -1 if an error
+  * 	occured (in which case errno will be set) */
+int xdgWatchData(const char *relativePath, xdgWatchCallback callback, void *userData,
+	xdgWatcher *watcher, xdgHandle *handle);
+
+/** Watch the effective config file for a relative path.
+  * @see xdgWatchData()
+  * @return An identifier of the watch for xdgUnwatch(), or -1 if an error
+  * 	occured (in which case errno will be set) */
+int xdgWatchConfig(const char *relativePath, xdgWatchCallback callback, void *userData,
+	xdgWatcher *watcher, xdgHandle *handle);
+
+/** Remove a watch.
+  * @param watcher Watcher the watch was added to.
+  * @param id Identifier returned by xdgWatchData() or xdgWatchConfig().
+  * @return Zero on success, -1 if an error occured (in which case errno will
+  * 	be set) */
+int xdgUnwatch(xdgWatcher *watcher, int id);
+
+/*@}*/
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /*XDG_BASEDIR_WATCH_H*/
@@ -44,6 +44,18 @@
 
 #include <errno.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#ifdef HAVE_PTHREAD
+#  include <pthread.h>
+#  include <signal.h>
+#endif
+#ifdef HAVE_SYS_VFS_H
+#  include <sys/vfs.h>
+#endif
+#include <time.h>
 
 #ifdef FALSE
 #undef FALSE
@@ -81,8 +93,15 @@ static void xdgZeroMemory(void* p, int n)
 #  define NO_ESCAPES_IN_PATHS
 #endif
 
+#ifdef O_CLOEXEC
+#  define XDG_O_CLOEXEC O_CLOEXEC
+#else
+#  define XDG_O_CLOEXEC 0
+#endif
+
 #include <basedir.h>
 #include <basedir_fs.h>
+#include "basedir_private.h"
 
 #ifndef MAX
 #define MAX(a, b) ((b) > (a) ? (b) : (a))
@@ -100,6 +119,122 @@ static const char
 	*DefaultDataDirectoriesList[] = { DefaultDataDirectories1, DefaultDataDirectories2, NULL },
 	*DefaultConfigDirectoriesList[] = { DefaultConfigDirectories, NULL };
 
+/** Directory of a searchable list, prepared for composing paths. */
+typedef struct _xdgDirectory
+{
+	/** Directory path with exactly one trailing separator added if missing. */
+	const char * prefix;
+	/** Length of prefix. */
+	size_t length;
+	/** Descriptor of the directory if the list has descriptors, -1 if it does not exist. */
+	int fd;
+	/** Descriptor the directory had before it disappeared, or -1, see xdgOpenDirectoryFd(). */
+	int absentFd;
+	/** Identity of the directory when fd was opened. */
+	dev_t device;
+	ino_t inode;
+	/** Whether the directory is on a network or FUSE filesystem, see xdgClassifyDirectories(). */
+	int slow;
+	/** time() until which lookups skip the directory because it did not answer in time. */
+	long long demotedUntil;
+} xdgDirectory;
+
+/** Names in a subdirectory of every directory of a list, taken at one time.
+ * Snapshots are immutable and replaced as a whole when a directory changes. */
+typedef struct _xdgListingSnapshot
+{
+	/** Users of the snapshot, the last one frees it. */
+	int references;
+	unsigned int count;
+	/** Whether a subdirectory was modified so shortly before the snapshot
+	 * that a later change may not show in its modification time. */
+	int racy;
+	/** State of the subdirectory in each directory of the list. */
+	struct _xdgListedDirectory
+	{
+		/** Whether the subdirectory exists. */
+		int exists;
+		/** Whether the subdirectory could be read. */
+		int listed;
+		dev_t device;
+		ino_t inode;
+		long long mtime;
+		/** Open addressing table of name hashes, 0 for unused slots. */
+		unsigned long long * table;
+		unsigned long long mask;
+	} * directories;
+} xdgListingSnapshot;
+
+/** Subdirectory whose listing is cached, see xdgDataCacheListing(). */
+typedef struct _xdgListing
+{
+	/** Relative path of the subdirectory without leading and with one
+	 * trailing separator. */
+	char * relative;
+	size_t length;
+	/** Current snapshot, or @c NULL until the first lookup. */
+	xdgListingSnapshot * snapshot;
+	/** time() at which the snapshot was last compared to the directories. */
+	long long checked;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t mutex;
+#endif
+	struct _xdgListing * next;
+} xdgListing;
+
+/** Searchable directory list prepared for composing paths.
+ * The items and their prefixes share a single allocation, unless the
+ * prefixes are interned in a pool. */
+typedef struct _xdgDirectoryList
+{
+	xdgDirectory * items;
+	unsigned int count;
+	/** Pool the items are interned in while they are unmodified, see
+	 * xdgOwnDirectoryItems(), or @c NULL if the list owns them. */
+	xdgStringPool * shared;
+	/** Length of the longest prefix. */
+	size_t maxLength;
+	/** Whether lookups go through xdgDirectory::fd. */
+	int hasFds;
+	/** Milliseconds lookups wait for slow directories, 0 to wait as long as they take. */
+	unsigned int deadline;
+	/** Subdirectories whose listings are cached, or @c NULL for lists outside a cache. */
+	xdgListing ** listings;
+	/** Whether opens for reading probe every directory at once. */
+	int parallel;
+} xdgDirectoryList;
+
+/** Node of the trie of path components of all base directories of a cache. */
+typedef struct _xdgPathNode
+{
+	/** Path component, pointing into a directory of the cache. */
+	const char * component;
+	size_t length;
+	/** Index of the parent node. */
+	unsigned int parent;
+	/** @c XDG_BASE_* value of the base directory ending at this node, or
+	 * @c XDG_BASE_NONE. */
+	int base;
+	/** Index of the base directory in its searchable list. */
+	unsigned int index;
+} xdgPathNode;
+
+/** Trie of the path components of all base directories of a cache.
+ * Children are found by hashing their parent and component, so that the
+ * cost of a step does not depend on the number of siblings. The trie, its
+ * nodes and its table share a single allocation. */
+typedef struct _xdgPathTrie
+{
+	/** Nodes, the first of which is the root. */
+	xdgPathNode * nodes;
+	/** Open addressing table of the indices of all nodes but the root,
+	 * 0 for unused slots. */
+	unsigned int * table;
+	unsigned int mask;
+	/** Number of nodes in use. */
+	unsigned int size;
+} xdgPathTrie;
+
 typedef struct _xdgCachedData
 {
 	char * dataHome;
@@ -107,23 +242,83 @@ typedef struct _xdgCachedData
 	char * cacheHome;
 	char * runtimeDirectory;
 	/* Note: string lists are null-terminated and all items */
-	/* are to be allocated using malloc. */
+	/* are to be allocated using malloc, or interned in the pool */
+	/* together with the lists themselves. */
 	char ** searchableDataDirectories;
 	char ** searchableConfigDirectories; 
+	/* The searchable lists prepared for lookups. */
+	xdgDirectoryList dataDirectories;
+	xdgDirectoryList configDirectories;
+	/* Hashes of the searchable directory lists, identifying them */
+	/* in the shared resolution cache. */
+	unsigned long long dataFingerprint;
+	unsigned long long configFingerprint;
+	/* Trie of all base directories for xdgClassifyPath(). */
+	xdgPathTrie * pathTrie;
+	/* Subdirectories whose listings are cached, kept across xdgUpdateData(). */
+	xdgListing * dataListings;
+	xdgListing * configListings;
+	/* Shared resolution cache, kept across xdgUpdateData(). */
+	xdgSharedCache * sharedCache;
+	/* Deadline set with xdgSetLookupDeadline(), kept across xdgUpdateData(). */
+	unsigned int deadline;
+	/* Flags passed to xdgInitHandleWithFlags(). */
+	unsigned int flags;
+	/* Variables passed to xdgInitHandleFromEnv(), or NULL to read */
+	/* the environment of the process. Kept across xdgUpdateData(). */
+	char ** environment;
+	/* Variables of the environment of the process read when a handle */
+	/* with XDG_HANDLE_LAZY was updated, see xdgSnapshotVariables(). */
+	char ** variables;
+	/* Pool the strings of the cache are interned in, or NULL. */
+	xdgStringPool * pool;
+	/* XDG_FIELD_* bits of the fields which were computed. */
+	unsigned int ready;
+#ifdef HAVE_PTHREAD
+	/* Serializes computing fields of handles with XDG_HANDLE_LAZY. */
+	pthread_mutex_t mutex;
+#endif
 } xdgCachedData;
 
+/** @name Fields of xdgCachedData which are computed together */
+/*@{*/
+#define XDG_FIELD_DATA_HOME 0x1
+#define XDG_FIELD_CONFIG_HOME 0x2
+#define XDG_FIELD_CACHE_HOME 0x4
+#define XDG_FIELD_RUNTIME_DIRECTORY 0x8
+/** searchableDataDirectories, dataDirectories and dataFingerprint. */
+#define XDG_FIELD_DATA_DIRECTORIES 0x10
+/** searchableConfigDirectories, configDirectories and configFingerprint. */
+#define XDG_FIELD_CONFIG_DIRECTORIES 0x20
+/** pathTrie, which needs every other field. */
+#define XDG_FIELD_PATH_TRIE 0x40
+#define XDG_FIELD_ALL 0x7f
+/*@}*/
+
 /** Get cache object associated with a handle */
 static xdgCachedData* xdgGetCache(xdgHandle *handle)
 {
 	return ((xdgCachedData*)(handle->reserved));
 }
 
+static int xdgUpdateDataFrom(xdgHandle *handle, unsigned int flags, char **environment, xdgStringPool *pool);
+static void xdgDestroyCache(xdgCachedData *cache);
+static int xdgImportInheritedHandle(xdgHandle *handle, unsigned int flags);
+
 xdgHandle * xdgInitHandle(xdgHandle *handle)
+{
+	return xdgInitHandleWithFlags(handle, 0);
+}
+
+xdgHandle * xdgInitHandleWithFlags(xdgHandle *handle, unsigned int flags)
 {
 	if (!handle) return 0;
 	handle->reserved = 0; /* So xdgUpdateData() doesn't free it */
-	if (xdgUpdateData(handle))
+	if (xdgImportInheritedHandle(handle, flags) || xdgUpdateDataFrom(handle, flags, 0, 0))
+	{
+		xdgProfileStart(handle);
 		return handle;
+	}
 	return 0;
 }
 
@@ -137,43 +332,246 @@ static void xdgFreeStringList(char** list)
 	free(list);
 }
 
+/** Copy a string, interning it if a pool is given.
+ * @param pool Pool to intern the string in, or @c NULL to allocate a copy.
+ * @param string String to copy, which need not be null-terminated.
+ * @param length Number of characters in string.
+ */
+static char * xdgDupString(xdgStringPool *pool, const char *string, size_t length)
+{
+	char * copy;
+	if (pool)
+		return xdgPoolIntern(pool, string, length);
+	if (!(copy = (char*)malloc(length+1)))
+		return 0;
+	memcpy(copy, string, length);
+	copy[length] = 0;
+	return copy;
+}
+
+/** Free a string copied with xdgDupString(). */
+static void xdgFreeString(xdgStringPool *pool, char *string)
+{
+	if (pool)
+		xdgPoolRelease(pool, string);
+	else
+		free(string);
+}
+
+/** Free a NULL-terminated list of strings copied with xdgDupString(). */
+static void xdgFreePooledStringList(xdgStringPool *pool, char **list)
+{
+	char** ptr = list;
+	if (!pool)
+	{
+		xdgFreeStringList(list);
+		return;
+	}
+	if (!list) return;
+	for (; *ptr; ptr++)
+		xdgPoolRelease(pool, *ptr);
+	free(list);
+}
+
+/** Replace an allocated string by its interned copy, if a pool is given.
+ * If interning fails the string is freed and set to @c NULL.
+ * @return Non-zero on success.
+ */
+static int xdgInternString(xdgStringPool *pool, char **string)
+{
+	char * interned;
+	if (!pool || !*string) return TRUE;
+	interned = xdgPoolIntern(pool, *string, strlen(*string));
+	free(*string);
+	*string = interned;
+	return interned != 0;
+}
+
+/** Replace the allocated strings of a list from index first on by their
+ * interned copies, if a pool is given.
+ * If interning fails the list is truncated, so that all its items are interned.
+ * @return Non-zero on success.
+ */
+static int xdgInternStringList(xdgStringPool *pool, char **list, unsigned int first)
+{
+	unsigned int i;
+	for (i = first; list[i]; ++i)
+	{
+		if (!xdgInternString(pool, &list[i]))
+		{
+			for (++i; list[i]; ++i)
+			{
+				free(list[i]);
+				list[i] = 0;
+			}
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/** Close the directory descriptors of a prepared directory list. */
+static void xdgCloseDirectoryFds(xdgDirectoryList *list)
+{
+	unsigned int i;
+	if (!list->hasFds) return;
+	for (i = 0; i < list->count; ++i)
+	{
+		if (list->items[i].fd != -1)
+			close(list->items[i].fd);
+		if (list->items[i].absentFd != -1)
+			close(list->items[i].absentFd);
+	}
+	list->hasFds = FALSE;
+}
+
+/** Free a prepared directory list and set it to empty.
+ * @param list List prepared with xdgPrepareDirectoryList().
+ * @param pool Pool the list was prepared with, or @c NULL.
+ */
+static void xdgFreeDirectoryList(xdgDirectoryList *list, xdgStringPool *pool)
+{
+	unsigned int i;
+	xdgCloseDirectoryFds(list);
+	if (pool)
+		for (i = 0; i < list->count; ++i)
+			xdgPoolRelease(pool, (char*)list->items[i].prefix);
+	if (list->shared)
+		xdgPoolRelease(list->shared, list->items);
+	else
+		free(list->items);
+	xdgZeroMemory(list, sizeof(xdgDirectoryList));
+}
+
+/** Free a searchable directory list of a cache.
+ * The first element is the home directory, which is owned by the cache.
+ * @param pool Pool the strings and the list are interned in, or @c NULL.
+ */
+static void xdgFreeSearchableList(xdgStringPool *pool, char **list)
+{
+	char** ptr;
+	if (!list) return;
+	for (ptr = list+1; *ptr; ptr++)
+		xdgFreeString(pool, *ptr);
+	if (pool)
+		xdgPoolRelease(pool, list);
+	else
+		free(list);
+}
+
+/** Intern the strings of an allocated searchable list of a cache and then
+ * the list itself, if a pool is given. The first element is the home
+ * directory, which is already interned.
+ * If interning fails the list is freed, except for its home directory, and
+ * set to @c NULL.
+ * @return Non-zero on success.
+ */
+static int xdgShareSearchableList(xdgStringPool *pool, char ***list)
+{
+	char ** shared = 0;
+	char ** ptr;
+	if (!pool) return TRUE;
+	if (xdgInternStringList(pool, *list, 1))
+	{
+		for (ptr = *list; *ptr; ++ptr) ;
+		shared = (char**)xdgPoolShare(pool, *list, sizeof(char*)*(ptr - *list + 1));
+	}
+	if (!shared)
+		for (ptr = *list+1; *ptr; ptr++)
+			xdgPoolRelease(pool, *ptr);
+	free(*list);
+	*list = shared;
+	return shared != 0;
+}
+
+/** Remove a user of a listing snapshot, freeing it when it was the last. */
+static void xdgReleaseListing(xdgListingSnapshot *snapshot)
+{
+	if (!snapshot)
+		return;
+#if defined(__GNUC__)
+	if (__atomic_sub_fetch(&snapshot->references, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+#else
+	if (--snapshot->references != 0)
+		return;
+#endif
+	free(snapshot);
+}
+
+/** Forget the snapshots of cached listings, so that they are taken again. */
+static void xdgResetListings(xdgListing *listings)
+{
+	for (; listings; listings = listings->next)
+	{
+		xdgReleaseListing(listings->snapshot);
+		listings->snapshot = 0;
+	}
+}
+
+/** Free a list of cached listings. */
+static void xdgFreeListings(xdgListing *listings)
+{
+	xdgListing * next;
+	for (; listings; listings = next)
+	{
+		next = listings->next;
+		xdgReleaseListing(listings->snapshot);
+#ifdef HAVE_PTHREAD
+		pthread_mutex_destroy(&listings->mutex);
+#endif
+		free(listings);
+	}
+}
+
 /** Free all data in the cache and set pointers to null. */
 static void xdgFreeData(xdgCachedData *cache)
 {
 	if (cache->dataHome)
 	{
-		/* the first element of the directory lists is usually the home directory */
-		if (cache->searchableDataDirectories && cache->searchableDataDirectories[0] != cache->dataHome)
-			free(cache->dataHome);
+		xdgFreeString(cache->pool, cache->dataHome);
 		cache->dataHome = 0;
 	}
 	if (cache->configHome)
 	{
-		if (cache->searchableConfigDirectories && cache->searchableConfigDirectories[0] != cache->configHome)
-			free(cache->configHome);
+		xdgFreeString(cache->pool, cache->configHome);
 		cache->configHome = 0;
 	}
 	if (cache->cacheHome)
 	{
-		free(cache->cacheHome);
+		xdgFreeString(cache->pool, cache->cacheHome);
 		cache->cacheHome = 0;
 	}
 	if (cache->runtimeDirectory)
 	{
-		free(cache->runtimeDirectory);
+		xdgFreeString(cache->pool, cache->runtimeDirectory);
 		cache->runtimeDirectory = 0;
 	}
-	xdgFreeStringList(cache->searchableDataDirectories);
+	xdgFreeSearchableList(cache->pool, cache->searchableDataDirectories);
 	cache->searchableDataDirectories = 0;
-	xdgFreeStringList(cache->searchableConfigDirectories);
+	xdgFreeSearchableList(cache->pool, cache->searchableConfigDirectories);
 	cache->searchableConfigDirectories = 0;
+	xdgFreeDirectoryList(&cache->dataDirectories, cache->pool);
+	xdgFreeDirectoryList(&cache->configDirectories, cache->pool);
+	free(cache->pathTrie);
+	cache->pathTrie = 0;
+	xdgFreeListings(cache->dataListings);
+	cache->dataListings = 0;
+	xdgFreeListings(cache->configListings);
+	cache->configListings = 0;
+	xdgFreePooledStringList(cache->pool, cache->environment);
+	cache->environment = 0;
+	free(cache->variables);
+	cache->variables = 0;
+	cache->ready = 0;
 }
 
 void xdgWipeHandle(xdgHandle *handle)
 {
 	xdgCachedData* cache = xdgGetCache(handle);
-	xdgFreeData(cache);
-	free(cache);
+	if (cache->sharedCache)
+		xdgSharedCacheUnmap(cache->sharedCache);
+	xdgDestroyCache(cache);
 }
 
 /** Split string at ':', return null-terminated list of resulting strings.
@@ -234,19 +632,38 @@ static char** xdgSplitPath(const char* string)
 	return itemlist;
 }
 
+/** Look up a variable in an environment.
+ * @param environment List of @c NAME=value strings, or @c NULL to read the
+ * 	environment of the process.
+ * @param name Name of environment variable.
+ * @return The value, or @c NULL if the variable is not set.
+ */
+static const char* xdgLookupEnv(const char * const * environment, const char *name)
+{
+	size_t length;
+	if (!environment)
+		return getenv(name);
+	length = strlen(name);
+	for (; *environment; ++environment)
+		if (strncmp(*environment, name, length) == 0 && (*environment)[length] == '=')
+			return *environment + length + 1;
+	return NULL;
+}
+
 /** Get $PATH-style environment variable as list of strings.
  * If $name is unset or empty, use default strings specified by variable arguments.
+ * @param environment Environment to read, or @c NULL for the environment of the process.
  * @param name Name of environment variable
  * @param defaults NULL-terminated list of strings to be copied and used as defaults
  */
-static char** xdgGetPathListEnv(const char* name, const char ** defaults)
+static char** xdgGetPathListEnv(const char * const * environment, const char* name, const char ** defaults)
 {
 	const char* env;
 	char* item;
 	char** itemlist;
 	int i, size;
 
-	env = getenv(name);
+	env = xdgLookupEnv(environment, name);
 	if (env && env[0])
 	{
 		if (!(item = (char*)malloc(strlen(env)+1))) return NULL;
@@ -275,12 +692,13 @@ static char** xdgGetPathListEnv(const char* name, const char ** defaults)
 
 /** Get value of an environment variable.
  * Sets @c errno to @c EINVAL if variable is not set or empty.
+ * @param environment Environment to read, or @c NULL for the environment of the process.
  * @param name Name of environment variable.
  * @return The environment variable or NULL if an error occurs.
  */
-static char* xdgGetEnv(const char *name)
+static const char* xdgGetEnv(const char * const * environment, const char *name)
 {
-	char *env = getenv(name);
+	const char *env = xdgLookupEnv(environment, name);
 	if (env && env[0])
 		return env;
 	/* What errno signifies missing env var? */
@@ -291,74 +709,48 @@ static char* xdgGetEnv(const char *name)
 /** Duplicate an environment variable.
  * Sets @c errno to @c ENOMEM if unable to allocate duplicate string.
  * Sets @c errno to @c EINVAL if variable is not set or empty.
+ * @param environment Environment to read, or @c NULL for the environment of the process.
+ * @param name Name of environment variable.
  * @return The duplicated string or NULL if an error occurs.
  */
-static char* xdgEnvDup(const char *name)
+static char* xdgEnvDup(const char * const * environment, const char *name)
 {
 	const char *env;
-	if ((env = xdgGetEnv(name)))
+	if ((env = xdgGetEnv(environment, name)))
 		return strdup(env);
 	else
 		return NULL;
 }
 
-/** Update all *Home variables of cache.
- * This includes xdgCachedData::dataHome, xdgCachedData::configHome and xdgCachedData::cacheHome.
- * @param cache Data cache to be updated
+/** Get a home directory from the environment or a fallback relative to @c \$HOME.
+ * Sets @c errno to @c ENOMEM if unable to allocate duplicate string.
+ * Sets @c errno to @c EINVAL if variable is not set or empty.
+ * @param environment Environment to read, or @c NULL for the environment of the process.
+ * @param envname Name of environment variable.
+ * @param relativefallback Path starting with "/" and relative to @c \$HOME to use as fallback.
+ * @param fallbacklength @c strlen(relativefallback).
+ * @return The home directory path or @c NULL of an error occurs.
  */
-static int xdgUpdateHomeDirectories(xdgCachedData* cache)
+static char * xdgGetRelativeHome(const char * const * environment, const char *envname,
+	const char *relativefallback, unsigned int fallbacklength)
 {
-	const char *homeenv;
-	char *value;
-	unsigned int homelen;
-	static const unsigned int extralen =
-		MAX(MAX(sizeof(DefaultRelativeDataHome),
-					sizeof(DefaultRelativeConfigHome)),
-				sizeof(DefaultRelativeCacheHome));
-
-	if (!(cache->dataHome = xdgEnvDup("XDG_DATA_HOME")) && errno == ENOMEM) return FALSE;
-	if (!(cache->configHome = xdgEnvDup("XDG_CONFIG_HOME")) && errno == ENOMEM) return FALSE;
-	if (!(cache->cacheHome = xdgEnvDup("XDG_CACHE_HOME")) && errno == ENOMEM) return FALSE;
-	if (!(cache->runtimeDirectory = xdgEnvDup("XDG_RUNTIME_DIR")) && errno == ENOMEM) return FALSE;
-	errno = 0;
-
-	if (cache->dataHome && cache->configHome && cache->cacheHome) return TRUE;
-
-	if (!(homeenv = xdgGetEnv("HOME")))
-		return FALSE;
-
-	/* Allocate maximum needed for any of the 3 default values */
-	homelen = strlen(homeenv);
-	value = malloc(homelen + extralen);
-	if (value == NULL) return FALSE;
-	memcpy(value, homeenv, homelen+1);
-
-	if (!cache->dataHome)
-	{
-		memcpy(value+homelen, DefaultRelativeDataHome, sizeof(DefaultRelativeDataHome));
-		cache->dataHome = strdup(value);
-	}
-
-	if (!cache->configHome)
-	{
-		memcpy(value+homelen, DefaultRelativeConfigHome, sizeof(DefaultRelativeConfigHome));
-		cache->configHome = strdup(value);
-	}
-
-	if (!cache->cacheHome)
+	char *relhome;
+	if (!(relhome = xdgEnvDup(environment, envname)) && errno != ENOMEM)
 	{
-		memcpy(value+homelen, DefaultRelativeCacheHome, sizeof(DefaultRelativeCacheHome));
-		cache->cacheHome = strdup(value);
+		errno = 0;
+		const char *home;
+		unsigned int homelen;
+		if (!(home = xdgGetEnv(environment, "HOME")))
+			return NULL;
+		if (!(relhome = (char*)malloc((homelen = strlen(home))+fallbacklength+1))) return NULL;
+		memcpy(relhome, home, homelen);
+		memcpy(relhome+homelen, relativefallback, fallbacklength+1);
 	}
-
-	free(value);
-
-	/* free does not change errno, and the prev call *must* have been a strdup,
-	 * so errno is already set. */
-	return cache->dataHome && cache->configHome && cache->cacheHome;
+	return relhome;
 }
 
 /** Get directory lists with initial home directory.
+ * @param environment Environment to read, or @c NULL for the environment of the process.
  * @param envname Environment variable with colon-seperated directories.
  * @param homedir Home directory for this directory list or NULL. This
  *                parameter should be allocated on the heap. The returned list
@@ -369,13 +761,13 @@ static int xdgUpdateHomeDirectories(xdgCachedData* cache)
  *         with malloc(). The function xdgFreeStringList is provided for
  *         conveniantly free()-ing the list and all its elements.
  */
-static char** xdgGetDirectoryLists(const char *envname, char *homedir, const char **defaults)
+static char** xdgGetDirectoryLists(const char * const * environment, const char *envname, char *homedir, const char **defaults)
 {
 	char **envlist;
 	char **dirlist;
 	unsigned int size;
 
-	if (!(envlist = xdgGetPathListEnv(envname, defaults)))
+	if (!(envlist = xdgGetPathListEnv(environment, envname, defaults)))
 		return NULL;
 
 	for (size = 0; envlist[size]; size++) ; /* Get list size */
@@ -394,301 +786,3771 @@ static char** xdgGetDirectoryLists(const char *envname, char *homedir, const cha
 	return dirlist;
 }
 
-/** Update all *Directories variables of cache.
- * This includes xdgCachedData::searchableDataDirectories and xdgCachedData::searchableConfigDirectories.
- * @param cache Data cache to be updated.
+/** Hash a directory list so that it can be identified across processes.
+ * @param dirList <tt>NULL</tt>-terminated list of directory paths.
  */
-static int xdgUpdateDirectoryLists(xdgCachedData* cache)
+static unsigned long long xdgGetListFingerprint(const char * const * dirList)
 {
-	if (!(cache->searchableDataDirectories = xdgGetDirectoryLists(
-			"XDG_DATA_DIRS", cache->dataHome, DefaultDataDirectoriesList)))
-		return FALSE;
-	if (!(cache->searchableConfigDirectories = xdgGetDirectoryLists(
-			"XDG_CONFIG_DIRS", cache->configHome, DefaultConfigDirectoriesList)))
-		return FALSE;
-
-	return TRUE;
+	unsigned long long hash = XDG_HASH_INIT;
+	for (; *dirList; ++dirList)
+		hash = xdgHashBytes(hash, *dirList, strlen(*dirList)+1);
+	return hash;
 }
 
-int xdgUpdateData(xdgHandle *handle)
+/** Prepare a directory list for composing paths.
+ * The length of every directory is computed once and a missing trailing
+ * separator is added, so that lookups only need to copy the prefix.
+ * @param dirList <tt>NULL</tt>-terminated list of directory paths.
+ * @param list List to fill, free it with xdgFreeDirectoryList().
+ * @param pool Pool to intern the prefixes in, or @c NULL to store them
+ * 	in the allocation of the items.
+ */
+static int xdgPrepareDirectoryList(const char * const * dirList, xdgDirectoryList *list, xdgStringPool *pool)
 {
-	xdgCachedData* cache = (xdgCachedData*)malloc(sizeof(xdgCachedData));
-	xdgCachedData* oldCache;
-	if (!cache) return FALSE;
-	xdgZeroMemory(cache, sizeof(xdgCachedData));
+	size_t total = 0, longest = 0, length;
+	unsigned int i, count;
+	xdgDirectory * items;
+	char * prefix;
+	char * scratch = 0;
 
-	if (xdgUpdateHomeDirectories(cache) &&
-		xdgUpdateDirectoryLists(cache))
+	for (count = 0; dirList[count]; ++count)
 	{
-		/* Update successful, replace pointer to old cache with pointer to new cache */
-		oldCache = xdgGetCache(handle);
-		handle->reserved = cache;
-		if (oldCache)
-		{
-			xdgFreeData(oldCache);
-			free(oldCache);
-		}
-		return TRUE;
+		length = strlen(dirList[count]);
+		total += length + 2;
+		longest = MAX(longest, length);
 	}
-	else
+	if (pool)
 	{
-		/* Update failed, discard new cache and leave old cache unmodified */
-		xdgFreeData(cache);
-		free(cache);
+		/* Only the items are per list, the prefixes are built in scratch. */
+		total = 0;
+		if (!(scratch = (char*)malloc(longest + 2)))
+			return FALSE;
+	}
+	if (!(list->items = (xdgDirectory*)malloc(sizeof(xdgDirectory)*(count ? count : 1) + total)))
+	{
+		free(scratch);
 		return FALSE;
 	}
-}
-
-/** Find all existing files corresponding to relativePath relative to each item in dirList.
-  * @param relativePath Relative path to search for.
-  * @param dirList <tt>NULL</tt>-terminated list of directory paths.
-  * @return A sequence of null-terminated strings terminated by a
-  * 	double-<tt>NULL</tt> (empty string) and allocated using malloc().
-  */
-static char * xdgFindExisting(const char * relativePath, const char * const * dirList)
-{
-	char * fullPath;
-	char * returnString = 0;
-	char * tmpString;
-	int strLen = 0;
-	FILE * testFile;
-	const char * const * item;
-
-	for (item = dirList; *item; item++)
+	/* Lists are interned by their bytes, including padding. */
+	xdgZeroMemory(list->items, sizeof(xdgDirectory)*(count ? count : 1));
+	list->count = 0;
+	list->shared = 0;
+	list->maxLength = 0;
+	list->hasFds = FALSE;
+	list->deadline = 0;
+	list->listings = 0;
+	list->parallel = FALSE;
+	prefix = pool ? scratch : (char*)(list->items + (count ? count : 1));
+	for (i = 0; i < count; ++i)
 	{
-		if (!(fullPath = (char*)malloc(strlen(*item)+strlen(relativePath)+2)))
-		{
-			if (returnString) free(returnString);
-			return 0;
-		}
-		strcpy(fullPath, *item);
-		if (fullPath[strlen(fullPath)-1] != DIR_SEPARATOR_CHAR)
-			strcat(fullPath, DIR_SEPARATOR_STR);
-		strcat(fullPath, relativePath);
-		testFile = fopen(fullPath, "r");
-		if (testFile)
+		length = strlen(dirList[i]);
+		memcpy(prefix, dirList[i], length);
+		if (length == 0 || prefix[length-1] != DIR_SEPARATOR_CHAR)
+			prefix[length++] = DIR_SEPARATOR_CHAR;
+		prefix[length] = 0;
+		if (pool)
 		{
-			if (!(tmpString = (char*)realloc(returnString, strLen+strlen(fullPath)+2)))
+			if (!(list->items[i].prefix = xdgPoolIntern(pool, prefix, length)))
 			{
-				free(returnString);
-				free(fullPath);
-				return 0;
+				free(scratch);
+				return FALSE;
 			}
-			returnString = tmpString;
-			strcpy(&returnString[strLen], fullPath);
-			strLen = strLen+strlen(fullPath)+1;
-			fclose(testFile);
 		}
-		free(fullPath);
+		else
+		{
+			list->items[i].prefix = prefix;
+			prefix += length + 1;
+		}
+		list->items[i].length = length;
+		list->items[i].fd = -1;
+		list->items[i].absentFd = -1;
+		list->items[i].slow = FALSE;
+		list->items[i].demotedUntil = 0;
+		list->maxLength = MAX(list->maxLength, length);
+		list->count++;
 	}
-	if (returnString)
-		returnString[strLen] = 0;
-	else
+	free(scratch);
+	/* With interned prefixes the items of equal lists are equal too. */
+	if (pool)
 	{
-		if ((returnString = (char*)malloc(2)))
-			strcpy(returnString, "\0");
+		if (!(items = (xdgDirectory*)xdgPoolShare(pool, list->items, sizeof(xdgDirectory)*(count ? count : 1))))
+			return FALSE;
+		free(list->items);
+		list->items = items;
+		list->shared = pool;
 	}
-	return returnString;
+	return TRUE;
 }
 
-/** Open first possible config file corresponding to relativePath.
-  * @param relativePath Path to scan for.
-  * @param mode Mode with which to attempt to open files (see fopen modes).
-  * @param dirList <tt>NULL</tt>-terminated list of paths in which to search for relativePath.
-  * @return File pointer if successful else @c NULL. Client must use @c fclose to close file.
-  */
-static FILE * xdgFileOpen(const char * relativePath, const char * mode, const char * const * dirList)
+/** Give a prepared list a copy of its items before they are modified, if
+ * they are interned in a pool.
+ * @return Non-zero on success.
+ */
+static int xdgOwnDirectoryItems(xdgDirectoryList *list)
 {
-	char * fullPath;
-	FILE * testFile;
-	const char * const * item;
+	xdgDirectory * items;
+	size_t size = sizeof(xdgDirectory)*(list->count ? list->count : 1);
+	if (!list->shared) return TRUE;
+	if (!(items = (xdgDirectory*)malloc(size)))
+		return FALSE;
+	memcpy(items, list->items, size);
+	xdgPoolRelease(list->shared, list->items);
+	list->items = items;
+	list->shared = 0;
+	return TRUE;
+}
 
-	for (item = dirList; *item; item++)
-	{
-		if (!(fullPath = (char*)malloc(strlen(*item)+strlen(relativePath)+2)))
-			return 0;
-		strcpy(fullPath, *item);
-		if (fullPath[strlen(fullPath)-1] != DIR_SEPARATOR_CHAR)
-			strcat(fullPath, DIR_SEPARATOR_STR);
-		strcat(fullPath, relativePath);
-		testFile = fopen(fullPath, mode);
-		free(fullPath);
-		if (testFile)
-			return testFile;
-	}
-	return 0;
+#if defined(HAVE_OPENAT) && defined(HAVE_FACCESSAT)
+
+/** Open a descriptor only used to open files relative to a directory. */
+static int xdgOpenDirectoryPath(const char *path)
+{
+#  ifdef O_PATH
+	return open(path, O_PATH | O_DIRECTORY | XDG_O_CLOEXEC);
+#  else
+	return open(path, O_RDONLY | O_DIRECTORY | XDG_O_CLOEXEC);
+#  endif
 }
 
-int xdgMakePath(const char * path, mode_t mode)
+/** Make a descriptor refer to another directory without closing it.
+ * Duplicating onto the descriptor number replaces it atomically, so that
+ * concurrent lookups using it never see it closed or reused.
+ * @param fresh Descriptor of the directory, which is closed.
+ * @param fd Descriptor to replace.
+ * @return Non-zero on success.
+ */
+static int xdgReplaceDirectoryFd(int fresh, int fd)
 {
-	int length = strlen(path);
-	char * tmpPath;
-	char * tmpPtr;
-	int ret;
+	int ok;
+#  ifdef HAVE_DUP3
+	ok = dup3(fresh, fd, XDG_O_CLOEXEC) != -1;
+#  else
+	ok = dup2(fresh, fd) != -1 && fcntl(fd, F_SETFD, FD_CLOEXEC) != -1;
+#  endif
+	close(fresh);
+	return ok;
+}
 
-	if (length == 0 || (length == 1 && path[0] == DIR_SEPARATOR_CHAR))
-		return 0;
+/** Make the descriptor of a directory refer to the directory now at its
+ * path, after a network filesystem reported it as stale. Its identity is
+ * left for xdgRevalidateHandle() to update.
+ * @return Non-zero on success. */
+static int xdgRefreshDirectoryFd(xdgDirectory *dir)
+{
+	int fresh = xdgOpenDirectoryPath(dir->prefix);
+	return fresh != -1 && xdgReplaceDirectoryFd(fresh, dir->fd);
+}
 
-	if (!(tmpPath = (char*)malloc(length+1)))
+#endif
+
+/** Open or reopen the descriptor of a directory.
+ * A directory which does not exist gets a descriptor of -1, so that
+ * lookups skip it without any system call. A directory which was replaced
+ * keeps its descriptor number. The descriptor of a directory which was
+ * removed stays open until the list is freed, as concurrent lookups may
+ * still use it, and opening files relative to it fails like in a missing
+ * directory. The directory gets the number back if it is created again.
+ * @return Non-zero if the descriptor changed.
+ */
+static int xdgOpenDirectoryFd(xdgDirectory *dir)
+{
+#if defined(HAVE_OPENAT) && defined(HAVE_FACCESSAT)
+	struct stat st;
+	int fd = xdgOpenDirectoryPath(dir->prefix);
+	if (fd != -1 && fstat(fd, &st) == -1)
 	{
-		errno = ENOMEM;
-		return -1;
+		close(fd);
+		fd = -1;
 	}
-	strcpy(tmpPath, path);
-	if (tmpPath[length-1] == DIR_SEPARATOR_CHAR)
-		tmpPath[length-1] = '\0';
-
-	/* skip tmpPath[0] since if it's a seperator we have an absolute path */
-	for (tmpPtr = tmpPath+1; *tmpPtr; ++tmpPtr)
+	if (fd != -1 && dir->fd != -1 && st.st_dev == dir->device && st.st_ino == dir->inode)
 	{
-		if (*tmpPtr == DIR_SEPARATOR_CHAR)
+		/* Still the same directory, keep the old descriptor. */
+		close(fd);
+		return FALSE;
+	}
+	if (fd == -1 && dir->fd == -1)
+		return FALSE;
+	if (fd == -1)
+	{
+		/* Keep the number from being reused before marking the directory absent. */
+		dir->absentFd = dir->fd;
+		dir->fd = -1;
+		return TRUE;
+	}
+	if (dir->fd != -1 || dir->absentFd != -1)
+	{
+		if (!xdgReplaceDirectoryFd(fd, dir->fd != -1 ? dir->fd : dir->absentFd))
+			return FALSE;
+		if (dir->fd == -1)
 		{
-			*tmpPtr = '\0';
-			if (mkdir(tmpPath, mode) == -1)
-			{
-				if (errno != EEXIST)
-				{
-					free(tmpPath);
-					return -1;
-				}
-			}
-			*tmpPtr = DIR_SEPARATOR_CHAR;
+			dir->fd = dir->absentFd;
+			dir->absentFd = -1;
 		}
 	}
-	ret = mkdir(tmpPath, mode);
-	free(tmpPath);
-	return ret;
+	else
+		dir->fd = fd;
+	dir->device = st.st_dev;
+	dir->inode = st.st_ino;
+	return TRUE;
+#else
+	return FALSE;
+#endif
 }
 
-/** Get a home directory from the environment or a fallback relative to @c \$HOME.
- * Sets @c errno to @c ENOMEM if unable to allocate duplicate string.
- * Sets @c errno to @c EINVAL if variable is not set or empty.
- * @param envname Name of environment variable.
- * @param relativefallback Path starting with "/" and relative to @c \$HOME to use as fallback.
- * @param fallbacklength @c strlen(relativefallback).
- * @return The home directory path or @c NULL of an error occurs.
+/** Open descriptors for all directories of a prepared list, if supported.
+ * @return Non-zero on success.
  */
-static char * xdgGetRelativeHome(const char *envname, const char *relativefallback, unsigned int fallbacklength)
+static int xdgOpenDirectoryFds(xdgDirectoryList *list)
 {
-	char *relhome;
-	if (!(relhome = xdgEnvDup(envname)) && errno != ENOMEM)
+#if defined(HAVE_OPENAT) && defined(HAVE_FACCESSAT)
+	unsigned int i;
+	if (!xdgOwnDirectoryItems(list))
+		return FALSE;
+	for (i = 0; i < list->count; ++i)
+		xdgOpenDirectoryFd(&list->items[i]);
+	list->hasFds = TRUE;
+#endif
+	return TRUE;
+}
+
+/** Seconds for which a directory which did not answer in time is skipped. */
+#define XDG_DEMOTE_SECONDS 30
+
+/** Check whether a directory is on a filesystem whose operations may block
+ * for a long time, such as a network or FUSE filesystem. */
+static int xdgIsSlowFilesystem(const char *path)
+{
+#if defined(HAVE_SYS_VFS_H) && defined(HAVE_STATFS)
+	struct statfs st;
+	if (statfs(path, &st) == -1)
+		return FALSE;
+	switch ((unsigned long)st.f_type & 0xffffffffUL)
+	{
+	case 0x6969UL:     /* NFS */
+	case 0x517BUL:     /* SMB */
+	case 0xFF534D42UL: /* CIFS */
+	case 0xFE534D42UL: /* SMB2 */
+	case 0x65735546UL: /* FUSE, such as sshfs */
+	case 0x73757245UL: /* Coda */
+	case 0x5346414FUL: /* AFS */
+	case 0x00C36400UL: /* Ceph */
+	case 0x01021997UL: /* 9P */
+		return TRUE;
+	}
+#endif
+	return FALSE;
+}
+
+/** Classify the directories of a prepared list and set the deadline of
+ * lookups in its slow directories.
+ * @param list Prepared list.
+ * @param deadline Milliseconds, see xdgSetLookupDeadline().
+ * @return Non-zero on success.
+ */
+static int xdgClassifyDirectories(xdgDirectoryList *list, unsigned int deadline)
+{
+	unsigned int i;
+	if (!list->deadline)
+	{
+		/* Slow directories are demoted, so the list needs items of its own. */
+		if (!xdgOwnDirectoryItems(list))
+			return FALSE;
+		for (i = 0; i < list->count; ++i)
+			list->items[i].slow = xdgIsSlowFilesystem(list->items[i].prefix);
+	}
+	list->deadline = deadline;
+	return TRUE;
+}
+
+/** Prepare a searchable directory list of a cache for lookups.
+ * On failure the list is freed, except for its home directory.
+ * @param cache Data cache whose list is prepared.
+ * @param searchable Searchable list, starting with the home directory of the cache.
+ * @param prepared Receives the prepared list.
+ * @param fingerprint Receives the hash of the list.
+ */
+static int xdgPrepareDirectories(xdgCachedData *cache, char ***searchable, xdgDirectoryList *prepared,
+	unsigned long long *fingerprint)
+{
+	if (!xdgShareSearchableList(cache->pool, searchable) ||
+		!xdgPrepareDirectoryList((const char * const *)*searchable, prepared, cache->pool) ||
+		((cache->flags & XDG_HANDLE_DIRECTORY_FDS) && !xdgOpenDirectoryFds(prepared)) ||
+		(cache->deadline && !xdgClassifyDirectories(prepared, cache->deadline)))
+	{
+		xdgFreeDirectoryList(prepared, cache->pool);
+		xdgFreeSearchableList(cache->pool, *searchable);
+		*searchable = 0;
+		return FALSE;
+	}
+	prepared->listings = prepared == &cache->dataDirectories ? &cache->dataListings : &cache->configListings;
+	prepared->parallel = (cache->flags & XDG_HANDLE_PARALLEL_OPEN) != 0;
+	*fingerprint = xdgGetListFingerprint((const char * const *)*searchable);
+	return TRUE;
+}
+
+/** Variables which determine the directories of a handle. */
+static const char
+	*SnapshotVariables[] = { "HOME", "XDG_DATA_HOME", "XDG_CONFIG_HOME", "XDG_CACHE_HOME",
+		"XDG_RUNTIME_DIR", "XDG_DATA_DIRS", "XDG_CONFIG_DIRS", NULL };
+
+/** Copy the variables which determine the directories of a handle from
+ * the environment of the process.
+ * @return List of @c NAME=value strings in a single block allocated with
+ * 	malloc(), or @c NULL if memory runs out.
+ */
+static char** xdgSnapshotVariables(void)
+{
+	const char * values[sizeof(SnapshotVariables)/sizeof(SnapshotVariables[0])];
+	size_t size = sizeof(values), length;
+	unsigned int i, count = 0;
+	char ** copy;
+	char * strings;
+
+	for (i = 0; SnapshotVariables[i]; ++i)
+		if ((values[i] = getenv(SnapshotVariables[i])))
+			size += strlen(SnapshotVariables[i]) + strlen(values[i]) + 2;
+	if (!(copy = (char**)malloc(size)))
+		return NULL;
+	strings = (char*)(copy + sizeof(values)/sizeof(values[0]));
+	for (i = 0; SnapshotVariables[i]; ++i)
+	{
+		if (!values[i])
+			continue;
+		copy[count++] = strings;
+		length = strlen(SnapshotVariables[i]);
+		memcpy(strings, SnapshotVariables[i], length);
+		strings[length] = '=';
+		strcpy(strings + length + 1, values[i]);
+		strings += length + strlen(values[i]) + 2;
+	}
+	copy[count] = 0;
+	return copy;
+}
+
+/** Get the environment the fields of a cache are computed from.
+ * @return List of @c NAME=value strings, or @c NULL for the environment
+ * 	of the process. */
+static const char * const * xdgGetCacheEnvironment(const xdgCachedData *cache)
+{
+	return (const char * const *)(cache->environment ? cache->environment : cache->variables);
+}
+
+/** Compute a searchable directory list of a cache and prepare it for lookups.
+ * On failure nothing is left allocated.
+ * @param cache Data cache whose list is computed.
+ * @param envname Environment variable with colon-seperated directories.
+ * @param home Home directory of the cache, which starts the list.
+ * @param defaults Default directories if environment variable is not set.
+ * @param searchable Receives the searchable list.
+ * @param prepared Receives the prepared list.
+ * @param fingerprint Receives the hash of the list.
+ */
+static int xdgComputeDirectories(xdgCachedData *cache, const char *envname, char *home, const char **defaults,
+	char ***searchable, xdgDirectoryList *prepared, unsigned long long *fingerprint)
+{
+	if (!(*searchable = xdgGetDirectoryLists(xdgGetCacheEnvironment(cache), envname, home, defaults)))
+		return FALSE;
+	return xdgPrepareDirectories(cache, searchable, prepared, fingerprint);
+}
+
+/** Get the length of the path component at the start of a path.
+ * @param path Path starting with a component, not a separator.
+ */
+static size_t xdgComponentLength(const char *path)
+{
+	const char * end = strchr(path, DIR_SEPARATOR_CHAR);
+	return end ? (size_t)(end - path) : strlen(path);
+}
+
+/** Skip the separators at the start of a path. */
+static const char * xdgSkipSeparators(const char *path)
+{
+	while (*path == DIR_SEPARATOR_CHAR) ++path;
+	return path;
+}
+
+/** Count the nodes a directory may add to a path trie. */
+static unsigned int xdgCountComponents(const char *path)
+{
+	unsigned int count = 0;
+	for (path = xdgSkipSeparators(path); *path; path = xdgSkipSeparators(path + xdgComponentLength(path)))
+		++count;
+	return count;
+}
+
+/** Find the child of a node of a path trie.
+ * @param trie Path trie.
+ * @param parent Index of the node.
+ * @param component Path component of the child, which need not be null-terminated.
+ * @param length Length of component.
+ * @param slot Receives the slot of the child in the table of the trie, or
+ * 	the free slot for it if there is none.
+ * @return The index of the child, or 0 if there is none.
+ */
+static unsigned int xdgFindPathChild(const xdgPathTrie *trie, unsigned int parent, const char *component, size_t length,
+	unsigned int *slot)
+{
+	unsigned long long hash = xdgHashBytes(xdgHashBytes(XDG_HASH_INIT, &parent, sizeof(parent)), component, length);
+	const xdgPathNode * node;
+	unsigned int h, child;
+
+	for (h = hash & trie->mask; (child = trie->table[h]); h = (h + 1) & trie->mask)
+	{
+		node = &trie->nodes[child];
+		if (node->parent == parent && node->length == length && memcmp(node->component, component, length) == 0)
+			break;
+	}
+	*slot = h;
+	return child;
+}
+
+/** Add a base directory to a path trie.
+ * Directories which are already in the trie keep their first, highest
+ * priority base and index. Relative directories are left out.
+ * @param trie Path trie, with room for the components of path.
+ */
+static void xdgAddToPathTrie(xdgPathTrie *trie, const char *path, int base, unsigned int index)
+{
+	unsigned int node = 0, child, slot;
+	size_t length;
+
+	/* Relative and empty directories cannot contain an absolute path. */
+	if (*path != DIR_SEPARATOR_CHAR)
+		return;
+	for (path = xdgSkipSeparators(path); *path; path = xdgSkipSeparators(path + length))
+	{
+		length = xdgComponentLength(path);
+		if (!(child = xdgFindPathChild(trie, node, path, length, &slot)))
+		{
+			child = trie->size++;
+			xdgZeroMemory(&trie->nodes[child], sizeof(xdgPathNode));
+			trie->nodes[child].component = path;
+			trie->nodes[child].length = length;
+			trie->nodes[child].parent = node;
+			trie->table[slot] = child;
+		}
+		node = child;
+	}
+	if (trie->nodes[node].base == XDG_BASE_NONE)
+	{
+		trie->nodes[node].base = base;
+		trie->nodes[node].index = index;
+	}
+}
+
+/** Build the trie of all base directories of a cache.
+ * The trie holds the searchable data and config directories, the cache
+ * home and the runtime directory, in the order of their priority.
+ */
+static int xdgBuildPathTrie(xdgCachedData *cache)
+{
+	xdgPathTrie * trie;
+	char ** item;
+	unsigned int count = 1, slots;
+
+	for (item = cache->searchableDataDirectories; *item; ++item)
+		count += xdgCountComponents(*item);
+	for (item = cache->searchableConfigDirectories; *item; ++item)
+		count += xdgCountComponents(*item);
+	count += xdgCountComponents(cache->cacheHome);
+	if (cache->runtimeDirectory)
+		count += xdgCountComponents(cache->runtimeDirectory);
+	/* The table is at most half full. */
+	for (slots = 2; slots < count*2; slots *= 2) ;
+	if (!(trie = (xdgPathTrie*)malloc(sizeof(xdgPathTrie) + sizeof(xdgPathNode)*count + sizeof(unsigned int)*slots)))
+		return FALSE;
+	trie->nodes = (xdgPathNode*)(trie + 1);
+	trie->table = (unsigned int*)(trie->nodes + count);
+	trie->mask = slots - 1;
+	trie->size = 1;
+	xdgZeroMemory(trie->nodes, sizeof(xdgPathNode));
+	xdgZeroMemory(trie->table, sizeof(unsigned int)*slots);
+
+	for (item = cache->searchableDataDirectories; *item; ++item)
+		xdgAddToPathTrie(trie, *item, XDG_BASE_DATA, item - cache->searchableDataDirectories);
+	for (item = cache->searchableConfigDirectories; *item; ++item)
+		xdgAddToPathTrie(trie, *item, XDG_BASE_CONFIG, item - cache->searchableConfigDirectories);
+	xdgAddToPathTrie(trie, cache->cacheHome, XDG_BASE_CACHE, 0);
+	if (cache->runtimeDirectory)
+		xdgAddToPathTrie(trie, cache->runtimeDirectory, XDG_BASE_RUNTIME, 0);
+	cache->pathTrie = trie;
+	return TRUE;
+}
+
+/** Compute one of the fields of a cache.
+ * On failure the field is left unset.
+ * @param cache Data cache whose field is computed.
+ * @param field One of the @c XDG_FIELD_* values. The home directory of
+ * 	a directory list must have been computed before.
+ */
+static int xdgComputeField(xdgCachedData *cache, unsigned int field)
+{
+	const char * const * environment = xdgGetCacheEnvironment(cache);
+	switch (field)
 	{
+	case XDG_FIELD_DATA_HOME:
+		return (cache->dataHome = xdgGetRelativeHome(environment, "XDG_DATA_HOME",
+				DefaultRelativeDataHome, sizeof(DefaultRelativeDataHome)-1)) &&
+			xdgInternString(cache->pool, &cache->dataHome);
+	case XDG_FIELD_CONFIG_HOME:
+		return (cache->configHome = xdgGetRelativeHome(environment, "XDG_CONFIG_HOME",
+				DefaultRelativeConfigHome, sizeof(DefaultRelativeConfigHome)-1)) &&
+			xdgInternString(cache->pool, &cache->configHome);
+	case XDG_FIELD_CACHE_HOME:
+		return (cache->cacheHome = xdgGetRelativeHome(environment, "XDG_CACHE_HOME",
+				DefaultRelativeCacheHome, sizeof(DefaultRelativeCacheHome)-1)) &&
+			xdgInternString(cache->pool, &cache->cacheHome);
+	case XDG_FIELD_RUNTIME_DIRECTORY:
+		/* The runtime directory is optional. */
+		if (!(cache->runtimeDirectory = xdgEnvDup(environment, "XDG_RUNTIME_DIR")) && errno == ENOMEM)
+			return FALSE;
 		errno = 0;
-		const char *home;
-		unsigned int homelen;
-		if (!(home = xdgGetEnv("HOME")))
+		return xdgInternString(cache->pool, &cache->runtimeDirectory);
+	case XDG_FIELD_DATA_DIRECTORIES:
+		return xdgComputeDirectories(cache, "XDG_DATA_DIRS", cache->dataHome, DefaultDataDirectoriesList,
+			&cache->searchableDataDirectories, &cache->dataDirectories, &cache->dataFingerprint);
+	case XDG_FIELD_CONFIG_DIRECTORIES:
+		return xdgComputeDirectories(cache, "XDG_CONFIG_DIRS", cache->configHome, DefaultConfigDirectoriesList,
+			&cache->searchableConfigDirectories, &cache->configDirectories, &cache->configFingerprint);
+	case XDG_FIELD_PATH_TRIE:
+		return xdgBuildPathTrie(cache);
+	}
+	return FALSE;
+}
+
+/** Make sure that fields of a cache are computed.
+ * Fields of handles with @c XDG_HANDLE_LAZY are computed on first use, any
+ * number of threads may call this concurrently.
+ * @param cache Data cache whose fields are needed.
+ * @param fields Bitwise or of @c XDG_FIELD_* values.
+ * @return Non-zero if all fields are available.
+ */
+static int xdgEnsureFields(xdgCachedData *cache, unsigned int fields)
+{
+	unsigned int field;
+	int ok = TRUE;
+
+#if defined(__GNUC__)
+	if ((__atomic_load_n(&cache->ready, __ATOMIC_ACQUIRE) & fields) == fields)
+		return TRUE;
+#endif
+	/* Directory lists start with their home directory. */
+	if (fields & XDG_FIELD_DATA_DIRECTORIES) fields |= XDG_FIELD_DATA_HOME;
+	if (fields & XDG_FIELD_CONFIG_DIRECTORIES) fields |= XDG_FIELD_CONFIG_HOME;
+	if (fields & XDG_FIELD_PATH_TRIE) fields |= XDG_FIELD_ALL;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&cache->mutex);
+#endif
+	/* Home directories have lower bits, so they are computed first. */
+	for (field = 1; ok && field <= fields; field <<= 1)
+	{
+		if (!(fields & field) || (cache->ready & field))
+			continue;
+		if ((ok = xdgComputeField(cache, field)))
+		{
+#if defined(__GNUC__)
+			__atomic_store_n(&cache->ready, cache->ready | field, __ATOMIC_RELEASE);
+#else
+			cache->ready |= field;
+#endif
+		}
+	}
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&cache->mutex);
+#endif
+	return ok;
+}
+
+/** Check that the home directories of a cache can be computed, without
+ * computing them.
+ * Sets @c errno to @c EINVAL if @c \$HOME is needed but not set.
+ */
+static int xdgCheckHomeDirectories(xdgCachedData *cache)
+{
+	const char * const * environment = xdgGetCacheEnvironment(cache);
+	if ((!xdgGetEnv(environment, "XDG_DATA_HOME") || !xdgGetEnv(environment, "XDG_CONFIG_HOME") ||
+			!xdgGetEnv(environment, "XDG_CACHE_HOME")) &&
+		!xdgGetEnv(environment, "HOME"))
+		return FALSE;
+	errno = 0;
+	return TRUE;
+}
+
+/** Get the cache of a handle with some fields computed.
+ * @param handle Handle to data cache.
+ * @param fields Bitwise or of @c XDG_FIELD_* values.
+ * @return The cache, or @c NULL if computing a field failed (in which case
+ * 	errno will be set).
+ */
+static xdgCachedData* xdgGetCacheFields(xdgHandle *handle, unsigned int fields)
+{
+	xdgCachedData* cache = xdgGetCache(handle);
+	return xdgEnsureFields(cache, fields) ? cache : 0;
+}
+
+/** Free a cache and all data in it. */
+static void xdgDestroyCache(xdgCachedData *cache)
+{
+	xdgFreeData(cache);
+#ifdef HAVE_PTHREAD
+	pthread_mutex_destroy(&cache->mutex);
+#endif
+	free(cache);
+}
+
+/** Update the data cache of a handle.
+ * @param handle Handle whose cache should be replaced.
+ * @param flags Flags for the new cache.
+ * @param environment Variables to read, which the new cache takes over if
+ * 	the update succeeds, or @c NULL to read the environment of the process.
+ * @param pool Pool to intern the strings of the new cache in, or @c NULL.
+ */
+static int xdgUpdateDataFrom(xdgHandle *handle, unsigned int flags, char **environment, xdgStringPool *pool)
+{
+	xdgCachedData* cache = (xdgCachedData*)malloc(sizeof(xdgCachedData));
+	xdgCachedData* oldCache = xdgGetCache(handle);
+	if (!cache) return FALSE;
+	xdgZeroMemory(cache, sizeof(xdgCachedData));
+	cache->flags = flags;
+	if (oldCache)
+		cache->deadline = oldCache->deadline;
+	cache->environment = environment;
+	cache->pool = pool;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_init(&cache->mutex, 0);
+#endif
+	/* The environment of the process may change before the fields of a
+	 * lazy handle are computed, and reading it may race with setenv(). */
+	if ((flags & XDG_HANDLE_LAZY) && !environment && !(cache->variables = xdgSnapshotVariables()))
+	{
+		xdgDestroyCache(cache);
+		errno = ENOMEM;
+		return FALSE;
+	}
+
+	if ((flags & XDG_HANDLE_LAZY) ? xdgCheckHomeDirectories(cache) : xdgEnsureFields(cache, XDG_FIELD_ALL))
+	{
+		/* Update successful, replace pointer to old cache with pointer to new cache */
+		handle->reserved = cache;
+		if (oldCache)
+		{
+			cache->sharedCache = oldCache->sharedCache;
+			/* The directories may have changed, so the listings are taken again. */
+			cache->dataListings = oldCache->dataListings;
+			cache->configListings = oldCache->configListings;
+			oldCache->dataListings = oldCache->configListings = 0;
+			xdgResetListings(cache->dataListings);
+			xdgResetListings(cache->configListings);
+			if (oldCache->environment == environment)
+				oldCache->environment = 0;
+			xdgDestroyCache(oldCache);
+		}
+		return TRUE;
+	}
+	else
+	{
+		/* Update failed, discard new cache and leave old cache unmodified */
+		cache->environment = 0;
+		xdgDestroyCache(cache);
+		return FALSE;
+	}
+}
+
+int xdgUpdateData(xdgHandle *handle)
+{
+	xdgCachedData* cache = xdgGetCache(handle);
+	if (!cache)
+		return xdgUpdateDataFrom(handle, 0, 0, 0);
+	return xdgUpdateDataFrom(handle, cache->flags, cache->environment, cache->pool);
+}
+
+/** Copy the variables of an environment which are used by the library.
+ * @param environment List of @c NAME=value strings.
+ * @param pool Pool to intern the copies in, or @c NULL.
+ * @return The copied list, to be freed with xdgFreePooledStringList(), or
+ * 	@c NULL if an error occurs.
+ */
+static char** xdgCopyEnvironment(const char * const * environment, xdgStringPool *pool)
+{
+	unsigned int size = 0, i;
+	char ** copy;
+
+	for (i = 0; environment[i]; ++i)
+		if (strncmp(environment[i], "XDG_", 4) == 0 || strncmp(environment[i], "HOME=", 5) == 0)
+			++size;
+	if (!(copy = (char**)malloc(sizeof(char*)*(size+1))))
+		return NULL;
+	copy[0] = 0;
+	for (size = i = 0; environment[i]; ++i)
+	{
+		if (strncmp(environment[i], "XDG_", 4) != 0 && strncmp(environment[i], "HOME=", 5) != 0)
+			continue;
+		if (!(copy[size] = xdgDupString(pool, environment[i], strlen(environment[i]))))
+		{
+			xdgFreePooledStringList(pool, copy);
 			return NULL;
-		if (!(relhome = (char*)malloc((homelen = strlen(home))+fallbacklength+1))) return NULL;
-		memcpy(relhome, home, homelen);
-		memcpy(relhome+homelen, relativefallback, fallbacklength+1);
+		}
+		copy[++size] = 0;
 	}
-	return relhome;
+	return copy;
+}
+
+xdgHandle * xdgInitHandleFromEnv(xdgHandle *handle, const char * const *environment, unsigned int flags, xdgHandlePool *pool)
+{
+	xdgStringPool * strings = pool ? (xdgStringPool*)pool->reserved : 0;
+	char ** copy;
+	if (!handle || !environment) return 0;
+	if (!(copy = xdgCopyEnvironment(environment, strings))) return 0;
+	handle->reserved = 0; /* So xdgUpdateData() doesn't free it */
+	if (xdgUpdateDataFrom(handle, flags, copy, strings))
+	{
+		xdgProfileStart(handle);
+		return handle;
+	}
+	xdgFreePooledStringList(strings, copy);
+	return 0;
+}
+
+int xdgRevalidateHandle(xdgHandle *handle)
+{
+	xdgCachedData* cache = xdgGetCache(handle);
+	unsigned int i;
+	int changed = 0;
+	if (cache->dataDirectories.hasFds)
+		for (i = 0; i < cache->dataDirectories.count; ++i)
+			changed += xdgOpenDirectoryFd(&cache->dataDirectories.items[i]);
+	if (cache->configDirectories.hasFds)
+		for (i = 0; i < cache->configDirectories.count; ++i)
+			changed += xdgOpenDirectoryFd(&cache->configDirectories.items[i]);
+	return changed;
+}
+
+/** Magic number at the start of a handle snapshot. */
+#define XDG_SNAPSHOT_MAGIC 0x31534858u /* "XHS1" */
+
+/** Header of a handle snapshot made by xdgExportHandle().
+ * It is followed by the cache home, the runtime directory if there is one,
+ * and the searchable data and config directories, each null-terminated. */
+typedef struct _xdgSnapshotHeader
+{
+	unsigned int magic;
+	/** Size of the snapshot including the header. */
+	unsigned int size;
+	/** Hash of the variables the snapshot was computed from, see xdgHashEnvironment(). */
+	unsigned long long environmentHash;
+	unsigned int dataCount;
+	unsigned int configCount;
+	unsigned int hasRuntimeDirectory;
+	unsigned int deadline;
+	/** Whether a shared resolution cache was attached, and where it was mapped from. */
+	unsigned int hasSharedCache;
+	int sharedFd;
+	unsigned int sharedTtl;
+	unsigned int reserved;
+	unsigned long long sharedDevice;
+	unsigned long long sharedInode;
+} xdgSnapshotHeader;
+
+/** Hash the variables which determine the directories of a handle.
+ * @param environment Environment to read, or @c NULL for the environment of the process.
+ */
+static unsigned long long xdgHashEnvironment(const char * const * environment)
+{
+	unsigned long long hash = XDG_HASH_INIT;
+	const char ** name;
+	const char * value;
+	for (name = SnapshotVariables; *name; ++name)
+	{
+		/* Unset and empty variables hash differently. */
+		value = xdgLookupEnv(environment, *name);
+		hash = xdgHashBytes(hash, value ? "=" : "!", 1);
+		if (value)
+			hash = xdgHashBytes(hash, value, strlen(value)+1);
+	}
+	return hash;
+}
+
+void * xdgExportHandle(xdgHandle *handle, size_t *size)
+{
+	xdgCachedData* cache = xdgGetCacheFields(handle, XDG_FIELD_ALL & ~XDG_FIELD_PATH_TRIE);
+	xdgSnapshotHeader * header;
+	xdgSharedCacheOrigin origin;
+	size_t total = sizeof(xdgSnapshotHeader);
+	char ** item;
+	char * strings;
+
+	if (!cache) return 0;
+	total += strlen(cache->cacheHome) + 1;
+	if (cache->runtimeDirectory)
+		total += strlen(cache->runtimeDirectory) + 1;
+	for (item = cache->searchableDataDirectories; *item; ++item)
+		total += strlen(*item) + 1;
+	for (item = cache->searchableConfigDirectories; *item; ++item)
+		total += strlen(*item) + 1;
+	if (total > 0xffffffffu)
+	{
+		errno = EOVERFLOW;
+		return 0;
+	}
+	if (!(header = (xdgSnapshotHeader*)malloc(total)))
+	{
+		errno = ENOMEM;
+		return 0;
+	}
+
+	xdgZeroMemory(header, sizeof(xdgSnapshotHeader));
+	header->magic = XDG_SNAPSHOT_MAGIC;
+	header->size = total;
+	header->environmentHash = xdgHashEnvironment(xdgGetCacheEnvironment(cache));
+	header->hasRuntimeDirectory = !!cache->runtimeDirectory;
+	header->deadline = cache->deadline;
+	header->sharedFd = -1;
+	if (cache->sharedCache)
+	{
+		xdgSharedCacheGetOrigin(cache->sharedCache, &origin);
+		header->hasSharedCache = TRUE;
+		header->sharedFd = origin.fd;
+		header->sharedTtl = origin.ttl;
+		header->sharedDevice = origin.device;
+		header->sharedInode = origin.inode;
+	}
+	strings = (char*)(header + 1);
+	strcpy(strings, cache->cacheHome);
+	strings += strlen(strings) + 1;
+	if (cache->runtimeDirectory)
+	{
+		strcpy(strings, cache->runtimeDirectory);
+		strings += strlen(strings) + 1;
+	}
+	for (item = cache->searchableDataDirectories; *item; ++item, ++header->dataCount)
+	{
+		strcpy(strings, *item);
+		strings += strlen(strings) + 1;
+	}
+	for (item = cache->searchableConfigDirectories; *item; ++item, ++header->configCount)
+	{
+		strcpy(strings, *item);
+		strings += strlen(strings) + 1;
+	}
+	*size = total;
+	return header;
+}
+
+int xdgExportHandleFd(xdgHandle *handle)
+{
+#ifdef HAVE_MEMFD_CREATE
+	void * snapshot;
+	size_t size, done;
+	ssize_t written;
+	int fd, err;
+
+	if (!(snapshot = xdgExportHandle(handle, &size)))
+		return -1;
+	/* Not close-on-exec, so that child processes inherit it. */
+#  ifdef MFD_ALLOW_SEALING
+	fd = memfd_create("libxdg-basedir-handle", MFD_ALLOW_SEALING);
+#  else
+	fd = memfd_create("libxdg-basedir-handle", 0);
+#  endif
+	for (done = 0; fd != -1 && done < size; done += written)
+	{
+		if ((written = write(fd, (char*)snapshot + done, size - done)) == -1)
+		{
+			if (errno == EINTR)
+				written = 0;
+			else
+			{
+				err = errno;
+				close(fd);
+				errno = err;
+				fd = -1;
+			}
+		}
+	}
+	free(snapshot);
+#  if defined(F_ADD_SEALS) && defined(F_SEAL_WRITE)
+	/* Children cannot change what their siblings import. */
+	if (fd != -1)
+		fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#  endif
+	return fd;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/** Take a copy of the next string of a snapshot.
+ * @param cursor Start of the string, moved past it.
+ * @param end End of the snapshot.
+ * @return The copy, or @c NULL if the snapshot is truncated (errno is
+ * 	set to @c EINVAL) or memory runs out.
+ */
+static char * xdgNextSnapshotString(const char ** cursor, const char * end)
+{
+	const char * string = *cursor;
+	const char * terminator = (const char*)memchr(string, 0, end - string);
+	if (!terminator)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+	*cursor = terminator + 1;
+	return xdgDupString(NULL, string, terminator - string);
+}
+
+/** Take a copy of the next directory list of a snapshot.
+ * @param cursor Start of the list, moved past it.
+ * @param end End of the snapshot.
+ * @param count Number of directories, at least 1.
+ * @return The null-terminated list, or @c NULL if an error occurs.
+ */
+static char ** xdgNextSnapshotList(const char ** cursor, const char * end, unsigned int count)
+{
+	char ** list;
+	unsigned int i;
+	/* Every directory takes at least its null byte. */
+	if (count == 0 || count > (size_t)(end - *cursor))
+	{
+		errno = EINVAL;
+		return 0;
+	}
+	if (!(list = (char**)malloc(sizeof(char*)*(count+1))))
+	{
+		errno = ENOMEM;
+		return 0;
+	}
+	for (i = 0; i < count; ++i)
+	{
+		list[i+1] = 0;
+		if (!(list[i] = xdgNextSnapshotString(cursor, end)))
+		{
+			xdgFreeStringList(list);
+			return 0;
+		}
+	}
+	list[count] = 0;
+	return list;
+}
+
+/** Fill a new cache from a snapshot.
+ * @param cache Empty cache with its flags set.
+ * @param header Snapshot, which must be at least @c header->size bytes.
+ */
+static int xdgImportSnapshot(xdgCachedData *cache, const xdgSnapshotHeader *header)
+{
+	const char * cursor = (const char*)(header + 1);
+	const char * end = (const char*)header + header->size;
+
+	cache->deadline = header->deadline;
+	if (!(cache->cacheHome = xdgNextSnapshotString(&cursor, end)))
+		return FALSE;
+	if (header->hasRuntimeDirectory && !(cache->runtimeDirectory = xdgNextSnapshotString(&cursor, end)))
+		return FALSE;
+	if (!(cache->searchableDataDirectories = xdgNextSnapshotList(&cursor, end, header->dataCount)))
+		return FALSE;
+	cache->dataHome = cache->searchableDataDirectories[0];
+	if (!(cache->searchableConfigDirectories = xdgNextSnapshotList(&cursor, end, header->configCount)))
+		return FALSE;
+	cache->configHome = cache->searchableConfigDirectories[0];
+	if (!xdgPrepareDirectories(cache, &cache->searchableDataDirectories, &cache->dataDirectories, &cache->dataFingerprint) ||
+		!xdgPrepareDirectories(cache, &cache->searchableConfigDirectories, &cache->configDirectories, &cache->configFingerprint))
+		return FALSE;
+	cache->ready = XDG_FIELD_ALL & ~XDG_FIELD_PATH_TRIE;
+	if (!(cache->flags & XDG_HANDLE_LAZY) && !xdgEnsureFields(cache, XDG_FIELD_ALL))
+		return FALSE;
+
+	/* Map the shared resolution cache again, unless its descriptor was
+	 * not inherited or now refers to another file. */
+	if (header->hasSharedCache)
+	{
+		struct stat st;
+		if (header->sharedFd == -1 ||
+			(fstat(header->sharedFd, &st) == 0 && (unsigned long long)st.st_dev == header->sharedDevice &&
+				(unsigned long long)st.st_ino == header->sharedInode))
+			cache->sharedCache = xdgSharedCacheMap(header->sharedFd, cache->runtimeDirectory, header->sharedTtl);
+	}
+	errno = 0;
+	return TRUE;
+}
+
+xdgHandle * xdgImportHandle(xdgHandle *handle, const void *snapshot, size_t size, unsigned int flags)
+{
+	const xdgSnapshotHeader * header = (const xdgSnapshotHeader*)snapshot;
+	xdgCachedData* cache;
+
+	if (!handle) return 0;
+	if (size < sizeof(xdgSnapshotHeader) || header->magic != XDG_SNAPSHOT_MAGIC || header->size != size)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+	if (!(cache = (xdgCachedData*)malloc(sizeof(xdgCachedData))))
+	{
+		errno = ENOMEM;
+		return 0;
+	}
+	xdgZeroMemory(cache, sizeof(xdgCachedData));
+	cache->flags = flags;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_init(&cache->mutex, 0);
+#endif
+	if (!xdgImportSnapshot(cache, header))
+	{
+		xdgDestroyCache(cache);
+		return 0;
+	}
+	handle->reserved = cache;
+	return handle;
+}
+
+/** Map a snapshot from a file descriptor and import it.
+ * @param handle Handle to initialize.
+ * @param fd Descriptor of the snapshot.
+ * @param flags Bitwise or of @c XDG_HANDLE_* flags.
+ * @param environmentHash Hash the snapshot must have been computed from,
+ * 	or 0 to accept any snapshot.
+ */
+static xdgHandle * xdgImportHandleFdChecked(xdgHandle *handle, int fd, unsigned int flags,
+	unsigned long long environmentHash)
+{
+	struct stat st;
+	void * snapshot;
+	xdgHandle * result;
+	int err;
+
+	if (fstat(fd, &st) == -1)
+		return 0;
+	if (st.st_size < (off_t)sizeof(xdgSnapshotHeader) || st.st_size > 0xffffffffL)
+	{
+		errno = EINVAL;
+		return 0;
+	}
+	if ((snapshot = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		return 0;
+	if (environmentHash && ((xdgSnapshotHeader*)snapshot)->environmentHash != environmentHash)
+	{
+		errno = ESTALE;
+		result = 0;
+	}
+	else
+		result = xdgImportHandle(handle, snapshot, st.st_size, flags);
+	err = errno;
+	munmap(snapshot, st.st_size);
+	errno = err;
+	return result;
+}
+
+xdgHandle * xdgImportHandleFd(xdgHandle *handle, int fd, unsigned int flags)
+{
+	if (!handle) return 0;
+	return xdgImportHandleFdChecked(handle, fd, flags, 0);
+}
+
+/** Import the snapshot named by @c XDG_BASEDIR_HANDLE_FD if there is one
+ * and it was computed from the same variables as the environment of the process.
+ * @return Non-zero if the handle was initialized from the snapshot.
+ */
+static int xdgImportInheritedHandle(xdgHandle *handle, unsigned int flags)
+{
+	const char * value = getenv(XDG_HANDLE_FD_VARIABLE);
+	char * end;
+	long fd;
+	if (!value || !*value)
+		return FALSE;
+	fd = strtol(value, &end, 10);
+	if (*end || fd < 0 || fd > 0x7fffffffL)
+		return FALSE;
+	if (!xdgImportHandleFdChecked(handle, (int)fd, flags, xdgHashEnvironment(NULL)))
+	{
+		/* Fall back to computing the handle from the environment. */
+		handle->reserved = 0;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/** Maximum number of directories in a list whose lookups can be shared. */
+#define XDG_SHARED_MAX_DIRECTORIES 64
+/** Default number of seconds for which shared lookup results are trusted. */
+#define XDG_SHARED_DEFAULT_TTL 5
+
+/** Get the bitmap of all directories of a list for the shared resolution cache.
+  * @param dirs Prepared directory list.
+  * @return The bitmap, or 0 if the list is too long to be shared.
+  */
+static unsigned long long xdgGetSharedMask(const xdgDirectoryList * dirs)
+{
+	if (dirs->count > XDG_SHARED_MAX_DIRECTORIES) return 0;
+	return dirs->count == XDG_SHARED_MAX_DIRECTORIES ? ~0ull : (1ull << dirs->count) - 1;
+}
+
+/** Size of the buffer on the stack used for composing paths. */
+#define XDG_PATH_BUFFER_SIZE 512
+
+/** Buffer for composing the paths of a relative path in each directory of a list.
+  * The relative path is copied once, right after room for the longest
+  * prefix, so that each candidate is composed by copying only its prefix
+  * in front of it. */
+typedef struct _xdgPathBuffer
+{
+	char * buffer;
+	char * relative;
+	size_t relativeLength;
+	/** Relative path without leading separators, for use with directory descriptors. */
+	const char * relativeAt;
+	char stack[XDG_PATH_BUFFER_SIZE];
+} xdgPathBuffer;
+
+/** Initialize a path buffer for a directory list and relative path.
+  * The relative path need not be null-terminated, the copy in the buffer is.
+  * Sets @c errno to @c ENOMEM if the paths do not fit on the stack and
+  * allocating a buffer fails. */
+static int xdgInitPathBuffer(xdgPathBuffer *path, const xdgDirectoryList * dirs, const char * relativePath, size_t length)
+{
+	path->relativeLength = length;
+	if (dirs->maxLength + path->relativeLength < XDG_PATH_BUFFER_SIZE)
+		path->buffer = path->stack;
+	else if (!(path->buffer = (char*)malloc(dirs->maxLength + path->relativeLength + 1)))
+	{
+		errno = ENOMEM;
+		return FALSE;
+	}
+	path->relative = path->buffer + dirs->maxLength;
+	memcpy(path->relative, relativePath, length);
+	path->relative[length] = 0;
+	for (path->relativeAt = path->relative; *path->relativeAt == DIR_SEPARATOR_CHAR; ++path->relativeAt) ;
+	return TRUE;
+}
+
+/** Compose the path of the relative path in a directory.
+  * @return The full path, valid until the next call. */
+static char * xdgComposePath(xdgPathBuffer *path, const xdgDirectory *dir)
+{
+	char * fullPath = path->relative - dir->length;
+	memcpy(fullPath, dir->prefix, dir->length);
+	return fullPath;
+}
+
+static void xdgFreePathBuffer(xdgPathBuffer *path)
+{
+	if (path->buffer != path->stack)
+		free(path->buffer);
+}
+
+/** Deadline of a single lookup in a directory list. */
+typedef struct _xdgDeadline
+{
+	/** Whether the list has slow directories with a deadline. */
+	int active;
+	/** CLOCK_MONOTONIC time at which the lookup gives up on slow directories. */
+	struct timespec end;
+	/** Bits of the directories which were skipped because they did not answer in time. */
+	unsigned long long skipped;
+} xdgDeadline;
+
+/** Start the deadline of a lookup in a directory list. */
+static void xdgStartDeadline(xdgDeadline *deadline, const xdgDirectoryList * dirs)
+{
+	deadline->active = FALSE;
+	deadline->skipped = 0;
+#if defined(HAVE_PTHREAD) && defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	if (!dirs->deadline || clock_gettime(CLOCK_MONOTONIC, &deadline->end) == -1)
+		return;
+	deadline->end.tv_sec += dirs->deadline / 1000;
+	deadline->end.tv_nsec += (long)(dirs->deadline % 1000) * 1000000L;
+	if (deadline->end.tv_nsec >= 1000000000L)
+	{
+		deadline->end.tv_sec++;
+		deadline->end.tv_nsec -= 1000000000L;
+	}
+	deadline->active = TRUE;
+#endif
+}
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+
+/** Check whether a slow directory was recently demoted. */
+static int xdgIsDemoted(const xdgDirectory *dir)
+{
+#if defined(__GNUC__)
+	return __atomic_load_n(&dir->demotedUntil, __ATOMIC_RELAXED) > (long long)time(NULL);
+#else
+	return dir->demotedUntil > (long long)time(NULL);
+#endif
+}
+
+/** Skip a slow directory in lookups for @c XDG_DEMOTE_SECONDS. */
+static void xdgDemote(xdgDirectory *dir)
+{
+#if defined(__GNUC__)
+	__atomic_store_n(&dir->demotedUntil, (long long)time(NULL) + XDG_DEMOTE_SECONDS, __ATOMIC_RELAXED);
+#else
+	dir->demotedUntil = (long long)time(NULL) + XDG_DEMOTE_SECONDS;
+#endif
+}
+
+/** Probe of a slow directory running on its own thread.
+ * Whichever of the prober and the waiting lookup finishes last frees it. */
+typedef struct _xdgSlowProbe
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t finished;
+	/** Flags for open(), or -1 to only check whether the file is readable. */
+	int flags;
+	/** Descriptor, or 0 if the file is readable, -1 on error. */
+	int result;
+	int error;
+	int done;
+	/** Set by the lookup when it stops waiting. */
+	int abandoned;
+	char path[1];
+} xdgSlowProbe;
+
+/** Open a path, or check whether it is readable if flags is -1. */
+static int xdgRunProbe(const char *path, int flags)
+{
+	if (flags != -1)
+		return open(path, flags, 0666);
+#ifdef HAVE_FACCESSAT
+	return faccessat(AT_FDCWD, path, R_OK, AT_EACCESS);
+#else
+	return access(path, R_OK);
+#endif
+}
+
+static void * xdgSlowProbeThread(void *arg)
+{
+	xdgSlowProbe * probe = (xdgSlowProbe*)arg;
+	int result = xdgRunProbe(probe->path, probe->flags), abandoned;
+
+	pthread_mutex_lock(&probe->mutex);
+	probe->result = result;
+	probe->error = errno;
+	probe->done = TRUE;
+	abandoned = probe->abandoned;
+	pthread_cond_signal(&probe->finished);
+	pthread_mutex_unlock(&probe->mutex);
+	if (abandoned)
+	{
+		if (probe->flags != -1 && result != -1)
+			close(result);
+		pthread_mutex_destroy(&probe->mutex);
+		pthread_cond_destroy(&probe->finished);
+		free(probe);
+	}
+	return 0;
+}
+
+/** Probe a path in a slow directory on a separate thread, waiting no
+ * longer than the deadline of the lookup. A directory which does not
+ * answer in time is skipped by lookups for @c XDG_DEMOTE_SECONDS.
+ * Opens which may create or truncate the file are never left running once
+ * the lookup returns, so they block instead, unless the directory is demoted.
+ * @param dir Directory of the path.
+ * @param fullPath Path to probe.
+ * @param flags Flags for open(), or -1 to check whether the path is readable.
+ * @param deadline Deadline of the lookup.
+ * @return As open() or access(). Sets @c errno to @c ETIMEDOUT if the
+ * 	directory did not answer in time.
+ */
+static int xdgProbeSlowDirectory(xdgDirectory *dir, const char *fullPath, int flags, const xdgDeadline *deadline)
+{
+	xdgSlowProbe * probe;
+	pthread_condattr_t condattr;
+	pthread_attr_t attr;
+	pthread_t thread;
+	size_t length = strlen(fullPath);
+	int result, err = 0, done;
+
+	if (xdgIsDemoted(dir))
+	{
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	if (flags != -1 && (flags & (O_CREAT | O_TRUNC)))
+		return xdgRunProbe(fullPath, flags);
+	if (!(probe = (xdgSlowProbe*)malloc(sizeof(xdgSlowProbe) + length)))
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	xdgZeroMemory(probe, sizeof(xdgSlowProbe));
+	probe->flags = flags;
+	memcpy(probe->path, fullPath, length + 1);
+	pthread_mutex_init(&probe->mutex, 0);
+	pthread_condattr_init(&condattr);
+	pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&probe->finished, &condattr);
+	pthread_condattr_destroy(&condattr);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	err = pthread_create(&thread, &attr, xdgSlowProbeThread, probe);
+	pthread_attr_destroy(&attr);
+	if (err)
+	{
+		/* Better to block than to miss the file. */
+		pthread_mutex_destroy(&probe->mutex);
+		pthread_cond_destroy(&probe->finished);
+		free(probe);
+		return xdgRunProbe(fullPath, flags);
+	}
+
+	pthread_mutex_lock(&probe->mutex);
+	while (!probe->done && err != ETIMEDOUT)
+		err = pthread_cond_timedwait(&probe->finished, &probe->mutex, &deadline->end);
+	done = probe->done;
+	probe->abandoned = !done;
+	result = probe->result;
+	err = probe->error;
+	pthread_mutex_unlock(&probe->mutex);
+
+	if (!done)
+	{
+		xdgDemote(dir);
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	pthread_mutex_destroy(&probe->mutex);
+	pthread_cond_destroy(&probe->finished);
+	free(probe);
+	errno = err;
+	return result;
+}
+
+/** Number of threads opening candidates for handles with @c XDG_HANDLE_PARALLEL_OPEN. */
+#define XDG_OPEN_POOL_SIZE 4
+
+struct _xdgOpenBatch;
+
+/** States of the candidates of a parallel open. */
+enum
+{
+	/** Opened by the lookup itself when it gets to the candidate. */
+	XDG_CANDIDATE_LOCAL,
+	/** Waiting for a thread of the pool, or for the lookup to take it back. */
+	XDG_CANDIDATE_QUEUED,
+	/** Being opened by a thread of the pool or by the lookup. */
+	XDG_CANDIDATE_RUNNING,
+	XDG_CANDIDATE_DONE
+};
+
+/** Candidate of a parallel open. */
+typedef struct _xdgOpenCandidate
+{
+	struct _xdgOpenBatch * batch;
+	/** Next candidate in the queue of the pool. */
+	struct _xdgOpenCandidate * next;
+	/** Full path, stored after the candidates of the batch. */
+	const char * path;
+	/** One of the @c XDG_CANDIDATE_* states. */
+	int state;
+	/** Descriptor, or -1 on error. */
+	int fd;
+	int error;
+} xdgOpenCandidate;
+
+/** Candidates of a parallel open, one per directory of the list.
+ * Whichever of the lookup and the pool threads drops the last reference frees it. */
+typedef struct _xdgOpenBatch
+{
+	pthread_cond_t finished;
+	/** Flags for open(). */
+	int flags;
+	/** The lookup and every queued candidate hold a reference. */
+	unsigned int references;
+	/** Set by the lookup when it has its result. Candidates which did not
+	 * start yet are then dropped, and files opened later are closed. */
+	int abandoned;
+	xdgOpenCandidate candidates[1];
+} xdgOpenBatch;
+
+/** Threads opening candidates, shared by all handles.
+ * The mutex also protects the batches of the queued candidates. */
+static struct
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t queued;
+	xdgOpenCandidate * head;
+	xdgOpenCandidate ** tail;
+	unsigned int threads;
+	/** Threads which are neither opening nor promised a queued candidate.
+	 * Threads stuck on an unresponsive filesystem are not idle, so that
+	 * lookups do not queue candidates behind them. */
+	unsigned int idle;
+	int forkHandlers;
+} xdgOpenPool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, &xdgOpenPool.head, 0, 0, FALSE };
+
+/** Drop a reference to a batch, with the mutex of the pool held. */
+static void xdgReleaseOpenBatch(xdgOpenBatch *batch)
+{
+	if (--batch->references)
+		return;
+	pthread_cond_destroy(&batch->finished);
+	free(batch);
+}
+
+static void * xdgOpenPoolThread(void *arg)
+{
+	xdgOpenCandidate * candidate;
+	int fd, error;
+
+	(void)arg;
+	pthread_mutex_lock(&xdgOpenPool.mutex);
+	for (;;)
+	{
+		while (!(candidate = xdgOpenPool.head))
+			pthread_cond_wait(&xdgOpenPool.queued, &xdgOpenPool.mutex);
+		if (!(xdgOpenPool.head = candidate->next))
+			xdgOpenPool.tail = &xdgOpenPool.head;
+		/* The lookup may have taken the candidate back to open it itself. */
+		if (!candidate->batch->abandoned && candidate->state == XDG_CANDIDATE_QUEUED)
+		{
+			candidate->state = XDG_CANDIDATE_RUNNING;
+			pthread_mutex_unlock(&xdgOpenPool.mutex);
+			fd = open(candidate->path, candidate->batch->flags, 0666);
+			error = errno;
+			pthread_mutex_lock(&xdgOpenPool.mutex);
+			if (fd != -1 && candidate->batch->abandoned)
+			{
+				close(fd);
+				fd = -1;
+			}
+			candidate->fd = fd;
+			candidate->error = error;
+			candidate->state = XDG_CANDIDATE_DONE;
+			pthread_cond_signal(&candidate->batch->finished);
+		}
+		xdgReleaseOpenBatch(candidate->batch);
+		++xdgOpenPool.idle;
+	}
+	return 0;
+}
+
+static void xdgLockOpenPool(void) { pthread_mutex_lock(&xdgOpenPool.mutex); }
+static void xdgUnlockOpenPool(void) { pthread_mutex_unlock(&xdgOpenPool.mutex); }
+
+/** Forget the threads of the pool in a forked child, which has none of them. */
+static void xdgResetOpenPool(void)
+{
+	pthread_mutex_init(&xdgOpenPool.mutex, 0);
+	pthread_cond_init(&xdgOpenPool.queued, 0);
+	xdgOpenPool.head = 0;
+	xdgOpenPool.tail = &xdgOpenPool.head;
+	xdgOpenPool.threads = 0;
+	xdgOpenPool.idle = 0;
+}
+
+/** Start the threads of the pool which are not running yet, with the
+ * mutex of the pool held. The threads block all signals, so that they
+ * are still delivered to the threads of the application.
+ * @return The number of threads running. */
+static unsigned int xdgStartOpenPool(void)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	sigset_t all, old;
+
+	if (xdgOpenPool.threads == XDG_OPEN_POOL_SIZE)
+		return XDG_OPEN_POOL_SIZE;
+	if (!xdgOpenPool.forkHandlers)
+		xdgOpenPool.forkHandlers = pthread_atfork(xdgLockOpenPool, xdgUnlockOpenPool, xdgResetOpenPool) == 0;
+	if (!xdgOpenPool.forkHandlers)
+		return 0;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while (xdgOpenPool.threads < XDG_OPEN_POOL_SIZE && pthread_create(&thread, &attr, xdgOpenPoolThread, 0) == 0)
+	{
+		++xdgOpenPool.threads;
+		++xdgOpenPool.idle;
+	}
+	pthread_attr_destroy(&attr);
+	pthread_sigmask(SIG_SETMASK, &old, 0);
+	return xdgOpenPool.threads;
+}
+
+#endif
+
+/** Check whether a directory of a list is probed in bounded time by a lookup. */
+static int xdgIsBounded(const xdgDirectoryList * dirs, unsigned int i, const xdgDeadline *deadline)
+{
+	return deadline && deadline->active && dirs->items[i].slow;
+}
+
+/** Probe a path in a slow directory of a list within the deadline of a lookup.
+ * Directories which do not answer in time are recorded in the deadline.
+ * @see xdgProbeSlowDirectory() */
+static int xdgProbeBounded(xdgDirectoryList * dirs, unsigned int i, xdgPathBuffer *path, int flags, xdgDeadline *deadline)
+{
+#if defined(HAVE_PTHREAD) && defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	int result = xdgProbeSlowDirectory(&dirs->items[i], xdgComposePath(path, &dirs->items[i]), flags, deadline);
+	if (result == -1 && errno == ETIMEDOUT && i < 64)
+		deadline->skipped |= 1ull << i;
+	return result;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/** Open the relative path of a path buffer in a directory of a list.
+  * Lists with descriptors open relative to the directory descriptor, so
+  * that the kernel does not have to walk the directory path again.
+  * @param dirs Prepared directory list.
+  * @param i Index of the directory in dirs.
+  * @param path Path buffer for dirs.
+  * @param flags Flags for open().
+  * @param deadline Deadline of the lookup, or @c NULL to wait for slow directories.
+  * @return A file descriptor, or -1 if an error occurs.
+  */
+static int xdgOpenInDirectory(xdgDirectoryList * dirs, unsigned int i, xdgPathBuffer *path, int flags, xdgDeadline *deadline)
+{
+#if defined(HAVE_OPENAT) && defined(HAVE_FACCESSAT)
+	xdgDirectory * dir = &dirs->items[i];
+	int fd;
+#endif
+	if (xdgIsBounded(dirs, i, deadline))
+		return xdgProbeBounded(dirs, i, path, flags, deadline);
+#if defined(HAVE_OPENAT) && defined(HAVE_FACCESSAT)
+	if (dirs->hasFds)
+	{
+		/* Files are only read from directories which existed when the
+		 * handle was updated, but may be created in new ones. */
+		if (dir->fd == -1)
+		{
+			if (flags & O_CREAT)
+				return open(xdgComposePath(path, dir), flags, 0666);
+			errno = ENOENT;
+			return -1;
+		}
+		fd = openat(dir->fd, path->relativeAt, flags, 0666);
+#  ifdef ESTALE
+		/* The directory was replaced behind a network filesystem's back. */
+		if (fd == -1 && errno == ESTALE && xdgRefreshDirectoryFd(dir))
+			fd = openat(dir->fd, path->relativeAt, flags, 0666);
+#  endif
+		return fd;
+	}
+#endif
+	return open(xdgComposePath(path, &dirs->items[i]), flags, 0666);
+}
+
+/** Check whether the relative path of a path buffer is readable in a directory of a list.
+  * Consider as performing @code fopen(filename, "r") @endcode.
+  * @see xdgOpenInDirectory() */
+static int xdgIsReadableInDirectory(xdgDirectoryList * dirs, unsigned int i, xdgPathBuffer *path, xdgDeadline *deadline)
+{
+	FILE * testFile;
+	if (xdgIsBounded(dirs, i, deadline))
+		return xdgProbeBounded(dirs, i, path, -1, deadline) == 0;
+#if defined(HAVE_OPENAT) && defined(HAVE_FACCESSAT)
+	xdgDirectory * dir = &dirs->items[i];
+	if (dirs->hasFds)
+	{
+		if (dir->fd == -1)
+			return FALSE;
+		if (faccessat(dir->fd, path->relativeAt, R_OK, AT_EACCESS) == 0)
+			return TRUE;
+#  ifdef ESTALE
+		if (errno == ESTALE && xdgRefreshDirectoryFd(dir))
+			return faccessat(dir->fd, path->relativeAt, R_OK, AT_EACCESS) == 0;
+#  endif
+		return FALSE;
+	}
+#endif
+	if (!(testFile = fopen(xdgComposePath(path, &dirs->items[i]), "r")))
+		return FALSE;
+	fclose(testFile);
+	return TRUE;
+}
+
+/** Convert an fopen() mode to open() flags.
+  * @return The flags, or -1 if the mode contains unknown characters. */
+static int xdgGetModeFlags(const char * mode)
+{
+	int flags, access;
+	switch (*mode++)
+	{
+	case 'r': flags = 0; access = O_RDONLY; break;
+	case 'w': flags = O_CREAT | O_TRUNC; access = O_WRONLY; break;
+	case 'a': flags = O_CREAT | O_APPEND; access = O_WRONLY; break;
+	default: return -1;
+	}
+	for (; *mode; ++mode)
+	{
+		switch (*mode)
+		{
+		case '+': access = O_RDWR; break;
+		case 'b': case 't': break;
+		case 'x': flags |= O_EXCL; break;
+		case 'e': flags |= XDG_O_CLOEXEC; break;
+		default: return -1;
+		}
+	}
+	return flags | access;
+}
+
+/** Open the relative path of a path buffer in a directory of a list as a stream.
+  * @see xdgOpenInDirectory() */
+static FILE * xdgFopenInDirectory(xdgDirectoryList * dirs, unsigned int i, xdgPathBuffer *path, const char * mode,
+	xdgDeadline *deadline)
+{
+	FILE * file;
+	int fd, flags;
+	if ((!dirs->hasFds && !xdgIsBounded(dirs, i, deadline)) || (flags = xdgGetModeFlags(mode)) == -1)
+		return fopen(xdgComposePath(path, &dirs->items[i]), mode);
+	if ((fd = xdgOpenInDirectory(dirs, i, path, flags, deadline)) == -1)
+		return 0;
+	if (!(file = fdopen(fd, mode)))
+		close(fd);
+	return file;
+}
+
+/** Get the modification time of a file in nanoseconds. */
+static long long xdgGetModificationTime(const struct stat *st)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+	return (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+#else
+	return (long long)st->st_mtime * 1000000000LL;
+#endif
+}
+
+/** Nanoseconds within which a change may leave a fine-grained modification
+ * time unchanged, as file timestamps follow a coarse clock. */
+#define XDG_RACY_NANOSECONDS 50000000LL
+
+/** Get the current time of the clock of file timestamps in nanoseconds. */
+static long long xdgGetFileClock(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec now;
+	if (clock_gettime(CLOCK_REALTIME, &now) == 0)
+		return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+#endif
+	return (long long)time(NULL) * 1000000000LL;
+}
+
+/** Check whether a modification time is too recent to show later changes.
+ * A change made after the time a directory was examined may leave its
+ * modification time unchanged if that falls into the same timestamp tick.
+ * Times without nanoseconds are taken to have a granularity of a second.
+ * @param mtime Modification time from xdgGetModificationTime().
+ * @param examined Time from xdgGetFileClock() taken before the directory
+ * 	was examined.
+ */
+static int xdgIsRacy(long long mtime, long long examined)
+{
+	if (mtime % 1000000000LL == 0)
+		return mtime / 1000000000LL >= examined / 1000000000LL;
+	return mtime >= examined - XDG_RACY_NANOSECONDS;
+}
+
+/** Watch the parent of the relative path of a path buffer in every
+ * directory of a list, so that creating, removing or renaming a file next
+ * to it changes the generation of a shared resolution cache. Directories
+ * probed within the deadline of a lookup are left out, so that their
+ * results only expire with the cache.
+ * @param shared Shared resolution cache.
+ * @param dirs Prepared directory list.
+ * @param path Path buffer for dirs.
+ * @param deadline Deadline of the lookup, or @c NULL.
+ * @return 1 if every parent was already watched, 0 if results published
+ * 	before may predate a watch, or -1 if a parent cannot be watched.
+ */
+static int xdgWatchSharedParents(xdgSharedCache * shared, xdgDirectoryList * dirs, xdgPathBuffer *path, const xdgDeadline *deadline)
+{
+	char * fullPath, * sep;
+	unsigned int i;
+	int result = 1, watched;
+
+	for (i = 0; i < dirs->count; ++i)
+	{
+		if (xdgIsBounded(dirs, i, deadline))
+			continue;
+		fullPath = xdgComposePath(path, &dirs->items[i]);
+		if (!(sep = strrchr(fullPath, DIR_SEPARATOR_CHAR)))
+			continue;
+		/* Keep the root separator of a path directly below it. */
+		if ((watched = xdgSharedCacheWatch(shared, fullPath, dirs->items[i].length,
+				(size_t)(sep - fullPath) + (sep == fullPath))) == -1)
+			return -1;
+		result &= watched;
+	}
+	return result;
+}
+
+/** Hash a name in a listing, never 0. */
+static unsigned long long xdgHashName(const char *name, size_t length)
+{
+	unsigned long long hash = xdgHashBytes(XDG_HASH_INIT, name, length);
+	return hash ? hash : 1;
+}
+
+/** Take a snapshot of the names in a subdirectory of every directory of a list.
+ * @param dirs Prepared directory list.
+ * @param relative Relative path of the subdirectory.
+ * @return The snapshot with one reference, or @c NULL if memory runs out.
+ */
+static xdgListingSnapshot * xdgTakeListing(xdgDirectoryList * dirs, const char * relative)
+{
+	xdgListingSnapshot * snapshot = 0;
+	struct _xdgListedDirectory * listed;
+	xdgPathBuffer path;
+	struct stat st;
+	struct dirent * entry;
+	DIR * dir;
+	unsigned long long * hashes = 0, * tmp, * table, hash;
+	unsigned int * counts;
+	size_t total = 0, capacity = 0, slots = 0, size, h, first;
+	unsigned int i, n;
+	long long taken = xdgGetFileClock();
+
+	if (!xdgInitPathBuffer(&path, dirs, relative, strlen(relative)))
+		return 0;
+	size = sizeof(xdgListingSnapshot) + sizeof(struct _xdgListedDirectory)*dirs->count;
+	if (!(snapshot = (xdgListingSnapshot*)malloc(size)) ||
+		!(counts = (unsigned int*)malloc(sizeof(unsigned int)*(dirs->count ? dirs->count : 1))))
+	{
+		free(snapshot);
+		xdgFreePathBuffer(&path);
+		return 0;
+	}
+	snapshot->references = 1;
+	snapshot->count = dirs->count;
+	snapshot->racy = FALSE;
+	xdgZeroMemory(snapshot + 1, sizeof(struct _xdgListedDirectory)*dirs->count);
+
+	/* Read the names of all directories first, to size the tables. */
+	for (i = 0; i < dirs->count; ++i)
+	{
+		listed = (struct _xdgListedDirectory*)(snapshot + 1) + i;
+		counts[i] = 0;
+		/* Slow directories are not read within lookups, and their
+		 * names are left unknown. */
+		if (dirs->items[i].slow)
+		{
+			listed->exists = TRUE;
+			continue;
+		}
+		/* The identity is taken before reading, so that a change while
+		 * reading is noticed by the next revalidation. */
+		if (stat(xdgComposePath(&path, &dirs->items[i]), &st) == -1 || !S_ISDIR(st.st_mode))
+			continue;
+		listed->exists = TRUE;
+		listed->device = st.st_dev;
+		listed->inode = st.st_ino;
+		listed->mtime = xdgGetModificationTime(&st);
+		if (xdgIsRacy(listed->mtime, taken))
+			snapshot->racy = TRUE;
+		if (!(dir = opendir(xdgComposePath(&path, &dirs->items[i]))))
+			continue;
+		while ((entry = readdir(dir)))
+		{
+			if (total == capacity)
+			{
+				capacity = MAX(capacity*2, 64);
+				if (!(tmp = (unsigned long long*)realloc(hashes, sizeof(unsigned long long)*capacity)))
+				{
+					closedir(dir);
+					free(snapshot);
+					snapshot = 0;
+					goto done;
+				}
+				hashes = tmp;
+			}
+			hashes[total++] = xdgHashName(entry->d_name, strlen(entry->d_name));
+			++counts[i];
+		}
+		closedir(dir);
+		listed->listed = TRUE;
+		/* Tables are at most half full. */
+		for (size = 2; size < counts[i]*2; size *= 2) ;
+		slots += size;
+	}
+
+	size = sizeof(xdgListingSnapshot) + sizeof(struct _xdgListedDirectory)*dirs->count;
+	if (!(tmp = (unsigned long long*)realloc(snapshot, size + sizeof(unsigned long long)*slots)))
+	{
+		free(snapshot);
+		snapshot = 0;
+		goto done;
+	}
+	snapshot = (xdgListingSnapshot*)tmp;
+	snapshot->directories = (struct _xdgListedDirectory*)(snapshot + 1);
+	table = (unsigned long long*)((char*)snapshot + size);
+	xdgZeroMemory(table, sizeof(unsigned long long)*slots);
+	for (i = 0, first = 0; i < dirs->count; ++i)
+	{
+		listed = &snapshot->directories[i];
+		if (!listed->listed)
+			continue;
+		for (size = 2; size < counts[i]*2; size *= 2) ;
+		listed->table = table;
+		listed->mask = size - 1;
+		for (n = 0; n < counts[i]; ++n)
+		{
+			hash = hashes[first + n];
+			for (h = hash & listed->mask; table[h] && table[h] != hash; h = (h + 1) & listed->mask) ;
+			table[h] = hash;
+		}
+		first += counts[i];
+		table += size;
+	}
+
+done:
+	free(counts);
+	free(hashes);
+	xdgFreePathBuffer(&path);
+	return snapshot;
+}
+
+/** Check whether a snapshot still matches the subdirectory in every directory of a list.
+ * Only the identity and modification time of the subdirectories are compared,
+ * so racy snapshots are never current. */
+static int xdgIsListingCurrent(xdgDirectoryList * dirs, const char * relative, const xdgListingSnapshot * snapshot)
+{
+	const struct _xdgListedDirectory * listed;
+	xdgPathBuffer path;
+	struct stat st;
+	unsigned int i;
+	int exists, current = TRUE;
+
+	if (snapshot->racy || snapshot->count != dirs->count || !xdgInitPathBuffer(&path, dirs, relative, strlen(relative)))
+		return FALSE;
+	for (i = 0; current && i < dirs->count; ++i)
+	{
+		if (dirs->items[i].slow)
+			continue;
+		listed = &snapshot->directories[i];
+		exists = stat(xdgComposePath(&path, &dirs->items[i]), &st) == 0 && S_ISDIR(st.st_mode);
+		current = exists == listed->exists && (!exists || (st.st_dev == listed->device &&
+				st.st_ino == listed->inode && xdgGetModificationTime(&st) == listed->mtime));
+	}
+	xdgFreePathBuffer(&path);
+	return current;
+}
+
+/** Get the cached listing which covers a lookup.
+ * The snapshot is taken on first use and compared to the directories at
+ * most once per second.
+ * @param dirs Prepared directory list.
+ * @param path Path buffer of the lookup.
+ * @param hash Receives the hash of the name in the listed subdirectory
+ * 	which the looked up path starts with.
+ * @return A referenced snapshot to be released with xdgReleaseListing(),
+ * 	or @c NULL if no listing covers the lookup.
+ */
+static xdgListingSnapshot * xdgAcquireListing(xdgDirectoryList * dirs, xdgPathBuffer *path, unsigned long long *hash)
+{
+	xdgListing * listing;
+	xdgListingSnapshot * snapshot, * fresh;
+	const char * name;
+	size_t length;
+	long long now;
+
+	if (!dirs->listings)
+		return 0;
+	for (listing = *dirs->listings; listing; listing = listing->next)
+		if (strncmp(path->relativeAt, listing->relative, listing->length) == 0)
+			break;
+	if (!listing)
+		return 0;
+	name = path->relativeAt + listing->length;
+	for (length = 0; name[length] && name[length] != DIR_SEPARATOR_CHAR; ++length) ;
+	if (!length)
+		return 0;
+	*hash = xdgHashName(name, length);
+
+	now = time(NULL);
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&listing->mutex);
+#endif
+	if (!listing->snapshot || (now != listing->checked && !xdgIsListingCurrent(dirs, listing->relative, listing->snapshot)))
+	{
+		/* Keep using the old snapshot if a new one cannot be taken. */
+		if ((fresh = xdgTakeListing(dirs, listing->relative)))
+		{
+			xdgReleaseListing(listing->snapshot);
+			listing->snapshot = fresh;
+		}
+	}
+	listing->checked = now;
+	if ((snapshot = listing->snapshot))
+	{
+#if defined(__GNUC__)
+		__atomic_add_fetch(&snapshot->references, 1, __ATOMIC_RELAXED);
+#else
+		++snapshot->references;
+#endif
+	}
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&listing->mutex);
+#endif
+	return snapshot;
+}
+
+/** Check whether a listing shows that a name is missing from a directory.
+ * @param snapshot Snapshot from xdgAcquireListing(), or @c NULL.
+ * @param i Index of the directory.
+ * @param hash Hash of the name from xdgAcquireListing().
+ */
+static int xdgIsUnlisted(const xdgListingSnapshot * snapshot, unsigned int i, unsigned long long hash)
+{
+	const struct _xdgListedDirectory * listed;
+	unsigned long long h;
+	if (!snapshot)
+		return FALSE;
+	listed = &snapshot->directories[i];
+	/* Missing subdirectories contain nothing, unreadable ones anything. */
+	if (!listed->exists)
+		return TRUE;
+	if (!listed->listed)
+		return FALSE;
+	for (h = hash & listed->mask; listed->table[h]; h = (h + 1) & listed->mask)
+		if (listed->table[h] == hash)
+			return FALSE;
+	return TRUE;
+}
+
+/** Find all existing files corresponding to relativePath relative to each item in dirs.
+  * @param relativePath Relative path to search for, which need not be null-terminated.
+  * @param length Length of relativePath.
+  * @param dirs Prepared directory list.
+  * @param shared Shared resolution cache to use, or @c NULL.
+  * @param fingerprint Fingerprint of dirs in the shared resolution cache.
+  * @return A sequence of null-terminated strings terminated by a
+  * 	double-<tt>NULL</tt> (empty string) and allocated using malloc().
+  */
+static char * xdgFindExisting(const char * relativePath, size_t length, xdgDirectoryList * dirs,
+	xdgSharedCache * shared, unsigned long long fingerprint)
+{
+	xdgPathBuffer path;
+	char * fullPath;
+	char * returnString = 0;
+	char * tmpString;
+	size_t strLen = 0, capacity = 0, fullLength;
+	unsigned long long mask = shared ? xdgGetSharedMask(dirs) : 0;
+	unsigned long long known = 0, present = 0, generation = 0;
+	unsigned int i;
+	int cached, watched = 0;
+	xdgDeadline deadline;
+	xdgListingSnapshot * listing;
+	unsigned long long name;
+
+	if (!xdgInitPathBuffer(&path, dirs, relativePath, length))
+		return 0;
+	xdgStartDeadline(&deadline, dirs);
+	listing = xdgAcquireListing(dirs, &path, &name);
+	/* The directories are watched before probing, so that results are
+	 * published with a generation which is not newer than they are. */
+	if (mask && (watched = xdgWatchSharedParents(shared, dirs, &path, &deadline)) == -1)
+		mask = 0;
+	if (mask)
+		generation = xdgSharedCacheGeneration(shared);
+
+	/* A shared result can only be used if every directory was probed. */
+	cached = mask && watched && xdgSharedCacheLookup(shared, fingerprint, path.relative, length, &known, &present) &&
+		(known & mask) == mask;
+	if (!cached)
+		present = 0;
+
+	for (i = 0; i < dirs->count; ++i)
+	{
+		if (cached && !(present & (1ull << i)))
+			continue;
+		if (!cached)
+		{
+			if (xdgIsUnlisted(listing, i, name) || !xdgIsReadableInDirectory(dirs, i, &path, &deadline))
+				continue;
+			if (mask) present |= 1ull << i;
+		}
+		fullPath = xdgComposePath(&path, &dirs->items[i]);
+		fullLength = dirs->items[i].length + path.relativeLength;
+		if (strLen+fullLength+2 > capacity)
+		{
+			/* Grow geometrically so that many hits do not realloc each time. */
+			capacity = MAX(capacity*2, strLen+fullLength+2);
+			if (!(tmpString = (char*)realloc(returnString, capacity)))
+			{
+				free(returnString);
+				xdgFreePathBuffer(&path);
+				xdgReleaseListing(listing);
+				return 0;
+			}
+			returnString = tmpString;
+		}
+		memcpy(&returnString[strLen], fullPath, fullLength+1);
+		strLen += fullLength+1;
+	}
+	/* Directories which did not answer in time remain unknown. */
+	if (mask && !cached)
+		xdgSharedCacheStore(shared, fingerprint, generation, path.relative, length, mask & ~deadline.skipped, present);
+	xdgFreePathBuffer(&path);
+	xdgReleaseListing(listing);
+	if (returnString)
+		returnString[strLen] = 0;
+	else
+	{
+		if ((returnString = (char*)malloc(2)))
+			strcpy(returnString, "\0");
+	}
+	return returnString;
+}
+
+#if defined(HAVE_PTHREAD) && defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+
+/** Open the relative path of a path buffer in every directory of a list at
+ * once, for lists of handles with @c XDG_HANDLE_PARALLEL_OPEN. Idle threads
+ * of the pool open candidates by their full path, so that they do not
+ * depend on directory descriptors which may be reopened once the lookup
+ * returns. The lookup opens the other candidates itself when it gets to
+ * them, as well as queued candidates which no thread took yet, so it only
+ * ever waits for opens which are running, and no longer than the deadline.
+ * @param dirs Prepared directory list.
+ * @param path Path buffer for dirs.
+ * @param flags Flags for open(), which must not create files.
+ * @param deadline Deadline of the lookup.
+ * @param listing Listing of the parent directory of the path, or @c NULL.
+ * @param name Hash of the name of the path in the listing.
+ * @param fd Receives the descriptor in the highest priority directory
+ * 	containing the path, or -1 with @c errno set.
+ * @param index Receives the index of that directory.
+ * @return Whether the directories were probed, @c FALSE if the pool
+ * 	cannot be used and they have to be probed one after another.
+ */
+static int xdgOpenParallel(xdgDirectoryList * dirs, xdgPathBuffer *path, int flags, xdgDeadline *deadline,
+	const xdgListingSnapshot * listing, unsigned long long name, int *fd, unsigned int *index)
+{
+	xdgOpenBatch * batch;
+	xdgOpenCandidate * candidate;
+	pthread_condattr_t condattr;
+	size_t size = 0;
+	char * paths;
+	unsigned int i, queued = 0, local = dirs->count;
+	int result, error = ENOENT, err;
+
+	for (i = 0; i < dirs->count; ++i)
+		size += dirs->items[i].length + path->relativeLength + 1;
+	if (!(batch = (xdgOpenBatch*)malloc(sizeof(xdgOpenBatch) + sizeof(xdgOpenCandidate)*(dirs->count - 1) + size)))
+		return FALSE;
+	paths = (char*)(batch->candidates + dirs->count);
+	batch->flags = flags;
+	batch->abandoned = FALSE;
+
+	/* Candidates which are known to fail are done before they start. The
+	 * first candidate which is not slow is opened by the lookup at once. */
+	for (i = 0; i < dirs->count; ++i)
+	{
+		candidate = &batch->candidates[i];
+		candidate->batch = batch;
+		candidate->next = 0;
+		candidate->path = 0;
+		candidate->fd = -1;
+		candidate->error = ENOENT;
+		candidate->state = XDG_CANDIDATE_LOCAL;
+		if (xdgIsUnlisted(listing, i, name) || (dirs->hasFds && dirs->items[i].fd == -1))
+			candidate->state = XDG_CANDIDATE_DONE;
+		else if (xdgIsBounded(dirs, i, deadline) && xdgIsDemoted(&dirs->items[i]))
+		{
+			candidate->state = XDG_CANDIDATE_DONE;
+			candidate->error = ETIMEDOUT;
+			if (i < 64)
+				deadline->skipped |= 1ull << i;
+		}
+		else if (local == dirs->count && !xdgIsBounded(dirs, i, deadline))
+			local = i;
+		else
+		{
+			candidate->path = paths;
+			memcpy(paths, xdgComposePath(path, &dirs->items[i]), dirs->items[i].length + path->relativeLength + 1);
+			paths += dirs->items[i].length + path->relativeLength + 1;
+			++queued;
+		}
+	}
+
+	pthread_mutex_lock(&xdgOpenPool.mutex);
+	if (queued && !xdgStartOpenPool())
+	{
+		pthread_mutex_unlock(&xdgOpenPool.mutex);
+		free(batch);
+		return FALSE;
+	}
+	pthread_condattr_init(&condattr);
+	pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&batch->finished, &condattr);
+	pthread_condattr_destroy(&condattr);
+	/* Only idle threads are handed candidates, the others stay local. */
+	for (i = 0, queued = 0; i < dirs->count && xdgOpenPool.idle; ++i)
+	{
+		candidate = &batch->candidates[i];
+		if (!candidate->path)
+			continue;
+		candidate->state = XDG_CANDIDATE_QUEUED;
+		*xdgOpenPool.tail = candidate;
+		xdgOpenPool.tail = &candidate->next;
+		--xdgOpenPool.idle;
+		++queued;
+	}
+	batch->references = 1 + queued;
+	if (queued)
+		pthread_cond_broadcast(&xdgOpenPool.queued);
+
+	/* Take the candidates in order of priority until one succeeds. */
+	for (i = 0; i < dirs->count; ++i)
+	{
+		candidate = &batch->candidates[i];
+		if (candidate->state == XDG_CANDIDATE_LOCAL || candidate->state == XDG_CANDIDATE_QUEUED)
+		{
+			candidate->state = XDG_CANDIDATE_RUNNING;
+			pthread_mutex_unlock(&xdgOpenPool.mutex);
+			result = xdgOpenInDirectory(dirs, i, path, flags, deadline);
+			err = errno;
+			pthread_mutex_lock(&xdgOpenPool.mutex);
+			candidate->fd = result;
+			candidate->error = err;
+			candidate->state = XDG_CANDIDATE_DONE;
+		}
+		err = 0;
+		while (candidate->state != XDG_CANDIDATE_DONE && err != ETIMEDOUT)
+		{
+			if (deadline->active)
+				err = pthread_cond_timedwait(&batch->finished, &xdgOpenPool.mutex, &deadline->end);
+			else
+				pthread_cond_wait(&batch->finished, &xdgOpenPool.mutex);
+		}
+		if (candidate->state != XDG_CANDIDATE_DONE)
+		{
+			if (xdgIsBounded(dirs, i, deadline))
+				xdgDemote(&dirs->items[i]);
+			if (i < 64)
+				deadline->skipped |= 1ull << i;
+			error = ETIMEDOUT;
+			continue;
+		}
+		if (candidate->fd != -1)
+			break;
+		error = candidate->error;
+	}
+	*index = i;
+	*fd = -1;
+	if (i < dirs->count)
+	{
+		*fd = batch->candidates[i].fd;
+		batch->candidates[i].fd = -1;
+	}
+
+	/* Close the files opened in directories of lower priority. */
+	batch->abandoned = TRUE;
+	for (i = 0; i < dirs->count; ++i)
+		if (batch->candidates[i].state == XDG_CANDIDATE_DONE && batch->candidates[i].fd != -1)
+			close(batch->candidates[i].fd);
+	xdgReleaseOpenBatch(batch);
+	pthread_mutex_unlock(&xdgOpenPool.mutex);
+	if (*fd == -1)
+		errno = error;
+	return TRUE;
+}
+
+#else
+
+static int xdgOpenParallel(xdgDirectoryList * dirs, xdgPathBuffer *path, int flags, xdgDeadline *deadline,
+	const xdgListingSnapshot * listing, unsigned long long name, int *fd, unsigned int *index)
+{
+	return FALSE;
+}
+
+#endif
+
+/** Open first possible config file corresponding to relativePath.
+  * @param relativePath Path to scan for, which need not be null-terminated.
+  * @param length Length of relativePath.
+  * @param mode Mode with which to attempt to open files (see fopen modes).
+  * @param dirs Prepared list of directories in which to search for relativePath.
+  * @param shared Shared resolution cache to use, or @c NULL.
+  * @param fingerprint Fingerprint of dirs in the shared resolution cache.
+  * @return File pointer if successful else @c NULL. Client must use @c fclose to close file.
+  */
+static FILE * xdgFileOpen(const char * relativePath, size_t length, const char * mode, xdgDirectoryList * dirs,
+	xdgSharedCache * shared, unsigned long long fingerprint)
+{
+	xdgPathBuffer path;
+	FILE * testFile = 0;
+	/* Modes other than reading may create files, so they always probe. */
+	unsigned long long mask = shared && mode[0] == 'r' ? xdgGetSharedMask(dirs) : 0;
+	unsigned long long known = 0, present = 0, before, generation = 0;
+	unsigned int i;
+	int cached, flags, fd, watched = 0;
+	xdgDeadline deadline;
+	xdgListingSnapshot * listing;
+	unsigned long long name;
+
+	if (!xdgInitPathBuffer(&path, dirs, relativePath, length))
+		return 0;
+	xdgStartDeadline(&deadline, dirs);
+	listing = xdgAcquireListing(dirs, &path, &name);
+	if (mask && (watched = xdgWatchSharedParents(shared, dirs, &path, &deadline)) == -1)
+		mask = 0;
+	if (mask)
+		generation = xdgSharedCacheGeneration(shared);
+
+	/* A shared result can be used if every directory before the first
+	 * one containing the file was probed. */
+	cached = mask && watched && xdgSharedCacheLookup(shared, fingerprint, path.relative, length, &known, &present);
+	if (cached)
+	{
+		present &= mask;
+		before = present ? (present & -present) - 1 : mask;
+		cached = (known & before) == before;
+	}
+
+	/* Opening a file in every directory is only harmless if it cannot create files. */
+	if (!cached && dirs->parallel && dirs->count > 1 && (flags = xdgGetModeFlags(mode)) != -1 &&
+		!(flags & O_CREAT) && xdgOpenParallel(dirs, &path, flags, &deadline, listing, name, &fd, &i))
+	{
+		if (fd != -1 && !(testFile = fdopen(fd, mode)))
+			close(fd);
+		if (mask && testFile)
+			xdgSharedCacheStore(shared, fingerprint, generation, path.relative, length,
+				((2ull << i) - 1) & ~deadline.skipped, 1ull << i);
+		else if (mask && fd == -1)
+			xdgSharedCacheStore(shared, fingerprint, generation, path.relative, length, mask & ~deadline.skipped, 0);
+		goto done;
+	}
+
+probe:
+	for (i = 0; i < dirs->count; ++i)
+	{
+		if (cached && !(present & (1ull << i)))
+			continue;
+		/* Files in directories missing from a listing can only be created when writing. */
+		if (mode[0] == 'r' && !cached && xdgIsUnlisted(listing, i, name))
+			continue;
+		if ((testFile = xdgFopenInDirectory(dirs, i, &path, mode, &deadline)))
+		{
+			if (mask && !cached)
+				xdgSharedCacheStore(shared, fingerprint, generation, path.relative, length,
+					((2ull << i) - 1) & ~deadline.skipped, 1ull << i);
+			break;
+		}
+		if (cached)
+		{
+			/* The shared result is stale, probe every directory and republish. */
+			cached = FALSE;
+			goto probe;
+		}
+	}
+	if (!testFile && mask && !cached)
+		xdgSharedCacheStore(shared, fingerprint, generation, path.relative, length, mask & ~deadline.skipped, 0);
+	/* Lookups in other processes notice created files without waiting for
+	 * their watchers. */
+	if (testFile && shared && mode[0] != 'r')
+		xdgSharedCacheInvalidate(shared);
+done:
+	xdgFreePathBuffer(&path);
+	xdgReleaseListing(listing);
+	return testFile;
+}
+
+/** Get the status of the relative path of a path buffer in a directory of a list.
+  * @return Zero on success, -1 if an error occured (in which case errno will be set).
+  * @see xdgOpenInDirectory() */
+static int xdgStatInDirectory(xdgDirectoryList * dirs, unsigned int i, xdgPathBuffer *path, struct stat *st)
+{
+#if defined(HAVE_OPENAT) && defined(HAVE_FACCESSAT)
+	xdgDirectory * dir = &dirs->items[i];
+	if (dirs->hasFds)
+	{
+		if (dir->fd == -1)
+		{
+			errno = ENOENT;
+			return -1;
+		}
+		return fstatat(dir->fd, path->relativeAt, st, 0);
+	}
+#endif
+	return stat(xdgComposePath(path, &dirs->items[i]), st);
+}
+
+/** Hash the identity of all files corresponding to relative paths relative to each item in dirs.
+  * @param relativePaths Relative paths to hash.
+  * @param count Number of relative paths.
+  * @param dirs Prepared directory list.
+  * @param fingerprint Receives the hash.
+  * @return Zero on success, -1 if an error occured (in which case errno will be set).
+  */
+static int xdgFingerprintExisting(const char * const * relativePaths, unsigned int count, xdgDirectoryList * dirs,
+	unsigned long long *fingerprint)
+{
+	xdgPathBuffer path;
+	struct stat st;
+	unsigned long long hash = XDG_HASH_INIT;
+	unsigned long long identity[7];
+	unsigned int p, i;
+
+	for (i = 0; i < dirs->count; ++i)
+		hash = xdgHashBytes(hash, dirs->items[i].prefix, dirs->items[i].length + 1);
+	for (p = 0; p < count; ++p)
+	{
+		hash = xdgHashBytes(hash, relativePaths[p], strlen(relativePaths[p]) + 1);
+		if (!xdgInitPathBuffer(&path, dirs, relativePaths[p], strlen(relativePaths[p])))
+			return -1;
+		for (i = 0; i < dirs->count; ++i)
+		{
+			xdgZeroMemory(identity, sizeof(identity));
+			/* Missing files hash the reason, so that a file becoming unreadable changes the hash. */
+			if (xdgStatInDirectory(dirs, i, &path, &st) == -1)
+				identity[0] = errno;
+			else
+			{
+				identity[0] = 0;
+				identity[1] = st.st_dev;
+				identity[2] = st.st_ino;
+				identity[3] = st.st_size;
+				identity[4] = st.st_mode;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+				identity[5] = (unsigned long long)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+				identity[6] = (unsigned long long)st.st_ctim.tv_sec * 1000000000ull + st.st_ctim.tv_nsec;
+#else
+				identity[5] = st.st_mtime;
+				identity[6] = st.st_ctime;
+#endif
+			}
+			hash = xdgHashBytes(hash, identity, sizeof(identity));
+		}
+		xdgFreePathBuffer(&path);
+	}
+	*fingerprint = hash;
+	return 0;
+}
+
+/** File opened by xdgReadAllExisting() before its contents are read. */
+typedef struct _xdgOpenFile
+{
+	int fd;
+	unsigned int directory;
+	size_t length;
+} xdgOpenFile;
+
+/** Read all regular files corresponding to relativePath relative to each item in dirs.
+  * All files are opened and sized with fstat() first so that the contents can be read
+  * with a single read() per file into a single allocation.
+  * @param relativePath Relative path to search for.
+  * @param dirs Prepared directory list.
+  * @param order Either @c XDG_READ_PRIORITY_ORDER or @c XDG_READ_OVERRIDE_ORDER.
+  * @param files File set to fill.
+  * @return Zero on success, -1 if an error occured (in which case errno will be set).
+  */
+static int xdgReadAllExisting(const char * relativePath, xdgDirectoryList * dirs, int order, xdgFileSet *files)
+{
+	xdgPathBuffer path;
+	char * block;
+	xdgOpenFile * opened;
+	xdgOpenFile * current;
+	xdgFileExtent * extent;
+	struct stat st;
+	unsigned int count, i;
+	size_t total = 0, done;
+	ssize_t got;
+	int fd, ret = -1;
+	xdgDeadline deadline;
+	xdgListingSnapshot * listing;
+	unsigned long long name;
+
+	xdgZeroMemory(files, sizeof(xdgFileSet));
+	if (dirs->count == 0) return 0;
+	if (!xdgInitPathBuffer(&path, dirs, relativePath, strlen(relativePath)))
+		return -1;
+	if (!(opened = (xdgOpenFile*)malloc(sizeof(xdgOpenFile)*dirs->count)))
+	{
+		xdgFreePathBuffer(&path);
+		errno = ENOMEM;
+		return -1;
+	}
+	xdgStartDeadline(&deadline, dirs);
+	listing = xdgAcquireListing(dirs, &path, &name);
+
+	for (i = count = 0; i < dirs->count; ++i)
+	{
+		if (xdgIsUnlisted(listing, i, name))
+			continue;
+		fd = xdgOpenInDirectory(dirs, i, &path, O_RDONLY | XDG_O_CLOEXEC, &deadline);
+		if (fd == -1) continue;
+		if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+		{
+			close(fd);
+			continue;
+		}
+		opened[count].fd = fd;
+		opened[count].directory = i;
+		opened[count].length = st.st_size;
+		total += opened[count].length + 1;
+		++count;
+	}
+	xdgFreePathBuffer(&path);
+	xdgReleaseListing(listing);
+
+	if (count == 0)
+	{
+		ret = 0;
+		goto cleanup;
+	}
+	if (!(block = (char*)malloc(sizeof(xdgFileExtent)*count + total)))
+	{
+		errno = ENOMEM;
+		goto cleanup;
+	}
+	files->files = (xdgFileExtent*)block;
+	files->buffer = block + sizeof(xdgFileExtent)*count;
+
+	for (i = 0, total = 0; i < count; ++i)
+	{
+		current = &opened[order == XDG_READ_OVERRIDE_ORDER ? count-1-i : i];
+		extent = &files->files[i];
+		extent->offset = total;
+		extent->directory = current->directory;
+		/* The file may have shrunk since fstat(), so stop at end-of-file. */
+		for (done = 0; done < current->length; done += got)
+		{
+			got = read(current->fd, files->buffer+total+done, current->length-done);
+			if (got == 0) break;
+			if (got == -1)
+			{
+				if (errno == EINTR) { got = 0; continue; }
+				free(block);
+				xdgZeroMemory(files, sizeof(xdgFileSet));
+				goto cleanup;
+			}
+		}
+		extent->length = done;
+		files->buffer[total+done] = 0;
+		total += current->length + 1;
+	}
+	files->count = count;
+	ret = 0;
+
+cleanup:
+	for (i = 0; i < count; ++i)
+		close(opened[i].fd);
+	free(opened);
+	return ret;
+}
+
+/** Open relativePath for reading relative to each item in dirs.
+  * @see xdgOpenEach() */
+static int xdgOpenEachExisting(const char * relativePath, xdgDirectoryList * dirs,
+	xdgOpenEachCallback callback, void *userData)
+{
+	xdgPathBuffer path;
+	unsigned int i;
+	int fd, ret = 0;
+	xdgDeadline deadline;
+	xdgListingSnapshot * listing;
+	unsigned long long name;
+
+	if (dirs->count == 0) return 0;
+	if (!xdgInitPathBuffer(&path, dirs, relativePath, strlen(relativePath)))
+		return -1;
+	xdgStartDeadline(&deadline, dirs);
+	listing = xdgAcquireListing(dirs, &path, &name);
+	for (i = 0; ret == 0 && i < dirs->count; ++i)
+	{
+		if (xdgIsUnlisted(listing, i, name))
+			continue;
+		if ((fd = xdgOpenInDirectory(dirs, i, &path, O_RDONLY | XDG_O_CLOEXEC, &deadline)) != -1)
+			ret = callback(fd, i, userData);
+	}
+	xdgFreePathBuffer(&path);
+	xdgReleaseListing(listing);
+	return ret;
+}
+
+/** Number of distinct parent directories per thread of a probe matrix. */
+#define XDG_PROBE_GROUPS_PER_THREAD 32
+/** Maximum number of threads filling a probe matrix, including the calling thread. */
+#define XDG_PROBE_MAX_THREADS 4
+
+/** Path of a probe matrix, split into its parent directory and name. */
+typedef struct _xdgProbePath
+{
+	const char * parent;
+	size_t parentLength;
+	/** Name in the parent, empty if the path is the parent itself. */
+	const char * name;
+	/** Row of the path in the matrix. */
+	unsigned int row;
+} xdgProbePath;
+
+/** Share of the paths of a probe matrix, starting and ending at a change of parent. */
+typedef struct _xdgProbeJob
+{
+	xdgDirectoryList * dirs;
+	xdgProbePath * paths;
+	unsigned int begin;
+	unsigned int end;
+	xdgProbeMatrix * matrix;
+	/** Deadline of the matrix, of which each job records its own skipped directories. */
+	xdgDeadline deadline;
+	/** errno of the failure of the job, 0 if it succeeded. */
+	int error;
+} xdgProbeJob;
+
+/** Order paths by parent directory. */
+static int xdgCompareProbePaths(const void *a, const void *b)
+{
+	const xdgProbePath * x = (const xdgProbePath*)a;
+	const xdgProbePath * y = (const xdgProbePath*)b;
+	int result = memcmp(x->parent, y->parent, x->parentLength < y->parentLength ? x->parentLength : y->parentLength);
+	if (result)
+		return result;
+	return x->parentLength < y->parentLength ? -1 : x->parentLength > y->parentLength;
+}
+
+static int xdgCompareNames(const void *a, const void *b)
+{
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/** Check whether two paths of a probe matrix have the same parent directory. */
+static int xdgIsSameParent(const xdgProbePath *a, const xdgProbePath *b)
+{
+	return a->parentLength == b->parentLength && memcmp(a->parent, b->parent, a->parentLength) == 0;
+}
+
+/** Open the parent of a group of probe matrix paths in a directory of a
+ * list for reading its names.
+ * @see xdgOpenInDirectory() */
+static DIR * xdgOpenProbeDirectory(xdgDirectoryList * dirs, unsigned int i, xdgPathBuffer *path)
+{
+#if defined(HAVE_OPENAT) && defined(HAVE_FACCESSAT) && defined(HAVE_FDOPENDIR)
+	xdgDirectory * dir = &dirs->items[i];
+	const char * relative = *path->relativeAt ? path->relativeAt : ".";
+	DIR * stream;
+	int fd, err;
+	if (dirs->hasFds)
+	{
+		if (dir->fd == -1)
+		{
+			errno = ENOENT;
+			return 0;
+		}
+		fd = openat(dir->fd, relative, O_RDONLY | O_DIRECTORY | XDG_O_CLOEXEC);
+#  ifdef ESTALE
+		if (fd == -1 && errno == ESTALE && xdgRefreshDirectoryFd(dir))
+			fd = openat(dir->fd, relative, O_RDONLY | O_DIRECTORY | XDG_O_CLOEXEC);
+#  endif
+		if (fd == -1)
+			return 0;
+		if (!(stream = fdopendir(fd)))
+		{
+			err = errno;
+			close(fd);
+			errno = err;
+		}
+		return stream;
+	}
+#endif
+	return opendir(xdgComposePath(path, &dirs->items[i]));
+}
+
+/** Check whether a directory of a list contains a path of a probe matrix
+ * by probing the path itself, for directories which are not read: slow
+ * directories while the list has a deadline, which are probed within it
+ * like lookups do, and directories which can be searched but not read.
+ * @return Non-zero if the path exists. */
+static int xdgProbeMatrixPath(xdgProbeJob * job, unsigned int i, const xdgProbePath * probePath)
+{
+	xdgDirectoryList * dirs = job->dirs;
+	xdgPathBuffer path;
+	int found;
+
+	if (!xdgInitPathBuffer(&path, dirs, probePath->parent, strlen(probePath->parent)))
+	{
+		job->error = ENOMEM;
+		return FALSE;
+	}
+	if (xdgIsBounded(dirs, i, &job->deadline))
+		found = xdgProbeBounded(dirs, i, &path, -1, &job->deadline) == 0;
+#if defined(HAVE_OPENAT) && defined(HAVE_FACCESSAT)
+	else if (dirs->hasFds)
+		found = dirs->items[i].fd != -1 && faccessat(dirs->items[i].fd, path.relativeAt, F_OK, AT_EACCESS) == 0;
+	else
+		found = faccessat(AT_FDCWD, xdgComposePath(&path, &dirs->items[i]), F_OK, AT_EACCESS) == 0;
+#else
+	else
+		found = access(xdgComposePath(&path, &dirs->items[i]), F_OK) == 0;
+#endif
+	xdgFreePathBuffer(&path);
+	return found;
+}
+
+/** Fill the rows of the paths of a job, reading each parent directory once
+ * in every directory of the list and looking the names up in the sorted
+ * listing. */
+static void * xdgRunProbeJob(void *arg)
+{
+	xdgProbeJob * job = (xdgProbeJob*)arg;
+	xdgProbePath * paths = job->paths;
+	xdgPathBuffer path;
+	struct dirent * entry;
+	DIR * dir;
+	char * buffer = 0, ** names = 0;
+	size_t * offsets = 0;
+	size_t used, length, capacity = 0, nameCapacity = 0;
+	unsigned int g, end, p, i, count;
+	void * tmp;
+
+	for (g = job->begin; g < job->end && !job->error; g = end)
+	{
+		for (end = g + 1; end < job->end && xdgIsSameParent(&paths[g], &paths[end]); ++end) ;
+		if (!xdgInitPathBuffer(&path, job->dirs, paths[g].parent, paths[g].parentLength))
+		{
+			job->error = ENOMEM;
+			break;
+		}
+		for (i = 0; i < job->dirs->count && !job->error; ++i)
+		{
+			/* Slow directories are not read within the deadline, and
+			 * directories which cannot be read may still be searched. */
+			if (xdgIsBounded(job->dirs, i, &job->deadline) ||
+				(!(dir = xdgOpenProbeDirectory(job->dirs, i, &path)) && errno == EACCES))
+			{
+				for (p = g; p < end && !job->error; ++p)
+				{
+					if (xdgProbeMatrixPath(job, i, &paths[p]))
+						job->matrix->bits[paths[p].row*job->matrix->words + i/64] |= 1ull << (i%64);
+				}
+				continue;
+			}
+			if (!dir)
+				continue;
+			for (used = 0, count = 0; (entry = readdir(dir)); ++count)
+			{
+				length = strlen(entry->d_name) + 1;
+				if (used + length > capacity)
+				{
+					if (!(tmp = realloc(buffer, MAX(capacity*2, used + length + 4096))))
+						break;
+					buffer = (char*)tmp;
+					capacity = MAX(capacity*2, used + length + 4096);
+				}
+				if (count == nameCapacity)
+				{
+					if (!(tmp = realloc(offsets, sizeof(size_t)*MAX(nameCapacity*2, 64))))
+						break;
+					offsets = (size_t*)tmp;
+					if (!(tmp = realloc(names, sizeof(char*)*MAX(nameCapacity*2, 64))))
+						break;
+					names = (char**)tmp;
+					nameCapacity = MAX(nameCapacity*2, 64);
+				}
+				memcpy(buffer + used, entry->d_name, length);
+				offsets[count] = used;
+				used += length;
+			}
+			closedir(dir);
+			if (entry)
+			{
+				job->error = ENOMEM;
+				break;
+			}
+			/* The buffer may have moved while reading, so the names are only pointed to now. */
+			for (p = 0; p < count; ++p)
+				names[p] = buffer + offsets[p];
+			qsort(names, count, sizeof(char*), xdgCompareNames);
+			for (p = g; p < end; ++p)
+			{
+				if (*paths[p].name && !bsearch(&paths[p].name, names, count, sizeof(char*), xdgCompareNames))
+					continue;
+				job->matrix->bits[paths[p].row*job->matrix->words + i/64] |= 1ull << (i%64);
+			}
+		}
+		xdgFreePathBuffer(&path);
+	}
+	free(buffer);
+	free(offsets);
+	free(names);
+	return 0;
+}
+
+/** Find which directories of a list contain each of a list of paths.
+  * @param relativePaths Paths to look for.
+  * @param count Number of paths.
+  * @param dirs Prepared directory list.
+  * @param matrix Matrix to fill.
+  * @return Zero on success, -1 if an error occured (in which case errno will be set).
+  */
+static int xdgProbeMatrixExisting(const char * const * relativePaths, unsigned int count, xdgDirectoryList * dirs,
+	xdgProbeMatrix *matrix)
+{
+	xdgProbeJob jobs[XDG_PROBE_MAX_THREADS];
+	xdgDeadline deadline;
+	xdgProbePath * paths;
+	const char * relative, * name;
+	unsigned int groups, threads, i, p;
+	int error = 0;
+#ifdef HAVE_PTHREAD
+	pthread_t thread[XDG_PROBE_MAX_THREADS];
+	int started[XDG_PROBE_MAX_THREADS];
+#endif
+
+	xdgZeroMemory(matrix, sizeof(xdgProbeMatrix));
+	matrix->words = dirs->count ? (dirs->count + 63) / 64 : 1;
+	if (!(matrix->bits = (unsigned long long*)calloc(count ? count*matrix->words : 1, sizeof(unsigned long long))) ||
+		!(paths = (xdgProbePath*)malloc(sizeof(xdgProbePath)*(count ? count : 1))))
+	{
+		free(matrix->bits);
+		xdgZeroMemory(matrix, sizeof(xdgProbeMatrix));
+		errno = ENOMEM;
+		return -1;
+	}
+	matrix->count = count;
+	matrix->directories = dirs->count;
+
+	for (p = 0; p < count; ++p)
+	{
+		for (relative = relativePaths[p]; *relative == DIR_SEPARATOR_CHAR; ++relative) ;
+		name = strrchr(relative, DIR_SEPARATOR_CHAR);
+		paths[p].parent = relative;
+		paths[p].parentLength = name ? (size_t)(name - relative) : 0;
+		paths[p].name = name ? name + 1 : relative;
+		paths[p].row = p;
+	}
+	qsort(paths, count, sizeof(xdgProbePath), xdgCompareProbePaths);
+	for (p = 1, groups = count ? 1 : 0; p < count; ++p)
+		groups += !xdgIsSameParent(&paths[p-1], &paths[p]);
+
+	xdgStartDeadline(&deadline, dirs);
+	/* Split the paths in shares of about the same size, at changes of parent. */
+	threads = groups / XDG_PROBE_GROUPS_PER_THREAD;
+#ifdef HAVE_PTHREAD
+	threads = threads > XDG_PROBE_MAX_THREADS ? XDG_PROBE_MAX_THREADS : threads ? threads : 1;
+#else
+	threads = 1;
+#endif
+	for (i = 0, p = 0; i < threads; ++i)
+	{
+		jobs[i].dirs = dirs;
+		jobs[i].paths = paths;
+		jobs[i].matrix = matrix;
+		jobs[i].deadline = deadline;
+		jobs[i].error = 0;
+		jobs[i].begin = p;
+		p = i + 1 == threads ? count : MAX(p, (unsigned int)((unsigned long long)count * (i + 1) / threads));
+		while (p > jobs[i].begin && p < count && xdgIsSameParent(&paths[p-1], &paths[p]))
+			++p;
+		jobs[i].end = p;
+	}
+
+#ifdef HAVE_PTHREAD
+	for (i = 1; i < threads; ++i)
+		started[i] = pthread_create(&thread[i], 0, xdgRunProbeJob, &jobs[i]) == 0;
+	xdgRunProbeJob(&jobs[0]);
+	for (i = 1; i < threads; ++i)
+	{
+		if (started[i])
+			pthread_join(thread[i], 0);
+		else
+			xdgRunProbeJob(&jobs[i]);
+	}
+#else
+	xdgRunProbeJob(&jobs[0]);
+#endif
+	free(paths);
+	for (i = 0; i < threads && !error; ++i)
+		error = jobs[i].error;
+	if (error)
+	{
+		xdgFreeProbeMatrix(matrix);
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+int xdgMakePath(const char * path, mode_t mode)
+{
+	int length = strlen(path);
+	char * tmpPath;
+	char * tmpPtr;
+	int ret;
+
+	if (length == 0 || (length == 1 && path[0] == DIR_SEPARATOR_CHAR))
+		return 0;
+
+	if (!(tmpPath = (char*)malloc(length+1)))
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	strcpy(tmpPath, path);
+	if (tmpPath[length-1] == DIR_SEPARATOR_CHAR)
+		tmpPath[length-1] = '\0';
+
+	/* skip tmpPath[0] since if it's a seperator we have an absolute path */
+	for (tmpPtr = tmpPath+1; *tmpPtr; ++tmpPtr)
+	{
+		if (*tmpPtr == DIR_SEPARATOR_CHAR)
+		{
+			*tmpPtr = '\0';
+			if (mkdir(tmpPath, mode) == -1)
+			{
+				if (errno != EEXIST)
+				{
+					free(tmpPath);
+					return -1;
+				}
+			}
+			*tmpPtr = DIR_SEPARATOR_CHAR;
+		}
+	}
+	ret = mkdir(tmpPath, mode);
+	free(tmpPath);
+	return ret;
+}
+
+const char * xdgDataHome(xdgHandle *handle)
+{
+	xdgCachedData* cache;
+	if (handle)
+		return (cache = xdgGetCacheFields(handle, XDG_FIELD_DATA_HOME)) ? cache->dataHome : 0;
+	else
+		return xdgGetRelativeHome(NULL, "XDG_DATA_HOME", DefaultRelativeDataHome, sizeof(DefaultRelativeDataHome)-1);
+}
+
+const char * xdgConfigHome(xdgHandle *handle)
+{
+	xdgCachedData* cache;
+	if (handle)
+		return (cache = xdgGetCacheFields(handle, XDG_FIELD_CONFIG_HOME)) ? cache->configHome : 0;
+	else
+		return xdgGetRelativeHome(NULL, "XDG_CONFIG_HOME", DefaultRelativeConfigHome, sizeof(DefaultRelativeConfigHome)-1);
+}
+
+const char * const * xdgDataDirectories(xdgHandle *handle)
+{
+	xdgCachedData* cache;
+	if (handle)
+		return (cache = xdgGetCacheFields(handle, XDG_FIELD_DATA_DIRECTORIES)) ?
+			(const char * const *)&cache->searchableDataDirectories[1] : 0;
+	else
+		return (const char * const *)xdgGetDirectoryLists(NULL, "XDG_DATA_DIRS", NULL, DefaultDataDirectoriesList);
+}
+
+const char * const * xdgSearchableDataDirectories(xdgHandle *handle)
+{
+	xdgCachedData* cache;
+	if (handle)
+		return (cache = xdgGetCacheFields(handle, XDG_FIELD_DATA_DIRECTORIES)) ?
+			(const char * const *)cache->searchableDataDirectories : 0;
+	else
+	{
+		char *datahome = (char*)xdgDataHome(NULL);
+		char **datadirs = 0;
+		if (datahome && !(datadirs = xdgGetDirectoryLists(NULL, "XDG_DATA_DIRS", datahome, DefaultDataDirectoriesList)))
+			free(datahome);
+		return (const char * const *)datadirs;
+	}
+}
+
+const char * const * xdgConfigDirectories(xdgHandle *handle)
+{
+	xdgCachedData* cache;
+	if (handle)
+		return (cache = xdgGetCacheFields(handle, XDG_FIELD_CONFIG_DIRECTORIES)) ?
+			(const char * const *)&cache->searchableConfigDirectories[1] : 0;
+	else
+		return (const char * const *)xdgGetDirectoryLists(NULL, "XDG_CONFIG_DIRS", NULL, DefaultConfigDirectoriesList);
+}
+
+const char * const * xdgSearchableConfigDirectories(xdgHandle *handle)
+{
+	xdgCachedData* cache;
+	if (handle)
+		return (cache = xdgGetCacheFields(handle, XDG_FIELD_CONFIG_DIRECTORIES)) ?
+			(const char * const *)cache->searchableConfigDirectories : 0;
+	else
+	{
+		char *confighome = (char*)xdgConfigHome(NULL);
+		char **configdirs = 0;
+		if (confighome && !(configdirs = xdgGetDirectoryLists(NULL, "XDG_CONFIG_DIRS", confighome, DefaultConfigDirectoriesList)))
+			free(confighome);
+		return (const char * const *)configdirs;
+	}
+}
+
+const char * xdgCacheHome(xdgHandle *handle)
+{
+	xdgCachedData* cache;
+	if (handle)
+		return (cache = xdgGetCacheFields(handle, XDG_FIELD_CACHE_HOME)) ? cache->cacheHome : 0;
+	else
+		return xdgGetRelativeHome(NULL, "XDG_CACHE_HOME", DefaultRelativeCacheHome, sizeof(DefaultRelativeCacheHome)-1);
+}
+
+const char * xdgRuntimeDirectory(xdgHandle *handle)
+{
+	xdgCachedData* cache;
+	if (handle)
+		return (cache = xdgGetCacheFields(handle, XDG_FIELD_RUNTIME_DIRECTORY)) ? cache->runtimeDirectory : 0;
+	else
+		return xdgEnvDup(NULL, "XDG_RUNTIME_DIRECTORY");
+}
+
+int xdgClassifyPath(const char *path, xdgPathClass *result, xdgHandle *handle)
+{
+	xdgCachedData* cache;
+	xdgPathNode * nodes;
+	xdgHandle temp;
+	unsigned int node = 0, child, slot;
+	size_t length;
+	int base;
+
+	xdgZeroMemory(result, sizeof(xdgPathClass));
+	/* Relative paths depend on the working directory. */
+	if (*path != DIR_SEPARATOR_CHAR)
+		return XDG_BASE_NONE;
+	if (!handle)
+	{
+		if (!xdgInitHandle(&temp))
+			return XDG_BASE_NONE;
+		base = xdgClassifyPath(path, result, &temp);
+		xdgWipeHandle(&temp);
+		return base;
+	}
+	if (!(cache = xdgGetCacheFields(handle, XDG_FIELD_PATH_TRIE)))
+		return XDG_BASE_NONE;
+
+	/* The deepest base directory containing the path wins. */
+	nodes = cache->pathTrie->nodes;
+	if (nodes[0].base != XDG_BASE_NONE)
+	{
+		/* The root directory is a base directory. */
+		result->base = nodes[0].base;
+		result->index = nodes[0].index;
+		result->relativePath = xdgSkipSeparators(path);
+	}
+	for (path = xdgSkipSeparators(path); *path; path = xdgSkipSeparators(path + length))
+	{
+		length = xdgComponentLength(path);
+		if (!(child = xdgFindPathChild(cache->pathTrie, node, path, length, &slot)))
+			break;
+		node = child;
+		if (nodes[node].base != XDG_BASE_NONE)
+		{
+			result->base = nodes[node].base;
+			result->index = nodes[node].index;
+			result->relativePath = xdgSkipSeparators(path + length);
+		}
+	}
+	return result->base;
+}
+
+unsigned long long xdgGetHandleFingerprint(xdgHandle *handle)
+{
+	const char * const * dataDirs;
+	const char * const * configDirs;
+	unsigned long long result = 0;
+	xdgCachedData* cache;
+	if (handle)
+		return (cache = xdgGetCacheFields(handle, XDG_FIELD_DATA_DIRECTORIES | XDG_FIELD_CONFIG_DIRECTORIES)) ?
+			cache->dataFingerprint ^ (cache->configFingerprint * XDG_HASH_INIT) : 0;
+	dataDirs = xdgSearchableDataDirectories(NULL);
+	configDirs = xdgSearchableConfigDirectories(NULL);
+	if (dataDirs && configDirs)
+		result = xdgGetListFingerprint(dataDirs) ^ (xdgGetListFingerprint(configDirs) * XDG_HASH_INIT);
+	if (dataDirs) xdgFreeStringList((char**)dataDirs);
+	if (configDirs) xdgFreeStringList((char**)configDirs);
+	return result;
+}
+
+/** Get the prepared searchable data or config directories.
+ * @param handle Handle to data cache, or @c NULL to read the environment.
+ * @param config Whether to get the config instead of the data directories.
+ * @param temp Storage for the list if handle is @c NULL, which must be
+ * 	freed with free(temp->items) afterwards.
+ * @return The list, or @c NULL if an error occurs.
+ */
+static xdgDirectoryList * xdgGetDirectoryList(xdgHandle *handle, int config, xdgDirectoryList *temp)
+{
+	const char * const * dirs;
+	int ok;
+	xdgCachedData* cache;
+	if (handle)
+	{
+		if (!(cache = xdgGetCacheFields(handle, config ? XDG_FIELD_CONFIG_DIRECTORIES : XDG_FIELD_DATA_DIRECTORIES)))
+			return 0;
+		return config ? &cache->configDirectories : &cache->dataDirectories;
+	}
+	if (!(dirs = config ? xdgSearchableConfigDirectories(NULL) : xdgSearchableDataDirectories(NULL)))
+		return 0;
+	ok = xdgPrepareDirectoryList(dirs, temp, NULL);
+	xdgFreeStringList((char**)dirs);
+	return ok ? temp : 0;
+}
+
+char * xdgDataFind(const char * relativePath, xdgHandle *handle)
+{
+	return xdgDataFindN(relativePath, strlen(relativePath), handle);
+}
+
+char * xdgConfigFind(const char * relativePath, xdgHandle *handle)
+{
+	return xdgConfigFindN(relativePath, strlen(relativePath), handle);
+}
+
+FILE * xdgDataOpen(const char * relativePath, const char * mode, xdgHandle *handle)
+{
+	return xdgDataOpenN(relativePath, strlen(relativePath), mode, handle);
+}
+
+FILE * xdgConfigOpen(const char * relativePath, const char * mode, xdgHandle *handle)
+{
+	return xdgConfigOpenN(relativePath, strlen(relativePath), mode, handle);
 }
 
-const char * xdgDataHome(xdgHandle *handle)
+char * xdgDataFindN(const char * relativePath, size_t length, xdgHandle *handle)
 {
+	xdgDirectoryList temp;
+	xdgDirectoryList * dirs = xdgGetDirectoryList(handle, FALSE, &temp);
+	char * result;
+	xdgProfileRecord(handle, FALSE, relativePath, length);
+	if (!dirs) return 0;
 	if (handle)
-		return xdgGetCache(handle)->dataHome;
-	else
-		return xdgGetRelativeHome("XDG_DATA_HOME", DefaultRelativeDataHome, sizeof(DefaultRelativeDataHome)-1);
+		return xdgFindExisting(relativePath, length, dirs, xdgGetCache(handle)->sharedCache, xdgGetCache(handle)->dataFingerprint);
+	result = xdgFindExisting(relativePath, length, dirs, NULL, 0);
+	free(temp.items);
+	return result;
 }
 
-const char * xdgConfigHome(xdgHandle *handle)
+char * xdgConfigFindN(const char * relativePath, size_t length, xdgHandle *handle)
 {
+	xdgDirectoryList temp;
+	xdgDirectoryList * dirs = xdgGetDirectoryList(handle, TRUE, &temp);
+	char * result;
+	xdgProfileRecord(handle, TRUE, relativePath, length);
+	if (!dirs) return 0;
 	if (handle)
-		return xdgGetCache(handle)->configHome;
-	else
-		return xdgGetRelativeHome("XDG_CONFIG_HOME", DefaultRelativeConfigHome, sizeof(DefaultRelativeConfigHome)-1);
+		return xdgFindExisting(relativePath, length, dirs, xdgGetCache(handle)->sharedCache, xdgGetCache(handle)->configFingerprint);
+	result = xdgFindExisting(relativePath, length, dirs, NULL, 0);
+	free(temp.items);
+	return result;
 }
 
-const char * const * xdgDataDirectories(xdgHandle *handle)
+FILE * xdgDataOpenN(const char * relativePath, size_t length, const char * mode, xdgHandle *handle)
 {
+	xdgDirectoryList temp;
+	xdgDirectoryList * dirs = xdgGetDirectoryList(handle, FALSE, &temp);
+	FILE * result;
+	xdgProfileRecord(handle, FALSE, relativePath, length);
+	if (!dirs) return 0;
 	if (handle)
-		return (const char * const *)&(xdgGetCache(handle)->searchableDataDirectories[1]);
-	else
-		return (const char * const *)xdgGetDirectoryLists("XDG_DATA_DIRS", NULL, DefaultDataDirectoriesList);
+		return xdgFileOpen(relativePath, length, mode, dirs, xdgGetCache(handle)->sharedCache, xdgGetCache(handle)->dataFingerprint);
+	result = xdgFileOpen(relativePath, length, mode, dirs, NULL, 0);
+	free(temp.items);
+	return result;
 }
 
-const char * const * xdgSearchableDataDirectories(xdgHandle *handle)
+FILE * xdgConfigOpenN(const char * relativePath, size_t length, const char * mode, xdgHandle *handle)
 {
+	xdgDirectoryList temp;
+	xdgDirectoryList * dirs = xdgGetDirectoryList(handle, TRUE, &temp);
+	FILE * result;
+	xdgProfileRecord(handle, TRUE, relativePath, length);
+	if (!dirs) return 0;
 	if (handle)
-		return (const char * const *)xdgGetCache(handle)->searchableDataDirectories;
-	else
+		return xdgFileOpen(relativePath, length, mode, dirs, xdgGetCache(handle)->sharedCache, xdgGetCache(handle)->configFingerprint);
+	result = xdgFileOpen(relativePath, length, mode, dirs, NULL, 0);
+	free(temp.items);
+	return result;
+}
+
+int xdgDataReadAll(const char * relativePath, int order, xdgFileSet *files, xdgHandle *handle)
+{
+	xdgDirectoryList temp;
+	xdgDirectoryList * dirs = xdgGetDirectoryList(handle, FALSE, &temp);
+	int result;
+	if (!dirs) return -1;
+	result = xdgReadAllExisting(relativePath, dirs, order, files);
+	if (!handle) free(temp.items);
+	return result;
+}
+
+int xdgConfigReadAll(const char * relativePath, int order, xdgFileSet *files, xdgHandle *handle)
+{
+	xdgDirectoryList temp;
+	xdgDirectoryList * dirs = xdgGetDirectoryList(handle, TRUE, &temp);
+	int result;
+	if (!dirs) return -1;
+	result = xdgReadAllExisting(relativePath, dirs, order, files);
+	if (!handle) free(temp.items);
+	return result;
+}
+
+int xdgDataFingerprint(const char * const * relativePaths, unsigned int count, unsigned long long *fingerprint, xdgHandle *handle)
+{
+	xdgDirectoryList temp;
+	xdgDirectoryList * dirs = xdgGetDirectoryList(handle, FALSE, &temp);
+	int result;
+	if (!dirs) return -1;
+	result = xdgFingerprintExisting(relativePaths, count, dirs, fingerprint);
+	if (!handle) free(temp.items);
+	return result;
+}
+
+int xdgConfigFingerprint(const char * const * relativePaths, unsigned int count, unsigned long long *fingerprint, xdgHandle *handle)
+{
+	xdgDirectoryList temp;
+	xdgDirectoryList * dirs = xdgGetDirectoryList(handle, TRUE, &temp);
+	int result;
+	if (!dirs) return -1;
+	result = xdgFingerprintExisting(relativePaths, count, dirs, fingerprint);
+	if (!handle) free(temp.items);
+	return result;
+}
+
+int xdgDataProbeMatrix(const char * const * relativePaths, unsigned int count, xdgProbeMatrix *matrix, xdgHandle *handle)
+{
+	xdgDirectoryList temp;
+	xdgDirectoryList * dirs = xdgGetDirectoryList(handle, FALSE, &temp);
+	int result;
+	if (!dirs) return -1;
+	result = xdgProbeMatrixExisting(relativePaths, count, dirs, matrix);
+	if (!handle) free(temp.items);
+	return result;
+}
+
+int xdgConfigProbeMatrix(const char * const * relativePaths, unsigned int count, xdgProbeMatrix *matrix, xdgHandle *handle)
+{
+	xdgDirectoryList temp;
+	xdgDirectoryList * dirs = xdgGetDirectoryList(handle, TRUE, &temp);
+	int result;
+	if (!dirs) return -1;
+	result = xdgProbeMatrixExisting(relativePaths, count, dirs, matrix);
+	if (!handle) free(temp.items);
+	return result;
+}
+
+int xdgOpenEach(const char *relativePath, int config, xdgOpenEachCallback callback, void *userData,
+	xdgHandle *handle)
+{
+	xdgDirectoryList temp;
+	xdgDirectoryList * dirs = xdgGetDirectoryList(handle, config, &temp);
+	int result;
+	if (!dirs) return -1;
+	result = xdgOpenEachExisting(relativePath, dirs, callback, userData);
+	if (!handle) free(temp.items);
+	return result;
+}
+
+void xdgFreeProbeMatrix(xdgProbeMatrix *matrix)
+{
+	free(matrix->bits);
+	xdgZeroMemory(matrix, sizeof(xdgProbeMatrix));
+}
+
+void xdgFreeFileSet(xdgFileSet *files)
+{
+	/* The extent table and the buffer share a single allocation. */
+	free(files->files);
+	xdgZeroMemory(files, sizeof(xdgFileSet));
+}
+
+/** Maximum length of the suffix appended by xdgCreateTempFile(), including the null byte. */
+#define XDG_TEMP_SUFFIX_MAX 48
+
+/** Write of a batch which is waiting for xdgCommitWriteBatch(). */
+typedef struct _xdgPendingWrite
+{
+	char * path;
+	char * tempPath;
+	dev_t device;
+	/** Shared resolution cache to invalidate once renamed, or @c NULL. */
+	xdgSharedCache * shared;
+} xdgPendingWrite;
+
+/** Data associated with an xdgWriteBatch handle. */
+typedef struct _xdgWriteBatchData
+{
+	xdgPendingWrite * writes;
+	unsigned int count;
+	unsigned int capacity;
+} xdgWriteBatchData;
+
+/** Exclusively create a new temporary file in the directory of path.
+  * @param path Final path of the file.
+  * @param tempPath Buffer of at least <tt>strlen(path)+XDG_TEMP_SUFFIX_MAX</tt> bytes
+  * 	receiving the name of the temporary file.
+  * @return File descriptor open for writing, or -1 if an error occurs.
+  */
+static int xdgCreateTempFile(const char * path, char * tempPath)
+{
+	static unsigned int counter = 0;
+	unsigned int attempt, n;
+	int fd = -1;
+
+	for (attempt = 0; attempt < 100; ++attempt)
 	{
-		char *datahome = (char*)xdgDataHome(NULL);
-		char **datadirs = 0;
-		if (datahome && !(datadirs = xdgGetDirectoryLists("XDG_DATA_DIRS", datahome, DefaultDataDirectoriesList)))
-			free(datahome);
-		return (const char * const *)datadirs;
+		/* Threads writing the same file at once must not pick the same name. */
+#if defined(__GNUC__)
+		n = __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+#else
+		n = counter++;
+#endif
+		sprintf(tempPath, "%s.%lu.%u.tmp", path, (unsigned long)getpid(), n);
+		fd = open(tempPath, O_WRONLY | O_CREAT | O_EXCL | XDG_O_CLOEXEC, 0666);
+		if (fd != -1 || errno != EEXIST)
+			break;
 	}
+	return fd;
 }
 
-const char * const * xdgConfigDirectories(xdgHandle *handle)
+/** Sync the directory containing path with fsync().
+  * @param path Path whose last component is stripped, modified temporarily.
+  */
+static int xdgSyncParentDirectory(char * path)
 {
-	if (handle)
-		return (const char * const *)&(xdgGetCache(handle)->searchableConfigDirectories[1]);
-	else
-		return (const char * const *)xdgGetDirectoryLists("XDG_CONFIG_DIRS", NULL, DefaultConfigDirectoriesList);
+	char * sep = strrchr(path, DIR_SEPARATOR_CHAR);
+	int fd, ret = -1;
+
+	if (!sep) return 0;
+	*sep = 0;
+	fd = open(sep == path ? DIR_SEPARATOR_STR : path, O_RDONLY | XDG_O_CLOEXEC);
+	*sep = DIR_SEPARATOR_CHAR;
+	if (fd == -1) return -1;
+	ret = fsync(fd);
+	close(fd);
+	return ret;
 }
 
-const char * const * xdgSearchableConfigDirectories(xdgHandle *handle)
+/** Sync the writes of a batch to disk.
+  * If syncfs() is available, one call is issued per filesystem. Otherwise
+  * each temporary file, or each directory containing a final path, is synced.
+  * @param data Batch whose writes should be synced.
+  * @param renamed Whether the temporary files have already been renamed.
+  */
+static int xdgSyncPendingWrites(xdgWriteBatchData *data, int renamed)
 {
-	if (handle)
-		return (const char * const *)xdgGetCache(handle)->searchableConfigDirectories;
-	else
+	unsigned int i, j;
+	int fd, ret;
+
+	for (i = 0; i < data->count; ++i)
 	{
-		char *confighome = (char*)xdgConfigHome(NULL);
-		char **configdirs = 0;
-		if (confighome && !(configdirs = xdgGetDirectoryLists("XDG_CONFIG_DIRS", confighome, DefaultConfigDirectoriesList)))
-			free(confighome);
-		return (const char * const *)configdirs;
+#ifdef HAVE_SYNCFS
+		for (j = 0; j < i && data->writes[j].device != data->writes[i].device; ++j) ;
+		if (j < i) continue;
+		if ((fd = open(renamed ? data->writes[i].path : data->writes[i].tempPath, O_RDONLY | XDG_O_CLOEXEC)) == -1)
+			return -1;
+		ret = syncfs(fd);
+		close(fd);
+#else
+		(void)j;
+		if (renamed)
+			ret = xdgSyncParentDirectory(data->writes[i].path);
+		else if ((fd = open(data->writes[i].tempPath, O_RDONLY | XDG_O_CLOEXEC)) == -1)
+			return -1;
+		else
+		{
+			ret = fsync(fd);
+			close(fd);
+		}
+#endif
+		if (ret == -1) return -1;
 	}
+	return 0;
 }
 
-const char * xdgCacheHome(xdgHandle *handle)
+/** Atomically replace a file relative to a home directory.
+  * @param home Home directory of the file, may be @c NULL if it could not be determined.
+  * @param relativePath Path of the file relative to home.
+  * @param data Contents to write.
+  * @param size Number of bytes in data.
+  * @param batch Batch to add the write to, or @c NULL.
+  * @param shared Shared resolution cache to invalidate once the file is
+  * 	replaced, or @c NULL.
+  * @return Zero on success, -1 if an error occured (in which case errno will be set).
+  */
+static int xdgWriteAtomic(const char * home, const char * relativePath, const void * data, size_t size, xdgWriteBatch *batch,
+	xdgSharedCache * shared)
 {
-	if (handle)
-		return xdgGetCache(handle)->cacheHome;
-	else
-		return xdgGetRelativeHome("XDG_CACHE_HOME", DefaultRelativeCacheHome, sizeof(DefaultRelativeCacheHome)-1);
+	xdgWriteBatchData * batchData = batch ? (xdgWriteBatchData*)batch->reserved : 0;
+	xdgPendingWrite * writes;
+	char * path;
+	char * tempPath = 0;
+	char * resolved;
+	char * sep;
+	size_t homelen, rellen, done;
+	ssize_t got;
+	struct stat st, target;
+	int fd, err, exists;
+
+	if (!home) return -1;
+	homelen = strlen(home);
+	rellen = strlen(relativePath);
+	if (!(path = (char*)malloc(homelen+rellen+2)))
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(path, home, homelen);
+	if (homelen == 0 || path[homelen-1] != DIR_SEPARATOR_CHAR)
+		path[homelen++] = DIR_SEPARATOR_CHAR;
+	memcpy(path+homelen, relativePath, rellen+1);
+
+	/* A symbolic link is followed, so that the file it points to is replaced
+	 * instead of the link, which only happens to a dangling link. */
+	if ((exists = lstat(path, &target) == 0) && S_ISLNK(target.st_mode))
+	{
+		if ((resolved = realpath(path, NULL)))
+		{
+			free(path);
+			path = resolved;
+			exists = stat(path, &target) == 0;
+		}
+		else
+			exists = FALSE;
+	}
+	if (!(tempPath = (char*)malloc(strlen(path)+XDG_TEMP_SUFFIX_MAX)))
+	{
+		errno = ENOMEM;
+		goto fail;
+	}
+
+	if ((fd = xdgCreateTempFile(path, tempPath)) == -1 && errno == ENOENT)
+	{
+		/* Only try creating the parents when they are actually missing,
+		 * using the permissions required by the specification. */
+		sep = strrchr(path, DIR_SEPARATOR_CHAR);
+		*sep = 0;
+		if (xdgMakePath(path, 0700) == -1 && errno != EEXIST)
+			goto fail;
+		*sep = DIR_SEPARATOR_CHAR;
+		fd = xdgCreateTempFile(path, tempPath);
+	}
+	if (fd == -1) goto fail;
+	/* The replacement keeps the permissions of the file it replaces. */
+	if (exists && fchmod(fd, target.st_mode & 07777) == -1)
+		goto failfd;
+
+	for (done = 0; done < size; done += got)
+	{
+		if ((got = write(fd, (const char*)data+done, size-done)) == -1)
+		{
+			if (errno == EINTR) { got = 0; continue; }
+			goto failfd;
+		}
+	}
+	if (batchData ? fstat(fd, &st) == -1 : fsync(fd) == -1)
+		goto failfd;
+	if (close(fd) == -1)
+		goto failtemp;
+
+	if (batchData)
+	{
+		if (batchData->count == batchData->capacity)
+		{
+			if (!(writes = (xdgPendingWrite*)realloc(batchData->writes,
+					sizeof(xdgPendingWrite)*(batchData->capacity ? batchData->capacity*2 : 16))))
+			{
+				errno = ENOMEM;
+				goto failtemp;
+			}
+			batchData->writes = writes;
+			batchData->capacity = batchData->capacity ? batchData->capacity*2 : 16;
+		}
+		batchData->writes[batchData->count].path = path;
+		batchData->writes[batchData->count].tempPath = tempPath;
+		batchData->writes[batchData->count].device = st.st_dev;
+		batchData->writes[batchData->count].shared = shared ? xdgSharedCacheRetain(shared) : 0;
+		batchData->count++;
+		return 0;
+	}
+
+	if (rename(tempPath, path) == -1 || xdgSyncParentDirectory(path) == -1)
+		goto failtemp;
+	if (shared)
+		xdgSharedCacheInvalidate(shared);
+	free(path);
+	free(tempPath);
+	return 0;
+
+failfd:
+	err = errno;
+	close(fd);
+	errno = err;
+failtemp:
+	err = errno;
+	unlink(tempPath);
+	errno = err;
+fail:
+	free(path);
+	free(tempPath);
+	return -1;
 }
 
-const char * xdgRuntimeDirectory(xdgHandle *handle)
+xdgWriteBatch * xdgInitWriteBatch(xdgWriteBatch *batch)
 {
-	if (handle)
-		return xdgGetCache(handle)->runtimeDirectory;
-	else
-		return xdgEnvDup("XDG_RUNTIME_DIRECTORY");
+	xdgWriteBatchData *data;
+	if (!batch) return 0;
+	if (!(data = (xdgWriteBatchData*)malloc(sizeof(xdgWriteBatchData)))) return 0;
+	xdgZeroMemory(data, sizeof(xdgWriteBatchData));
+	batch->reserved = data;
+	return batch;
 }
 
-char * xdgDataFind(const char * relativePath, xdgHandle *handle)
+void xdgWipeWriteBatch(xdgWriteBatch *batch)
 {
-	const char * const * dirs = xdgSearchableDataDirectories(handle);
-	char * result = xdgFindExisting(relativePath, dirs);
-	if (!handle) xdgFreeStringList((char**)dirs);
+	xdgWriteBatchData *data = (xdgWriteBatchData*)batch->reserved;
+	unsigned int i;
+	for (i = 0; i < data->count; ++i)
+	{
+		if (data->writes[i].tempPath)
+		{
+			unlink(data->writes[i].tempPath);
+			free(data->writes[i].tempPath);
+		}
+		free(data->writes[i].path);
+		if (data->writes[i].shared)
+			xdgSharedCacheUnmap(data->writes[i].shared);
+	}
+	free(data->writes);
+	free(data);
+	batch->reserved = 0;
+}
+
+int xdgCommitWriteBatch(xdgWriteBatch *batch)
+{
+	xdgWriteBatchData *data = (xdgWriteBatchData*)batch->reserved;
+	unsigned int i;
+	int ret, err;
+
+	/* The contents of all files must be durable before any of them replaces
+	 * the old file, and the renames must be durable before returning. */
+	ret = xdgSyncPendingWrites(data, FALSE);
+	for (i = 0; ret == 0 && i < data->count; ++i)
+	{
+		if (rename(data->writes[i].tempPath, data->writes[i].path) == -1)
+			ret = -1;
+		else
+		{
+			free(data->writes[i].tempPath);
+			data->writes[i].tempPath = 0;
+			if (data->writes[i].shared)
+				xdgSharedCacheInvalidate(data->writes[i].shared);
+		}
+	}
+	if (ret == 0)
+		ret = xdgSyncPendingWrites(data, TRUE);
+
+	err = errno;
+	xdgWipeWriteBatch(batch);
+	errno = err;
+	return ret;
+}
+
+int xdgDataWriteAtomic(const char * relativePath, const void * data, size_t size, xdgWriteBatch *batch, xdgHandle *handle)
+{
+	const char * home = xdgDataHome(handle);
+	int result = xdgWriteAtomic(home, relativePath, data, size, batch, handle ? xdgGetCache(handle)->sharedCache : 0);
+	if (!handle) free((char*)home);
 	return result;
 }
 
-char * xdgConfigFind(const char * relativePath, xdgHandle *handle)
+int xdgConfigWriteAtomic(const char * relativePath, const void * data, size_t size, xdgWriteBatch *batch, xdgHandle *handle)
 {
-	const char * const * dirs = xdgSearchableConfigDirectories(handle);
-	char * result = xdgFindExisting(relativePath, dirs);
-	if (!handle) xdgFreeStringList((char**)dirs);
+	const char * home = xdgConfigHome(handle);
+	int result = xdgWriteAtomic(home, relativePath, data, size, batch, handle ? xdgGetCache(handle)->sharedCache : 0);
+	if (!handle) free((char*)home);
 	return result;
 }
 
-FILE * xdgDataOpen(const char * relativePath, const char * mode, xdgHandle *handle)
+int xdgCacheWriteAtomic(const char * relativePath, const void * data, size_t size, xdgWriteBatch *batch, xdgHandle *handle)
 {
-	const char * const * dirs = xdgSearchableDataDirectories(handle);
-	FILE * result = xdgFileOpen(relativePath, mode, dirs);
-	if (!handle) xdgFreeStringList((char**)dirs);
+	const char * home = xdgCacheHome(handle);
+	int result = xdgWriteAtomic(home, relativePath, data, size, batch, handle ? xdgGetCache(handle)->sharedCache : 0);
+	if (!handle) free((char*)home);
 	return result;
 }
 
-FILE * xdgConfigOpen(const char * relativePath, const char * mode, xdgHandle *handle)
+int xdgAttachSharedCache(xdgHandle *handle, int fd, unsigned int ttl)
+{
+	xdgCachedData* cache = xdgGetCacheFields(handle, XDG_FIELD_RUNTIME_DIRECTORY);
+	xdgSharedCache* shared;
+	if (!cache) return -1;
+	if (!(shared = xdgSharedCacheMap(fd, cache->runtimeDirectory, ttl ? ttl : XDG_SHARED_DEFAULT_TTL)))
+		return -1;
+	if (cache->sharedCache)
+		xdgSharedCacheUnmap(cache->sharedCache);
+	cache->sharedCache = shared;
+	return 0;
+}
+
+int xdgSetLookupDeadline(xdgHandle *handle, unsigned int milliseconds)
+{
+#if defined(HAVE_PTHREAD) && defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	xdgCachedData* cache = xdgGetCache(handle);
+	unsigned int ready;
+	pthread_mutex_lock(&cache->mutex);
+	cache->deadline = milliseconds;
+	/* Lists of lazy handles which are not computed yet are classified when they are. */
+	ready = cache->ready;
+	if (((ready & XDG_FIELD_DATA_DIRECTORIES) && !xdgClassifyDirectories(&cache->dataDirectories, milliseconds)) ||
+		((ready & XDG_FIELD_CONFIG_DIRECTORIES) && !xdgClassifyDirectories(&cache->configDirectories, milliseconds)))
+	{
+		pthread_mutex_unlock(&cache->mutex);
+		errno = ENOMEM;
+		return -1;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/** Cache the listing of a subdirectory of the data or config directories.
+ * @param relativeDirectory Relative path of the subdirectory.
+ * @param handle Handle to data cache.
+ * @param config Whether to list in the config instead of the data directories.
+ * @return Zero on success, -1 if an error occured (in which case errno will be set).
+ */
+static int xdgCacheListing(const char * relativeDirectory, xdgHandle *handle, int config)
+{
+	xdgCachedData* cache;
+	xdgListing ** link;
+	xdgListing * listing, * existing;
+	size_t length;
+
+	if (!handle)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	cache = xdgGetCache(handle);
+	while (*relativeDirectory == DIR_SEPARATOR_CHAR) ++relativeDirectory;
+	for (length = strlen(relativeDirectory); length && relativeDirectory[length-1] == DIR_SEPARATOR_CHAR; --length) ;
+	if (!length)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (!(listing = (xdgListing*)malloc(sizeof(xdgListing) + length + 2)))
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	xdgZeroMemory(listing, sizeof(xdgListing));
+	listing->relative = (char*)(listing + 1);
+	memcpy(listing->relative, relativeDirectory, length);
+	listing->relative[length++] = DIR_SEPARATOR_CHAR;
+	listing->relative[length] = 0;
+	listing->length = length;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_init(&listing->mutex, 0);
+	pthread_mutex_lock(&cache->mutex);
+#endif
+	/* Deeper subdirectories come first, so that lookups use the closest listing. */
+	for (link = config ? &cache->configListings : &cache->dataListings; *link && (*link)->length > length;
+		link = &(*link)->next) ;
+	for (existing = *link; existing && existing->length == length; existing = existing->next)
+		if (strcmp(existing->relative, listing->relative) == 0)
+			break;
+	if (existing && existing->length == length)
+		xdgFreeListings(listing);
+	else
+	{
+		listing->next = *link;
+		*link = listing;
+	}
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&cache->mutex);
+#endif
+	return 0;
+}
+
+int xdgDataCacheListing(const char * relativeDirectory, xdgHandle *handle)
+{
+	return xdgCacheListing(relativeDirectory, handle, FALSE);
+}
+
+int xdgConfigCacheListing(const char * relativeDirectory, xdgHandle *handle)
+{
+	return xdgCacheListing(relativeDirectory, handle, TRUE);
+}
+
+int xdgCreateSharedCache(void)
+{
+#ifdef HAVE_MEMFD_CREATE
+	return memfd_create("libxdg-basedir-resolve", 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+void xdgInvalidateSharedCache(xdgHandle *handle)
+{
+	xdgCachedData* cache = xdgGetCache(handle);
+	if (cache->sharedCache)
+		xdgSharedCacheInvalidate(cache->sharedCache);
+}
+
+#ifdef HAVE_PTHREAD
+
+/** Background lookup started by xdgDataPrefetch() or xdgConfigPrefetch().
+ * The job owns copies of everything it uses, so that the handle can be
+ * updated or wiped while it runs. */
+typedef struct _xdgPrefetchJob
+{
+	xdgDirectoryList dirs;
+	char ** paths;
+	unsigned int count;
+	xdgSharedCache * sharedCache;
+	unsigned long long fingerprint;
+} xdgPrefetchJob;
+
+static void xdgFreePrefetchJob(xdgPrefetchJob *job)
+{
+	if (job->sharedCache)
+		xdgSharedCacheUnmap(job->sharedCache);
+	free(job->dirs.items);
+	free(job);
+}
+
+/** Resolve every path of a prefetch job and ask the kernel to read ahead the winning files. */
+static void * xdgPrefetchThread(void *arg)
+{
+	xdgPrefetchJob * job = (xdgPrefetchJob*)arg;
+	unsigned long long mask = job->sharedCache ? xdgGetSharedMask(&job->dirs) : 0, generation = 0;
+	xdgPathBuffer path;
+	struct stat st;
+	unsigned int p, i;
+	int fd = -1, store;
+
+	for (p = 0; p < job->count; ++p)
+	{
+		if (!xdgInitPathBuffer(&path, &job->dirs, job->paths[p], strlen(job->paths[p])))
+			continue;
+		store = mask && xdgWatchSharedParents(job->sharedCache, &job->dirs, &path, NULL) != -1;
+		if (store)
+			generation = xdgSharedCacheGeneration(job->sharedCache);
+		for (i = 0; i < job->dirs.count; ++i)
+		{
+			/* O_NONBLOCK so that a FIFO does not block the thread. */
+			if ((fd = xdgOpenInDirectory(&job->dirs, i, &path, O_RDONLY | O_NONBLOCK | XDG_O_CLOEXEC, NULL)) != -1)
+				break;
+		}
+		if (fd != -1)
+		{
+			if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+			{
+#if defined(HAVE_POSIX_FADVISE)
+				posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#elif defined(HAVE_READAHEAD)
+				readahead(fd, 0, st.st_size);
+#endif
+			}
+			close(fd);
+			fd = -1;
+			if (store)
+				xdgSharedCacheStore(job->sharedCache, job->fingerprint, generation,
+					path.relative, path.relativeLength, (2ull << i) - 1, 1ull << i);
+		}
+		else if (store)
+			xdgSharedCacheStore(job->sharedCache, job->fingerprint, generation,
+				path.relative, path.relativeLength, mask, 0);
+		xdgFreePathBuffer(&path);
+	}
+	xdgFreePrefetchJob(job);
+	return 0;
+}
+
+#endif
+
+/** Start resolving relative paths in the background.
+ * @param relativePaths Paths to resolve.
+ * @param count Number of paths.
+ * @param handle Handle to data cache, or @c NULL to read the environment.
+ * @param config Whether to resolve in the config instead of the data directories.
+ * @return Zero on success, -1 if an error occured (in which case errno will be set).
+ */
+static int xdgPrefetch(const char * const * relativePaths, unsigned int count, xdgHandle *handle, int config)
 {
-	const char * const * dirs = xdgSearchableConfigDirectories(handle);
-	FILE * result = xdgFileOpen(relativePath, mode, dirs);
+#ifdef HAVE_PTHREAD
+	xdgPrefetchJob * job;
+	const char * const * dirs;
+	pthread_attr_t attr;
+	pthread_t thread;
+	size_t size = sizeof(xdgPrefetchJob) + sizeof(char*)*count;
+	unsigned int i;
+	char * strings;
+	int ok, err;
+
+	for (i = 0; i < count; ++i)
+		size += strlen(relativePaths[i]) + 1;
+	if (!(job = (xdgPrefetchJob*)malloc(size)))
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	xdgZeroMemory(job, sizeof(xdgPrefetchJob));
+	job->paths = (char**)(job + 1);
+	job->count = count;
+	strings = (char*)(job->paths + count);
+	for (i = 0; i < count; ++i)
+	{
+		job->paths[i] = strings;
+		strcpy(strings, relativePaths[i]);
+		strings += strlen(strings) + 1;
+	}
+
+	if (handle)
+	{
+		dirs = config ? xdgSearchableConfigDirectories(handle) : xdgSearchableDataDirectories(handle);
+		if (xdgGetCache(handle)->sharedCache)
+		{
+			job->sharedCache = xdgSharedCacheRetain(xdgGetCache(handle)->sharedCache);
+			job->fingerprint = config ? xdgGetCache(handle)->configFingerprint : xdgGetCache(handle)->dataFingerprint;
+		}
+	}
+	else
+		dirs = config ? xdgSearchableConfigDirectories(NULL) : xdgSearchableDataDirectories(NULL);
+	ok = dirs && xdgPrepareDirectoryList(dirs, &job->dirs, NULL);
 	if (!handle) xdgFreeStringList((char**)dirs);
-	return result;
+	if (!ok)
+	{
+		xdgFreePrefetchJob(job);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	err = pthread_create(&thread, &attr, xdgPrefetchThread, job);
+	pthread_attr_destroy(&attr);
+	if (err)
+	{
+		xdgFreePrefetchJob(job);
+		errno = err;
+		return -1;
+	}
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+int xdgDataPrefetch(const char * const * relativePaths, unsigned int count, xdgHandle *handle)
+{
+	return xdgPrefetch(relativePaths, count, handle, FALSE);
+}
+
+int xdgConfigPrefetch(const char * const * relativePaths, unsigned int count, xdgHandle *handle)
+{
+	return xdgPrefetch(relativePaths, count, handle, TRUE);
 }
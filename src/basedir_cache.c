@@ -0,0 +1,659 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file basedir_cache.c
+  * @brief Size-bounded key/value store inside the XDG cache directory. */
+
+#if defined(HAVE_CONFIG_H) || defined(_DOXYGEN)
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#ifdef O_CLOEXEC
+#  define XDG_O_CLOEXEC O_CLOEXEC
+#else
+#  define XDG_O_CLOEXEC 0
+#endif
+
+#include <basedir.h>
+#include <basedir_fs.h>
+#include <basedir_cache.h>
+#include "basedir_private.h"
+
+/** Magic number at the start of the index, the journal records and every value file. */
+#define XDG_CACHE_MAGIC 0x31534358u /* "XCS1" */
+/** Number of values evicted at most by a single xdgCacheStorePut(). */
+#define XDG_CACHE_EVICT_STEP 8
+/** Number of values sampled to find the least recently used one. */
+#define XDG_CACHE_EVICT_SAMPLES 5
+/** Length of the path of a value relative to the store root: "/xx/" + 16 hex digits. */
+#define XDG_CACHE_ENTRY_PATH_LENGTH 20
+/** Maximum length of a temporary file suffix. */
+#define XDG_CACHE_TEMP_SUFFIX_MAX 32
+
+/** Journal operations. */
+enum { XDG_CACHE_PUT = 1, XDG_CACHE_REMOVE = 2, XDG_CACHE_ACCESS = 3 };
+
+/** Index entry of a single value. A hash of 0 marks an empty slot. */
+typedef struct _xdgCacheEntry
+{
+	unsigned long long hash;
+	unsigned long long size;
+	long long atime;
+} xdgCacheEntry;
+
+/** Header of the index file. */
+typedef struct _xdgCacheIndexHeader
+{
+	unsigned int magic;
+	unsigned int entrySize;
+	unsigned long long count;
+} xdgCacheIndexHeader;
+
+/** Record appended to the journal for every change since the last flush. */
+typedef struct _xdgCacheJournalRecord
+{
+	unsigned int magic;
+	unsigned int operation;
+	xdgCacheEntry entry;
+} xdgCacheJournalRecord;
+
+/** Header of every value file, followed by the key and the value. */
+typedef struct _xdgCacheValueHeader
+{
+	unsigned int magic;
+	unsigned int keySize;
+} xdgCacheValueHeader;
+
+/** Data associated with an xdgCacheStore handle. */
+typedef struct _xdgCacheStoreData
+{
+	/** Store root followed by space for a value path; see xdgCacheEntryPath(). */
+	char * path;
+	size_t rootLength;
+	/** Open-addressing hash table of all values, capacity is a power of two. */
+	xdgCacheEntry * entries;
+	unsigned int capacity;
+	unsigned int count;
+	unsigned long long total;
+	unsigned long long budget;
+	long long maxAge;
+	int journal;
+	unsigned long long random;
+} xdgCacheStoreData;
+
+static xdgCacheStoreData* xdgGetCacheStore(xdgCacheStore *store)
+{
+	return ((xdgCacheStoreData*)(store->reserved));
+}
+
+/** Hash a key. Zero is reserved for empty slots. */
+static unsigned long long xdgCacheKeyHash(const void *key, size_t keySize)
+{
+	unsigned long long hash = xdgHashBytes(XDG_HASH_INIT, key, keySize);
+	return hash ? hash : 1;
+}
+
+/** Append the relative path of a value to the store root.
+  * @param suffix Optional suffix to append after the file name, or NULL.
+  * @return The full path, which stays valid until the next call. */
+static const char * xdgCacheEntryPath(xdgCacheStoreData *data, unsigned long long hash, const char *suffix)
+{
+	sprintf(data->path + data->rootLength, "/%02x/%016llx%s",
+		(unsigned int)(hash >> 56), hash, suffix ? suffix : "");
+	return data->path;
+}
+
+/** Find the slot of a hash, or the empty slot where it would be inserted. */
+static unsigned int xdgCacheFindSlot(xdgCacheStoreData *data, unsigned long long hash)
+{
+	unsigned int mask = data->capacity - 1;
+	unsigned int i = (unsigned int)hash & mask;
+	while (data->entries[i].hash && data->entries[i].hash != hash)
+		i = (i + 1) & mask;
+	return i;
+}
+
+/** Add or replace an index entry, keeping xdgCacheStoreData::total up to date. */
+static int xdgCacheSetEntry(xdgCacheStoreData *data, const xdgCacheEntry *entry)
+{
+	xdgCacheEntry *old, *slot;
+	unsigned int i, oldCapacity;
+
+	if ((data->count + 1) * 10 > data->capacity * 7)
+	{
+		old = data->entries;
+		oldCapacity = data->capacity;
+		if (!(data->entries = (xdgCacheEntry*)calloc(oldCapacity * 2, sizeof(xdgCacheEntry))))
+		{
+			data->entries = old;
+			errno = ENOMEM;
+			return -1;
+		}
+		data->capacity = oldCapacity * 2;
+		for (i = 0; i < oldCapacity; ++i)
+			if (old[i].hash)
+				data->entries[xdgCacheFindSlot(data, old[i].hash)] = old[i];
+		free(old);
+	}
+
+	slot = &data->entries[xdgCacheFindSlot(data, entry->hash)];
+	if (slot->hash)
+		data->total -= slot->size;
+	else
+		data->count++;
+	*slot = *entry;
+	data->total += entry->size;
+	return 0;
+}
+
+/** Remove the index entry in a slot, shifting back following entries of the same run. */
+static void xdgCacheRemoveSlot(xdgCacheStoreData *data, unsigned int i)
+{
+	unsigned int mask = data->capacity - 1;
+	unsigned int j = i, k;
+
+	data->total -= data->entries[i].size;
+	data->count--;
+	for (;;)
+	{
+		j = (j + 1) & mask;
+		if (!data->entries[j].hash)
+			break;
+		k = (unsigned int)data->entries[j].hash & mask;
+		/* Move the entry back unless its home slot lies cyclically in (i, j]. */
+		if (i <= j ? (k <= i || k > j) : (k <= i && k > j))
+		{
+			data->entries[i] = data->entries[j];
+			i = j;
+		}
+	}
+	data->entries[i].hash = 0;
+}
+
+/** Append a change to the journal. Failures only lose the change on a crash. */
+static void xdgCacheJournal(xdgCacheStoreData *data, unsigned int operation, const xdgCacheEntry *entry)
+{
+	xdgCacheJournalRecord record;
+	if (data->journal == -1) return;
+	memset(&record, 0, sizeof(record));
+	record.magic = XDG_CACHE_MAGIC;
+	record.operation = operation;
+	record.entry = *entry;
+	if (write(data->journal, &record, sizeof(record)) != sizeof(record))
+		return;
+}
+
+/** Read exactly size bytes, returning 0 on success or -1 on error or end-of-file. */
+static int xdgCacheReadFull(int fd, void *buffer, size_t size)
+{
+	size_t done;
+	ssize_t got;
+	for (done = 0; done < size; done += got)
+	{
+		if ((got = read(fd, (char*)buffer + done, size - done)) == -1 && errno == EINTR)
+			got = 0;
+		else if (got <= 0)
+			return -1;
+	}
+	return 0;
+}
+
+/** Load the index file and replay the journal.
+  * @return Zero on success, -1 if the index is missing or corrupt. */
+static int xdgCacheLoadIndex(xdgCacheStoreData *data)
+{
+	xdgCacheIndexHeader header;
+	xdgCacheJournalRecord record;
+	xdgCacheEntry entry;
+	unsigned long long i;
+	int fd;
+
+	strcpy(data->path + data->rootLength, "/index");
+	if ((fd = open(data->path, O_RDONLY | XDG_O_CLOEXEC)) == -1)
+		return -1;
+	if (xdgCacheReadFull(fd, &header, sizeof(header)) == -1 ||
+		header.magic != XDG_CACHE_MAGIC || header.entrySize != sizeof(xdgCacheEntry))
+	{
+		close(fd);
+		return -1;
+	}
+	for (i = 0; i < header.count; ++i)
+	{
+		if (xdgCacheReadFull(fd, &entry, sizeof(entry)) == -1 || !entry.hash ||
+			xdgCacheSetEntry(data, &entry) == -1)
+		{
+			close(fd);
+			return -1;
+		}
+	}
+	close(fd);
+
+	lseek(data->journal, 0, SEEK_SET);
+	while (xdgCacheReadFull(data->journal, &record, sizeof(record)) == 0 && record.magic == XDG_CACHE_MAGIC)
+	{
+		if (record.operation == XDG_CACHE_PUT)
+		{
+			if (xdgCacheSetEntry(data, &record.entry) == -1)
+				return -1;
+		}
+		else if (!data->entries[i = xdgCacheFindSlot(data, record.entry.hash)].hash)
+			continue;
+		else if (record.operation == XDG_CACHE_ACCESS)
+			data->entries[i].atime = record.entry.atime;
+		else
+			xdgCacheRemoveSlot(data, (unsigned int)i);
+	}
+	return 0;
+}
+
+/** Rebuild the index by scanning all shard directories. */
+static int xdgCacheScan(xdgCacheStoreData *data)
+{
+	DIR *dir;
+	struct dirent *dirent;
+	struct stat st;
+	xdgCacheEntry entry;
+	unsigned int shard;
+	char *end;
+	int ok;
+
+	for (shard = 0; shard < 256; ++shard)
+	{
+		sprintf(data->path + data->rootLength, "/%02x", shard);
+		if (!(dir = opendir(data->path)))
+			continue;
+		while ((dirent = readdir(dir)))
+		{
+			if (strlen(dirent->d_name) != 16)
+				continue;
+			entry.hash = strtoull(dirent->d_name, &end, 16);
+			if (*end || !entry.hash || (unsigned int)(entry.hash >> 56) != shard)
+				continue;
+			ok = stat(xdgCacheEntryPath(data, entry.hash, NULL), &st) == 0 && S_ISREG(st.st_mode);
+			/* xdgCacheEntryPath() overwrote the shard name. */
+			data->path[data->rootLength + 3] = 0;
+			if (!ok)
+				continue;
+			entry.size = st.st_size;
+			/* Values are mapped when they are used, which updates their
+			 * access time unless the filesystem is mounted noatime. */
+			entry.atime = st.st_atime > st.st_mtime ? st.st_atime : st.st_mtime;
+			if (xdgCacheSetEntry(data, &entry) == -1)
+			{
+				closedir(dir);
+				return -1;
+			}
+		}
+		closedir(dir);
+	}
+	return 0;
+}
+
+static void xdgCacheFreeData(xdgCacheStoreData *data)
+{
+	if (data->journal != -1)
+		close(data->journal);
+	free(data->entries);
+	free(data->path);
+	free(data);
+}
+
+xdgCacheStore * xdgCacheStoreOpen(xdgCacheStore *store, const char *name,
+	unsigned long long budget, unsigned long maxAge, xdgHandle *handle)
+{
+	const char *home;
+	xdgCacheStoreData *data;
+	size_t homeLength, nameLength;
+
+	if (!store || !name || !*name) { errno = EINVAL; return 0; }
+	if (!(home = xdgCacheHome(handle)))
+		return 0;
+	if (!(data = (xdgCacheStoreData*)calloc(1, sizeof(xdgCacheStoreData))))
+		goto fail;
+	data->journal = -1;
+	homeLength = strlen(home);
+	nameLength = strlen(name);
+	data->rootLength = homeLength + 1 + nameLength;
+	if (!(data->path = (char*)malloc(data->rootLength + XDG_CACHE_ENTRY_PATH_LENGTH + XDG_CACHE_TEMP_SUFFIX_MAX + 1)))
+		goto fail;
+	memcpy(data->path, home, homeLength);
+	data->path[homeLength] = '/';
+	memcpy(data->path + homeLength + 1, name, nameLength + 1);
+	if (!handle) free((char*)home);
+	home = 0;
+
+	if (xdgMakePath(data->path, 0700) == -1 && errno != EEXIST)
+		goto fail;
+	data->capacity = 64;
+	if (!(data->entries = (xdgCacheEntry*)calloc(data->capacity, sizeof(xdgCacheEntry))))
+		goto fail;
+	data->budget = budget;
+	data->maxAge = maxAge;
+	data->random = (unsigned long long)time(NULL) ^ ((unsigned long long)getpid() << 32) ^ 0x9e3779b97f4a7c15ull;
+
+	strcpy(data->path + data->rootLength, "/journal");
+	if ((data->journal = open(data->path, O_RDWR | O_CREAT | O_APPEND | XDG_O_CLOEXEC, 0600)) == -1)
+		goto fail;
+	if (xdgCacheLoadIndex(data) == -1)
+	{
+		/* Only a missing or corrupt index requires a full scan. */
+		memset(data->entries, 0, sizeof(xdgCacheEntry) * data->capacity);
+		data->count = 0;
+		data->total = 0;
+		if (xdgCacheScan(data) == -1)
+			goto fail;
+	}
+	store->reserved = data;
+	return store;
+
+fail:
+	if (home && !handle) free((char*)home);
+	if (data) xdgCacheFreeData(data);
+	return 0;
+}
+
+int xdgCacheStoreFlush(xdgCacheStore *store)
+{
+	xdgCacheStoreData *data = xdgGetCacheStore(store);
+	xdgCacheIndexHeader header;
+	struct iovec iov[2];
+	xdgCacheEntry *packed;
+	unsigned int i, j;
+	char *tempPath;
+	ssize_t expected;
+	int fd, ok, err;
+
+	if (!(packed = (xdgCacheEntry*)malloc(sizeof(xdgCacheEntry) * (data->count ? data->count : 1))))
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	for (i = j = 0; i < data->capacity; ++i)
+		if (data->entries[i].hash)
+			packed[j++] = data->entries[i];
+
+	memset(&header, 0, sizeof(header));
+	header.magic = XDG_CACHE_MAGIC;
+	header.entrySize = sizeof(xdgCacheEntry);
+	header.count = j;
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = packed;
+	iov[1].iov_len = sizeof(xdgCacheEntry) * j;
+	expected = iov[0].iov_len + iov[1].iov_len;
+
+	/* The cache is not essential, so the index is replaced without syncing. */
+	sprintf(data->path + data->rootLength, "/index.%lu.tmp", (unsigned long)getpid());
+	tempPath = strdup(data->path);
+	strcpy(data->path + data->rootLength, "/index");
+	if (!tempPath || (fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC | XDG_O_CLOEXEC, 0600)) == -1)
+	{
+		err = tempPath ? errno : ENOMEM;
+		free(tempPath);
+		free(packed);
+		errno = err;
+		return -1;
+	}
+	ok = writev(fd, iov, 2) == expected;
+	err = errno;
+	if (close(fd) == -1 && ok) { ok = 0; err = errno; }
+	if (ok && rename(tempPath, data->path) == -1) { ok = 0; err = errno; }
+	if (!ok) unlink(tempPath);
+	free(tempPath);
+	free(packed);
+	if (!ok)
+	{
+		errno = err;
+		return -1;
+	}
+	return ftruncate(data->journal, 0);
+}
+
+void xdgCacheStoreClose(xdgCacheStore *store)
+{
+	xdgCacheStoreFlush(store);
+	xdgCacheFreeData(xdgGetCacheStore(store));
+	store->reserved = 0;
+}
+
+/** Remove the value in a slot from the disk and the index. */
+static void xdgCacheEvictSlot(xdgCacheStoreData *data, unsigned int i)
+{
+	xdgCacheEntry entry = data->entries[i];
+	unlink(xdgCacheEntryPath(data, entry.hash, NULL));
+	xdgCacheJournal(data, XDG_CACHE_REMOVE, &entry);
+	xdgCacheRemoveSlot(data, i);
+}
+
+/** Pick a random occupied slot. The store must not be empty. */
+static unsigned int xdgCacheRandomSlot(xdgCacheStoreData *data)
+{
+	unsigned int mask = data->capacity - 1;
+	unsigned int i;
+	/* xorshift64 */
+	data->random ^= data->random << 13;
+	data->random ^= data->random >> 7;
+	data->random ^= data->random << 17;
+	for (i = (unsigned int)data->random & mask; !data->entries[i].hash; i = (i + 1) & mask) ;
+	return i;
+}
+
+unsigned int xdgCacheStoreEvict(xdgCacheStore *store, unsigned int maxCount)
+{
+	xdgCacheStoreData *data = xdgGetCacheStore(store);
+	long long now = time(NULL);
+	unsigned int evicted, sample, i, oldest;
+
+	/* Approximate LRU: evict the oldest of a few randomly sampled values.
+	 * This keeps every step independent of the number of values. Stores
+	 * with no more values than samples are searched for the oldest one. */
+	for (evicted = 0; evicted < maxCount && data->count; ++evicted)
+	{
+		oldest = xdgCacheRandomSlot(data);
+		if (data->count <= XDG_CACHE_EVICT_SAMPLES)
+		{
+			for (i = 0; i < data->capacity; ++i)
+				if (data->entries[i].hash && data->entries[i].atime < data->entries[oldest].atime)
+					oldest = i;
+		}
+		else for (sample = 1; sample < XDG_CACHE_EVICT_SAMPLES; ++sample)
+		{
+			i = xdgCacheRandomSlot(data);
+			if (data->entries[i].atime < data->entries[oldest].atime)
+				oldest = i;
+		}
+		if (!(data->budget && data->total > data->budget) &&
+			!(data->maxAge && now - data->entries[oldest].atime > data->maxAge))
+			break;
+		xdgCacheEvictSlot(data, oldest);
+	}
+	return evicted;
+}
+
+int xdgCacheStorePut(xdgCacheStore *store, const void *key, size_t keySize,
+	const void *value, size_t size)
+{
+	xdgCacheStoreData *data = xdgGetCacheStore(store);
+	xdgCacheValueHeader header;
+	xdgCacheEntry entry;
+	struct iovec iov[3];
+	char suffix[XDG_CACHE_TEMP_SUFFIX_MAX];
+	char *tempPath;
+	ssize_t expected;
+	int fd, ok, err;
+
+	entry.hash = xdgCacheKeyHash(key, keySize);
+	entry.size = sizeof(header) + keySize + size;
+	entry.atime = time(NULL);
+	header.magic = XDG_CACHE_MAGIC;
+	header.keySize = keySize;
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = (void*)key;
+	iov[1].iov_len = keySize;
+	iov[2].iov_base = (void*)value;
+	iov[2].iov_len = size;
+	expected = entry.size;
+
+	/* Write to a temporary file so that readers never see a partial value. */
+	sprintf(suffix, ".%lu.tmp", (unsigned long)getpid());
+	if (!(tempPath = strdup(xdgCacheEntryPath(data, entry.hash, suffix))))
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	if ((fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC | XDG_O_CLOEXEC, 0600)) == -1 && errno == ENOENT)
+	{
+		/* Shard directories are only created once they are needed. */
+		tempPath[data->rootLength + 3] = 0;
+		if (mkdir(tempPath, 0700) == 0 || errno == EEXIST)
+		{
+			tempPath[data->rootLength + 3] = '/';
+			fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC | XDG_O_CLOEXEC, 0600);
+		}
+	}
+	if (fd == -1)
+	{
+		err = errno;
+		free(tempPath);
+		errno = err;
+		return -1;
+	}
+	ok = writev(fd, iov, 3) == expected;
+	err = errno;
+	if (close(fd) == -1 && ok) { ok = 0; err = errno; }
+	if (ok && rename(tempPath, xdgCacheEntryPath(data, entry.hash, NULL)) == -1) { ok = 0; err = errno; }
+	if (!ok) unlink(tempPath);
+	free(tempPath);
+	if (!ok)
+	{
+		errno = err;
+		return -1;
+	}
+
+	if (xdgCacheSetEntry(data, &entry) == -1)
+		return -1;
+	xdgCacheJournal(data, XDG_CACHE_PUT, &entry);
+	xdgCacheStoreEvict(store, XDG_CACHE_EVICT_STEP);
+	return 0;
+}
+
+int xdgCacheStoreGet(xdgCacheStore *store, const void *key, size_t keySize, xdgCacheItem *item)
+{
+	xdgCacheStoreData *data = xdgGetCacheStore(store);
+	const xdgCacheValueHeader *header;
+	unsigned long long hash = xdgCacheKeyHash(key, keySize);
+	unsigned int slot = xdgCacheFindSlot(data, hash);
+	long long now;
+	struct stat st;
+	void *base;
+	int fd;
+
+	memset(item, 0, sizeof(xdgCacheItem));
+	/* The index is authoritative, so misses never touch the disk. */
+	if (!data->entries[slot].hash)
+	{
+		errno = ENOENT;
+		return -1;
+	}
+	if ((fd = open(xdgCacheEntryPath(data, hash, NULL), O_RDONLY | XDG_O_CLOEXEC)) == -1)
+	{
+		if (errno == ENOENT)
+			xdgCacheRemoveSlot(data, slot);
+		return -1;
+	}
+	if (fstat(fd, &st) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(xdgCacheValueHeader) + keySize)
+	{
+		close(fd);
+		errno = ENOENT;
+		return -1;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return -1;
+	header = (const xdgCacheValueHeader*)base;
+	/* Different keys may share a hash, in which case the stored key differs. */
+	if (header->magic != XDG_CACHE_MAGIC || header->keySize != keySize ||
+		memcmp((const char*)base + sizeof(xdgCacheValueHeader), key, keySize) != 0)
+	{
+		munmap(base, st.st_size);
+		errno = ENOENT;
+		return -1;
+	}
+	/* Accesses are journaled at most once a second per value, so that
+	 * the eviction order survives a crash as well as a flush. */
+	if (data->entries[slot].atime != (now = time(NULL)))
+	{
+		data->entries[slot].atime = now;
+		xdgCacheJournal(data, XDG_CACHE_ACCESS, &data->entries[slot]);
+	}
+	item->reserved = base;
+	item->reservedSize = st.st_size;
+	item->data = (const char*)base + sizeof(xdgCacheValueHeader) + keySize;
+	item->size = st.st_size - sizeof(xdgCacheValueHeader) - keySize;
+	return 0;
+}
+
+void xdgCacheStoreRelease(xdgCacheItem *item)
+{
+	if (item->reserved)
+		munmap(item->reserved, item->reservedSize);
+	memset(item, 0, sizeof(xdgCacheItem));
+}
+
+int xdgCacheStoreRemove(xdgCacheStore *store, const void *key, size_t keySize)
+{
+	xdgCacheStoreData *data = xdgGetCacheStore(store);
+	unsigned int slot = xdgCacheFindSlot(data, xdgCacheKeyHash(key, keySize));
+	if (!data->entries[slot].hash)
+	{
+		errno = ENOENT;
+		return -1;
+	}
+	xdgCacheEvictSlot(data, slot);
+	return 0;
+}
+
+unsigned long long xdgCacheStoreSize(xdgCacheStore *store)
+{
+	return xdgGetCacheStore(store)->total;
+}
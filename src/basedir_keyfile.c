@@ -0,0 +1,284 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file basedir_keyfile.c
+  * @brief Merged key files in the format of desktop entries and INI files.
+  *
+  * Every matching file is opened as by xdgDataReadAll(), then mapped and
+  * scanned once, line by line, with memchr(), which the C library
+  * vectorizes. Each pair becomes an entry pointing into the mapping. The
+  * entries of all files are then sorted by group, key and priority, and
+  * all but the first entry of every key are dropped, which both merges
+  * the files and allows binary searches. */
+
+#if defined(HAVE_CONFIG_H) || defined(_DOXYGEN)
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <basedir.h>
+#include <basedir_keyfile.h>
+#include "basedir_private.h"
+
+/** Mapping of one of the files of a key file. */
+typedef struct _xdgKeyFileMapping
+{
+	void * address;
+	size_t length;
+} xdgKeyFileMapping;
+
+typedef struct _xdgKeyFileData
+{
+	xdgKeyFileMapping * mappings;
+	unsigned int mappingCount;
+	xdgKeyFileEntry * entries;
+	unsigned int count;
+	unsigned int capacity;
+} xdgKeyFileData;
+
+/** Name of the group of pairs before the first group header. */
+static const char xdgNoGroup[] = "";
+
+/** Check whether a character is whitespace around keys and values. */
+static int xdgIsBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/** Make a slice of a range without leading and trailing whitespace. */
+static xdgSlice xdgTrimSlice(const char *begin, const char *end)
+{
+	xdgSlice slice;
+	while (begin < end && xdgIsBlank(*begin)) ++begin;
+	while (end > begin && xdgIsBlank(end[-1])) --end;
+	slice.data = begin;
+	slice.length = end - begin;
+	return slice;
+}
+
+/** Add the pairs of a mapped file to the entries of a key file.
+ * @return Zero on success, -1 if memory runs out. */
+static int xdgParseKeyFile(xdgKeyFileData *data, const char *text, size_t length, unsigned int directory)
+{
+	const char * end = text + length;
+	const char * line, * eol, * equals;
+	xdgKeyFileEntry * entry;
+	xdgSlice group, trimmed;
+	int skipping = 0;
+
+	group.data = xdgNoGroup;
+	group.length = 0;
+	for (line = text; line < end; line = eol + (eol < end))
+	{
+		if (!(eol = (const char*)memchr(line, '\n', end - line)))
+			eol = end;
+		trimmed = xdgTrimSlice(line, eol);
+		if (trimmed.length == 0 || trimmed.data[0] == '#' || trimmed.data[0] == ';')
+			continue;
+		if (trimmed.data[0] == '[')
+		{
+			/* The pairs after a malformed header belong to no known
+			 * group, so they are dropped rather than guessed at. */
+			skipping = trimmed.data[trimmed.length-1] != ']';
+			if (!skipping)
+			{
+				group.data = trimmed.data + 1;
+				group.length = trimmed.length - 2;
+			}
+			continue;
+		}
+		if (skipping || !(equals = (const char*)memchr(trimmed.data, '=', trimmed.length)) || equals == trimmed.data)
+			continue;
+
+		if (data->count == data->capacity)
+		{
+			if (!(entry = (xdgKeyFileEntry*)realloc(data->entries,
+					sizeof(xdgKeyFileEntry)*(data->capacity ? data->capacity*2 : 64))))
+				return -1;
+			data->entries = entry;
+			data->capacity = data->capacity ? data->capacity*2 : 64;
+		}
+		entry = &data->entries[data->count++];
+		entry->group = group;
+		entry->key = xdgTrimSlice(trimmed.data, equals);
+		entry->value = xdgTrimSlice(equals + 1, trimmed.data + trimmed.length);
+		entry->directory = directory;
+	}
+	return 0;
+}
+
+/** Compare a slice to a string of known length, byte by byte. */
+static int xdgCompareSlice(const xdgSlice *slice, const char *string, size_t length)
+{
+	int result = memcmp(slice->data, string, slice->length < length ? slice->length : length);
+	if (result)
+		return result;
+	return slice->length < length ? -1 : slice->length > length;
+}
+
+/** Order entries by group and key, then by priority: lower directory
+ * indices first and, within a file, later pairs first. */
+static int xdgCompareEntries(const void *a, const void *b)
+{
+	const xdgKeyFileEntry * x = (const xdgKeyFileEntry*)a;
+	const xdgKeyFileEntry * y = (const xdgKeyFileEntry*)b;
+	int result;
+	if ((result = xdgCompareSlice(&x->group, y->group.data, y->group.length)) ||
+		(result = xdgCompareSlice(&x->key, y->key.data, y->key.length)))
+		return result;
+	if (x->directory != y->directory)
+		return x->directory < y->directory ? -1 : 1;
+	return x->key.data > y->key.data ? -1 : x->key.data < y->key.data;
+}
+
+/** Keep the entry of highest priority of every key of sorted entries. */
+static void xdgMergeEntries(xdgKeyFileData *data)
+{
+	unsigned int i, kept = 0;
+	qsort(data->entries, data->count, sizeof(xdgKeyFileEntry), xdgCompareEntries);
+	for (i = 0; i < data->count; ++i)
+	{
+		if (kept > 0 &&
+			xdgCompareSlice(&data->entries[kept-1].group, data->entries[i].group.data, data->entries[i].group.length) == 0 &&
+			xdgCompareSlice(&data->entries[kept-1].key, data->entries[i].key.data, data->entries[i].key.length) == 0)
+			continue;
+		data->entries[kept++] = data->entries[i];
+	}
+	data->count = kept;
+}
+
+/** Map a file opened by xdgOpenEach() and add its pairs to a key file,
+ * skipping files which are not regular or are empty. */
+static int xdgMapKeyFile(int fd, unsigned int directory, void *userData)
+{
+	xdgKeyFileData * data = (xdgKeyFileData*)userData;
+	xdgKeyFileMapping * mapping;
+	struct stat st;
+	void * address;
+
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0)
+	{
+		close(fd);
+		return 0;
+	}
+	address = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (address == MAP_FAILED)
+		return -1;
+	if (!(mapping = (xdgKeyFileMapping*)realloc(data->mappings, sizeof(xdgKeyFileMapping)*(data->mappingCount+1))))
+	{
+		munmap(address, st.st_size);
+		errno = ENOMEM;
+		return -1;
+	}
+	data->mappings = mapping;
+	mapping = &data->mappings[data->mappingCount++];
+	mapping->address = address;
+	mapping->length = st.st_size;
+	if (xdgParseKeyFile(data, (const char*)address, st.st_size, directory) == -1)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+/** Open every file matching a relative path in the data or config directories as a key file. */
+static int xdgOpenKeyFile(const char *relativePath, xdgKeyFile *keyFile, int config, xdgHandle *handle)
+{
+	xdgKeyFileData * data;
+
+	if (!(data = (xdgKeyFileData*)calloc(1, sizeof(xdgKeyFileData))))
+	{
+		keyFile->reserved = 0;
+		errno = ENOMEM;
+		return -1;
+	}
+	keyFile->reserved = data;
+	if (xdgOpenEach(relativePath, config, xdgMapKeyFile, data, handle) == -1)
+	{
+		xdgCloseKeyFile(keyFile);
+		return -1;
+	}
+	xdgMergeEntries(data);
+	return 0;
+}
+
+int xdgDataOpenKeyFile(const char *relativePath, xdgKeyFile *keyFile, xdgHandle *handle)
+{
+	return xdgOpenKeyFile(relativePath, keyFile, 0, handle);
+}
+
+int xdgConfigOpenKeyFile(const char *relativePath, xdgKeyFile *keyFile, xdgHandle *handle)
+{
+	return xdgOpenKeyFile(relativePath, keyFile, 1, handle);
+}
+
+void xdgCloseKeyFile(xdgKeyFile *keyFile)
+{
+	xdgKeyFileData * data = (xdgKeyFileData*)keyFile->reserved;
+	unsigned int i;
+	if (!data) return;
+	for (i = 0; i < data->mappingCount; ++i)
+		munmap(data->mappings[i].address, data->mappings[i].length);
+	free(data->mappings);
+	free(data->entries);
+	free(data);
+	keyFile->reserved = 0;
+}
+
+const xdgKeyFileEntry * xdgKeyFileEntries(xdgKeyFile *keyFile, unsigned int *count)
+{
+	xdgKeyFileData * data = (xdgKeyFileData*)keyFile->reserved;
+	*count = data->count;
+	return data->entries;
+}
+
+const xdgKeyFileEntry * xdgKeyFileLookup(xdgKeyFile *keyFile, const char *group, const char *key)
+{
+	xdgKeyFileData * data = (xdgKeyFileData*)keyFile->reserved;
+	size_t groupLength = strlen(group), keyLength = strlen(key);
+	unsigned int low = 0, high = data->count, middle;
+	int result;
+
+	while (low < high)
+	{
+		middle = low + (high - low) / 2;
+		if (!(result = xdgCompareSlice(&data->entries[middle].group, group, groupLength)))
+			result = xdgCompareSlice(&data->entries[middle].key, key, keyLength);
+		if (result == 0)
+			return &data->entries[middle];
+		if (result < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return 0;
+}
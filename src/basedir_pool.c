@@ -0,0 +1,215 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file basedir_pool.c
+  * @brief Strings and directory lists shared between handles.
+  *
+  * Handles initialized with a pool intern their environment, home
+  * directories and directory lists in it, so that handles of many users
+  * share the strings they have in common instead of each holding copies.
+  * The arrays of the directory lists, which point to interned strings, are
+  * interned as blocks of bytes the same way, so that handles with the same
+  * directories also share the lists themselves.
+  * Interned blocks are immutable and reference counted; updating a handle
+  * interns the new blocks and releases the old ones, and a handle which
+  * needs to modify a list copies it first. */
+
+#if defined(HAVE_CONFIG_H) || defined(_DOXYGEN)
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#ifdef HAVE_PTHREAD
+#  include <pthread.h>
+#endif
+
+#include <basedir.h>
+#include "basedir_private.h"
+
+/** Initial number of slots, must be a power of two. */
+#define XDG_POOL_INITIAL_SLOTS 64
+
+/** Interned string or block with its reference count. */
+typedef struct _xdgPooledString
+{
+	unsigned long long hash;
+	size_t length;
+	unsigned int references;
+	/** Contents, aligned for the arrays of directory lists. */
+	union
+	{
+		char string[1];
+		void * pointer;
+		long long number;
+	} data;
+} xdgPooledString;
+
+struct _xdgStringPool
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t mutex;
+#endif
+	/** Open-addressing table of the interned strings. */
+	xdgPooledString ** slots;
+	/** Number of slots, always a power of two. */
+	size_t capacity;
+	size_t count;
+};
+
+#ifdef HAVE_PTHREAD
+#  define xdgPoolLock(pool) pthread_mutex_lock(&(pool)->mutex)
+#  define xdgPoolUnlock(pool) pthread_mutex_unlock(&(pool)->mutex)
+#else
+#  define xdgPoolLock(pool)
+#  define xdgPoolUnlock(pool)
+#endif
+
+/** Double the number of slots of a pool.
+ * @return Non-zero on success. */
+static int xdgGrowPool(xdgStringPool *pool)
+{
+	xdgPooledString ** slots;
+	size_t capacity = pool->capacity*2, i, j;
+
+	if (!(slots = (xdgPooledString**)calloc(capacity, sizeof(xdgPooledString*))))
+		return 0;
+	for (i = 0; i < pool->capacity; ++i)
+	{
+		if (!pool->slots[i]) continue;
+		for (j = pool->slots[i]->hash & (capacity-1); slots[j]; j = (j+1) & (capacity-1)) ;
+		slots[j] = pool->slots[i];
+	}
+	free(pool->slots);
+	pool->slots = slots;
+	pool->capacity = capacity;
+	return 1;
+}
+
+void * xdgPoolShare(xdgStringPool *pool, const void *data, size_t length)
+{
+	unsigned long long hash = xdgHashBytes(XDG_HASH_INIT, data, length);
+	xdgPooledString * entry;
+	size_t i;
+
+	xdgPoolLock(pool);
+	if (pool->count*2 >= pool->capacity && !xdgGrowPool(pool))
+		goto nomem;
+	for (i = hash & (pool->capacity-1); (entry = pool->slots[i]); i = (i+1) & (pool->capacity-1))
+	{
+		if (entry->hash == hash && entry->length == length && memcmp(entry->data.string, data, length) == 0)
+		{
+			entry->references++;
+			xdgPoolUnlock(pool);
+			return entry->data.string;
+		}
+	}
+	if (!(entry = (xdgPooledString*)malloc(offsetof(xdgPooledString, data) + length + 1)))
+		goto nomem;
+	entry->hash = hash;
+	entry->length = length;
+	entry->references = 1;
+	memcpy(entry->data.string, data, length);
+	entry->data.string[length] = 0;
+	pool->slots[i] = entry;
+	pool->count++;
+	xdgPoolUnlock(pool);
+	return entry->data.string;
+
+nomem:
+	xdgPoolUnlock(pool);
+	errno = ENOMEM;
+	return 0;
+}
+
+char * xdgPoolIntern(xdgStringPool *pool, const char *string, size_t length)
+{
+	return (char*)xdgPoolShare(pool, string, length);
+}
+
+void xdgPoolRelease(xdgStringPool *pool, void *data)
+{
+	xdgPooledString * entry = (xdgPooledString*)((char*)data - offsetof(xdgPooledString, data));
+	size_t mask, i, j, home;
+
+	xdgPoolLock(pool);
+	if (--entry->references)
+	{
+		xdgPoolUnlock(pool);
+		return;
+	}
+	mask = pool->capacity-1;
+	for (i = entry->hash & mask; pool->slots[i] != entry; i = (i+1) & mask) ;
+	/* Shift later entries of the probe sequence back into the gap. */
+	for (j = (i+1) & mask; pool->slots[j]; j = (j+1) & mask)
+	{
+		home = pool->slots[j]->hash & mask;
+		if (((j - home) & mask) >= ((j - i) & mask))
+		{
+			pool->slots[i] = pool->slots[j];
+			i = j;
+		}
+	}
+	pool->slots[i] = 0;
+	pool->count--;
+	xdgPoolUnlock(pool);
+	free(entry);
+}
+
+xdgHandlePool * xdgInitHandlePool(xdgHandlePool *handlePool)
+{
+	xdgStringPool * pool;
+	if (!handlePool) return 0;
+	if (!(pool = (xdgStringPool*)malloc(sizeof(xdgStringPool))))
+		return 0;
+	if (!(pool->slots = (xdgPooledString**)calloc(XDG_POOL_INITIAL_SLOTS, sizeof(xdgPooledString*))))
+	{
+		free(pool);
+		return 0;
+	}
+	pool->capacity = XDG_POOL_INITIAL_SLOTS;
+	pool->count = 0;
+#ifdef HAVE_PTHREAD
+	pthread_mutex_init(&pool->mutex, 0);
+#endif
+	handlePool->reserved = pool;
+	return handlePool;
+}
+
+void xdgWipeHandlePool(xdgHandlePool *handlePool)
+{
+	xdgStringPool * pool = (xdgStringPool*)handlePool->reserved;
+	size_t i;
+	/* Strings still referenced belong to handles which were not wiped. */
+	for (i = 0; i < pool->capacity; ++i)
+		free(pool->slots[i]);
+	free(pool->slots);
+#ifdef HAVE_PTHREAD
+	pthread_mutex_destroy(&pool->mutex);
+#endif
+	free(pool);
+	handlePool->reserved = 0;
+}
@@ -0,0 +1,212 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file basedir_private.h
+  * Internal interfaces shared between the source files of the library. */
+
+#ifndef XDG_BASEDIR_PRIVATE_H
+#define XDG_BASEDIR_PRIVATE_H
+
+#include <stddef.h>
+#include <basedir.h>
+
+#if SUPPORT_ATTRIBUTE_VISIBILITY_HIDDEN
+#  define XDG_INTERNAL __attribute__((visibility("hidden")))
+#else
+#  define XDG_INTERNAL
+#endif
+
+/** Initial value for xdgHashBytes(). */
+#define XDG_HASH_INIT 0xcbf29ce484222325ull
+
+/** Continue a 64-bit FNV-1a hash over some bytes.
+  * @param hash Hash of the preceding bytes, or @c XDG_HASH_INIT.
+  * @param data Bytes to hash.
+  * @param size Number of bytes in data.
+  * @return The updated hash. */
+XDG_INTERNAL unsigned long long xdgHashBytes(unsigned long long hash, const void *data, size_t size);
+
+/** @name Shared resolution cache */
+/*@{*/
+
+/** Mapping of a shared resolution cache. */
+typedef struct _xdgSharedCache xdgSharedCache;
+
+/** Map a shared resolution cache.
+  * @param fd File descriptor of the cache, or -1 to open or create the
+  * 	cache file in runtimeDirectory.
+  * @param runtimeDirectory Runtime directory, only used if fd is -1.
+  * @param ttl Number of seconds for which results are trusted.
+  * @return The mapping, or @c NULL if an error occurs (in which case errno
+  * 	will be set). */
+XDG_INTERNAL xdgSharedCache * xdgSharedCacheMap(int fd, const char *runtimeDirectory, unsigned int ttl);
+
+/** Add a user of a shared resolution cache mapping.
+  * @return The mapping. */
+XDG_INTERNAL xdgSharedCache * xdgSharedCacheRetain(xdgSharedCache *shared);
+
+/** Remove a user of a shared resolution cache mapping, unmapping it when
+  * it was the last. */
+XDG_INTERNAL void xdgSharedCacheUnmap(xdgSharedCache *shared);
+
+/** Watch the parent directory of a path for changes which invalidate
+  * results, along with every directory up to the base directory.
+  * @param shared Mapped cache.
+  * @param path Path in a base directory.
+  * @param baseLength Length of the base directory in path.
+  * @param parentLength Length of the parent directory in path.
+  * @return 1 if the directories were already watched, 0 if they are
+  * 	watched from now on, so that results published before may be stale,
+  * 	or -1 if they cannot be watched. */
+XDG_INTERNAL int xdgSharedCacheWatch(xdgSharedCache *shared, const char *path, size_t baseLength, size_t parentLength);
+
+/** Get the current generation of a shared resolution cache, which changes
+  * whenever a watched directory changes or the cache is invalidated. */
+XDG_INTERNAL unsigned long long xdgSharedCacheGeneration(xdgSharedCache *shared);
+
+/** Look up which directories of a directory list contain a relative path.
+  * Only results of the current generation are used.
+  * @param shared Mapped cache.
+  * @param fingerprint Fingerprint of the directory list.
+  * @param relativePath Relative path which was looked up.
+  * @param length Length of relativePath.
+  * @param known Receives a bitmap of the directories whose state is known.
+  * @param present Receives a bitmap of the directories containing relativePath.
+  * @return Non-zero if a valid result was found. */
+XDG_INTERNAL int xdgSharedCacheLookup(xdgSharedCache *shared, unsigned long long fingerprint,
+	const char *relativePath, size_t length, unsigned long long *known, unsigned long long *present);
+
+/** Publish which directories of a directory list contain a relative path.
+  * Publishing is skipped if another process is updating the same entry,
+  * or if the generation changed since the directories were probed.
+  * @param generation Generation from xdgSharedCacheGeneration() taken
+  * 	before the directories were probed.
+  * @see xdgSharedCacheLookup() */
+XDG_INTERNAL void xdgSharedCacheStore(xdgSharedCache *shared, unsigned long long fingerprint, unsigned long long generation,
+	const char *relativePath, size_t length, unsigned long long known, unsigned long long present);
+
+/** Invalidate all results in a shared resolution cache. */
+XDG_INTERNAL void xdgSharedCacheInvalidate(xdgSharedCache *shared);
+
+/** Where a shared resolution cache was mapped from, so that another
+  * process can map it again. */
+typedef struct _xdgSharedCacheOrigin
+{
+	/** Descriptor passed to xdgSharedCacheMap(), or -1 for the cache file
+	  * in the runtime directory. */
+	int fd;
+	unsigned int ttl;
+	/** Identity of the cache file. */
+	unsigned long long device;
+	unsigned long long inode;
+} xdgSharedCacheOrigin;
+
+/** Get where a shared resolution cache was mapped from. */
+XDG_INTERNAL void xdgSharedCacheGetOrigin(xdgSharedCache *shared, xdgSharedCacheOrigin *origin);
+
+/*@}*/
+
+/** @name String pools */
+/*@{*/
+
+/** Reference counted strings and blocks shared between handles, kept in
+  * xdgHandlePool::reserved. */
+typedef struct _xdgStringPool xdgStringPool;
+
+/** Get a reference to the interned copy of a block of bytes.
+  * Interned blocks must not be modified.
+  * @param pool Pool to intern the block in.
+  * @param data Block to intern.
+  * @param length Size of @p data in bytes.
+  * @return The interned block, aligned for any pointer or integer, or
+  * 	@c NULL if an error occurs (in which case errno will be set). */
+XDG_INTERNAL void * xdgPoolShare(xdgStringPool *pool, const void *data, size_t length);
+
+/** Get a reference to the interned copy of a string.
+  * @param pool Pool to intern the string in.
+  * @param string String to intern, which need not be null-terminated.
+  * @param length Number of characters in string.
+  * @return The null-terminated interned string, or @c NULL if an error
+  * 	occurs (in which case errno will be set). */
+XDG_INTERNAL char * xdgPoolIntern(xdgStringPool *pool, const char *string, size_t length);
+
+/** Release a reference returned by xdgPoolIntern() or xdgPoolShare(),
+  * freeing the string or block when it was the last. */
+XDG_INTERNAL void xdgPoolRelease(xdgStringPool *pool, void *data);
+
+/*@}*/
+
+/** @name Opening every matching file */
+/*@{*/
+
+/** Called with each file opened by xdgOpenEach(), in order of priority.
+  * @param fd Descriptor of the file, owned by the callback.
+  * @param directory Index of the directory of the file, within the list
+  * 	returned by xdgSearchableDataDirectories() or
+  * 	xdgSearchableConfigDirectories().
+  * @param userData Pointer passed to xdgOpenEach().
+  * @return Zero to go on, -1 to stop with errno set. */
+typedef int (*xdgOpenEachCallback)(int fd, unsigned int directory, void *userData);
+
+/** Open a relative path for reading in every data or config directory,
+  * with the directory descriptors, listings and lookup deadline of the
+  * handle, as xdgDataReadAll() does.
+  * @param relativePath Relative path to open.
+  * @param config Whether to open in the config instead of the data directories.
+  * @param callback Called with each file which could be opened.
+  * @param userData Pointer passed to callback.
+  * @param handle Handle to data cache, or @c NULL to read the environment.
+  * @return Zero on success, -1 if an error occured or callback failed (in
+  * 	which case errno will be set). */
+XDG_INTERNAL int xdgOpenEach(const char *relativePath, int config, xdgOpenEachCallback callback, void *userData,
+	xdgHandle *handle);
+
+/*@}*/
+
+/** @name Startup profiles */
+/*@{*/
+
+/** Hash identifying the searchable data and config directories.
+  * @param handle Handle to data cache, or @c NULL to read the environment.
+  * @return The hash, or 0 if an error occurs. */
+XDG_INTERNAL unsigned long long xdgGetHandleFingerprint(xdgHandle *handle);
+
+/** Start recording the lookups of this process if XDG_BASEDIR_PROFILE is
+  * set, and replay the profile saved by the previous run.
+  * Only the first call in a process has any effect.
+  * @param handle Handle the lookups are made with, or @c NULL. */
+XDG_INTERNAL void xdgProfileStart(xdgHandle *handle);
+
+/** Record a lookup if this process is recording a profile, starting the
+  * profile first if needed.
+  * @param handle Handle the lookup is made with, or @c NULL.
+  * @param config Whether relativePath was looked up in the config directories.
+  * @param relativePath Relative path which was looked up, which need not
+  * 	be null-terminated.
+  * @param length Length of relativePath. */
+XDG_INTERNAL void xdgProfileRecord(xdgHandle *handle, int config, const char *relativePath, size_t length);
+
+/*@}*/
+
+#endif /*XDG_BASEDIR_PRIVATE_H*/
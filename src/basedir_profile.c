@@ -0,0 +1,296 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file basedir_profile.c
+  * @brief Recording and replaying the lookups made while a program starts.
+  *
+  * When XDG_BASEDIR_PROFILE is set to a number of seconds, the relative
+  * paths looked up during that time after the first handle was
+  * initialized or the first lookup was made are recorded and saved to a
+  * profile in xdgCacheHome. The next start of the same executable with
+  * the same directory lists replays the profile through xdgDataPrefetch()
+  * and xdgConfigPrefetch(). */
+
+#if defined(HAVE_CONFIG_H) || defined(_DOXYGEN)
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_PTHREAD
+#  include <pthread.h>
+#endif
+
+#include <basedir.h>
+#include <basedir_fs.h>
+#include "basedir_private.h"
+
+/** Environment variable holding the number of seconds to record. */
+#define XDG_PROFILE_ENV "XDG_BASEDIR_PROFILE"
+/** Directory of the profiles, relative to xdgCacheHome. */
+#define XDG_PROFILE_DIRECTORY "libxdg-basedir/profiles/"
+/** Maximum number of recorded lookups, must be below half of XDG_PROFILE_SLOTS. */
+#define XDG_PROFILE_MAX_ENTRIES 1024
+/** Size of the table of recorded lookups, must be a power of two. */
+#define XDG_PROFILE_SLOTS 4096
+/** Maximum size of a profile which is replayed. */
+#define XDG_PROFILE_MAX_SIZE (256*1024)
+
+enum
+{
+	XDG_PROFILE_IDLE,
+	XDG_PROFILE_RECORDING,
+	XDG_PROFILE_DONE
+};
+
+/** State of the profile of this process. */
+typedef struct _xdgProfile
+{
+	/** One of XDG_PROFILE_IDLE, XDG_PROFILE_RECORDING or XDG_PROFILE_DONE. */
+	volatile int state;
+	/** Profile path relative to xdgCacheHome. */
+	char relativePath[sizeof(XDG_PROFILE_DIRECTORY) + 16];
+	/** Process which records, so forked children don't save. */
+	pid_t pid;
+	/** Monotonic time at which recording stops. */
+	struct timespec deadline;
+	/** Recorded lookups, each "d path" or "c path", hashed into slots. */
+	char * slots[XDG_PROFILE_SLOTS];
+	unsigned int count;
+} xdgProfile;
+
+static xdgProfile xdgProcessProfile;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t xdgProfileMutex = PTHREAD_MUTEX_INITIALIZER;
+#  define xdgProfileLock() pthread_mutex_lock(&xdgProfileMutex)
+#  define xdgProfileUnlock() pthread_mutex_unlock(&xdgProfileMutex)
+#else
+#  define xdgProfileLock()
+#  define xdgProfileUnlock()
+#endif
+
+/** Save the recorded lookups and stop recording. Must be called with the lock held. */
+static void xdgProfileSave(void)
+{
+	xdgProfile * profile = &xdgProcessProfile;
+	char * buffer, * p;
+	size_t size = 0;
+	unsigned int i;
+
+	profile->state = XDG_PROFILE_DONE;
+	if (profile->pid != getpid() || profile->count == 0)
+		return;
+	for (i = 0; i < XDG_PROFILE_SLOTS; ++i)
+		if (profile->slots[i])
+			size += strlen(profile->slots[i]) + 1;
+	if ((p = buffer = (char*)malloc(size)))
+	{
+		for (i = 0; i < XDG_PROFILE_SLOTS; ++i)
+		{
+			if (!profile->slots[i]) continue;
+			size = strlen(profile->slots[i]);
+			memcpy(p, profile->slots[i], size);
+			p += size;
+			*p++ = '\n';
+		}
+		/* Saving is best effort, a missing profile only costs a warm-up. */
+		xdgCacheWriteAtomic(profile->relativePath, buffer, p - buffer, NULL, NULL);
+		free(buffer);
+	}
+	for (i = 0; i < XDG_PROFILE_SLOTS; ++i)
+	{
+		free(profile->slots[i]);
+		profile->slots[i] = 0;
+	}
+	profile->count = 0;
+}
+
+static void xdgProfileSaveAtExit(void)
+{
+	xdgProfileLock();
+	if (xdgProcessProfile.state == XDG_PROFILE_RECORDING)
+		xdgProfileSave();
+	xdgProfileUnlock();
+}
+
+/** Replay a saved profile as prefetches.
+ * @param handle Handle whose directory lists the profile was recorded with. */
+static void xdgProfileReplay(xdgHandle *handle)
+{
+	const char * cacheHome = xdgCacheHome(handle);
+	const char ** paths;
+	unsigned int dataCount = 0, count = 0, lines = 0;
+	size_t homeLength, size;
+	char * buffer, * line, * end;
+	FILE * file;
+
+	if (!cacheHome) return;
+	homeLength = strlen(cacheHome);
+	if (!(buffer = (char*)malloc(homeLength + 1 + sizeof(xdgProcessProfile.relativePath) + XDG_PROFILE_MAX_SIZE)))
+	{
+		if (!handle) free((char*)cacheHome);
+		return;
+	}
+	memcpy(buffer, cacheHome, homeLength);
+	buffer[homeLength] = '/';
+	strcpy(buffer + homeLength + 1, xdgProcessProfile.relativePath);
+	if (!handle) free((char*)cacheHome);
+	file = fopen(buffer, "r");
+	if (!file)
+	{
+		free(buffer);
+		return;
+	}
+	size = fread(buffer, 1, XDG_PROFILE_MAX_SIZE, file);
+	fclose(file);
+	buffer[size] = 0;
+
+	for (line = buffer; (line = strchr(line, '\n')); ++line)
+		++lines;
+	if (!(paths = (const char**)malloc(sizeof(char*)*(lines+1))))
+	{
+		free(buffer);
+		return;
+	}
+	/* Data paths are collected from the front, config paths from the back. */
+	for (line = buffer; (end = strchr(line, '\n')); line = end + 1)
+	{
+		*end = 0;
+		if (end - line < 3 || line[1] != ' ') continue;
+		if (line[0] == 'd')
+			paths[dataCount++] = line + 2;
+		else if (line[0] == 'c')
+			paths[lines - ++count] = line + 2;
+	}
+	if (dataCount)
+		xdgDataPrefetch(paths, dataCount, handle);
+	if (count)
+		xdgConfigPrefetch(paths + lines - count, count, handle);
+	free(paths);
+	free(buffer);
+}
+
+/** Read the variable enabling profiles, which is ignored in setuid and
+ * setgid programs, as a less privileged user controls their environment
+ * and would make them write to and read back from the cache home. */
+static const char * xdgProfileGetEnv(void)
+{
+#ifdef HAVE_SECURE_GETENV
+	return secure_getenv(XDG_PROFILE_ENV);
+#else
+	if (getuid() != geteuid() || getgid() != getegid())
+		return NULL;
+	return getenv(XDG_PROFILE_ENV);
+#endif
+}
+
+void xdgProfileStart(xdgHandle *handle)
+{
+	xdgProfile * profile = &xdgProcessProfile;
+	unsigned long long key = XDG_HASH_INIT;
+	unsigned long long fingerprint;
+	const char * env;
+	char exe[4096];
+	ssize_t length;
+	unsigned long seconds;
+	char * end;
+	int replay = 0;
+
+	if (profile->state != XDG_PROFILE_IDLE)
+		return;
+	xdgProfileLock();
+	if (profile->state == XDG_PROFILE_IDLE)
+	{
+		profile->state = XDG_PROFILE_DONE;
+		if ((env = xdgProfileGetEnv()) && (seconds = strtoul(env, &end, 10)) > 0 && !*end &&
+			(length = readlink("/proc/self/exe", exe, sizeof(exe))) > 0 &&
+			(fingerprint = xdgGetHandleFingerprint(handle)) != 0 &&
+			clock_gettime(CLOCK_MONOTONIC, &profile->deadline) == 0)
+		{
+			key = xdgHashBytes(key, exe, length);
+			key = xdgHashBytes(key, &fingerprint, sizeof(fingerprint));
+			sprintf(profile->relativePath, XDG_PROFILE_DIRECTORY "%016llx", key);
+			profile->deadline.tv_sec += seconds;
+			profile->pid = getpid();
+			if (atexit(xdgProfileSaveAtExit) == 0)
+			{
+				profile->state = XDG_PROFILE_RECORDING;
+				replay = 1;
+			}
+		}
+	}
+	xdgProfileUnlock();
+	if (replay)
+		xdgProfileReplay(handle);
+}
+
+void xdgProfileRecord(xdgHandle *handle, int config, const char *relativePath, size_t length)
+{
+	xdgProfile * profile = &xdgProcessProfile;
+	struct timespec now;
+	unsigned long long hash;
+	unsigned int i;
+	char * entry;
+
+	if (profile->state == XDG_PROFILE_IDLE)
+		xdgProfileStart(handle);
+	if (profile->state != XDG_PROFILE_RECORDING)
+		return;
+	xdgProfileLock();
+	if (profile->state != XDG_PROFILE_RECORDING)
+		goto done;
+	if (clock_gettime(CLOCK_MONOTONIC, &now) == 0 &&
+		(now.tv_sec > profile->deadline.tv_sec ||
+			(now.tv_sec == profile->deadline.tv_sec && now.tv_nsec >= profile->deadline.tv_nsec)))
+	{
+		xdgProfileSave();
+		goto done;
+	}
+	/* Lines of the profile cannot contain newlines. */
+	if (profile->count == XDG_PROFILE_MAX_ENTRIES || memchr(relativePath, '\n', length))
+		goto done;
+
+	hash = xdgHashBytes(XDG_HASH_INIT, config ? "c" : "d", 1);
+	hash = xdgHashBytes(hash, relativePath, length);
+	for (i = hash & (XDG_PROFILE_SLOTS-1); (entry = profile->slots[i]); i = (i + 1) & (XDG_PROFILE_SLOTS-1))
+	{
+		if (entry[0] == (config ? 'c' : 'd') && strncmp(entry + 2, relativePath, length) == 0 &&
+			entry[length + 2] == 0)
+			goto done;
+	}
+	if ((entry = (char*)malloc(length + 3)))
+	{
+		entry[0] = config ? 'c' : 'd';
+		entry[1] = ' ';
+		memcpy(entry + 2, relativePath, length);
+		entry[length + 2] = 0;
+		profile->slots[i] = entry;
+		profile->count++;
+	}
+done:
+	xdgProfileUnlock();
+}
@@ -0,0 +1,601 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file basedir_shared.c
+  * @brief Resolution cache shared between processes through shared memory.
+  *
+  * The cache is a fixed-size table of slots, each protected by a
+  * sequence counter. Readers never block: they copy a slot and give up
+  * if the counter was odd or changed meanwhile. Writers claim a slot by
+  * atomically making its counter odd and simply skip publishing if
+  * another writer holds it.
+  *
+  * Slots record the generation of the cache they were probed in, and are
+  * only used while it is unchanged. Each mapping watches the directories
+  * its lookups probed with inotify, and a thread bumps the generation
+  * whenever one of them changes, so that lookups need no system call to
+  * tell whether a result is still valid. */
+
+#if defined(HAVE_CONFIG_H) || defined(_DOXYGEN)
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__GNUC__) && defined(HAVE_PTHREAD) && defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_INOTIFY_INIT1)
+#  include <pthread.h>
+#  include <signal.h>
+#  include <poll.h>
+#  include <sys/inotify.h>
+#  define XDG_SHARED_WATCH 1
+#endif
+
+#ifdef O_CLOEXEC
+#  define XDG_O_CLOEXEC O_CLOEXEC
+#else
+#  define XDG_O_CLOEXEC 0
+#endif
+
+#include "basedir_private.h"
+
+/** Magic number at the start of the cache. */
+#define XDG_SHARED_MAGIC 0x33435258u /* "XRC3" */
+/** Number of slots, must be a power of two. */
+#define XDG_SHARED_SLOTS 4096
+/** Number of slots probed for each key. */
+#define XDG_SHARED_PROBES 4
+/** Maximum length of a cached relative path, including the null byte. */
+#define XDG_SHARED_PATH_MAX 200
+/** Name of the cache file in the runtime directory. */
+#define XDG_SHARED_FILE_NAME "/libxdg-basedir-resolve-3.cache"
+/** Number of watched directories of a mapping, must be a power of two. */
+#define XDG_SHARED_WATCHES 512
+
+#ifdef XDG_SHARED_WATCH
+/** Events which may change which directories contain a path. */
+#define XDG_SHARED_EVENTS (IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | \
+	IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#endif
+
+typedef struct _xdgSharedHeader
+{
+	unsigned int magic;
+	unsigned int slotCount;
+	unsigned int slotSize;
+	unsigned int reserved;
+	/** Incremented to invalidate all slots. */
+	unsigned long long generation;
+} xdgSharedHeader;
+
+typedef struct _xdgSharedSlot
+{
+	/** Odd while a writer updates the slot. */
+	unsigned int sequence;
+	unsigned int pathLength;
+	/** Hash of the fingerprint and path, 0 for unused slots. */
+	unsigned long long key;
+	unsigned long long fingerprint;
+	unsigned long long generation;
+	long long stamp;
+	unsigned long long known;
+	unsigned long long present;
+	char path[XDG_SHARED_PATH_MAX];
+} xdgSharedSlot;
+
+struct _xdgSharedCache
+{
+	xdgSharedHeader * header;
+	xdgSharedSlot * slots;
+	size_t size;
+	long long ttl;
+	/** Number of users of the mapping, see xdgSharedCacheRetain(). */
+	int references;
+	xdgSharedCacheOrigin origin;
+#ifdef XDG_SHARED_WATCH
+	/** Protects the fields of the watcher below. */
+	pthread_mutex_t mutex;
+	/** Inotify instance of the watcher, or -1 while it is not running. */
+	int inotify;
+	/** Pipe waking the watcher thread up to stop it. */
+	int wake[2];
+	pthread_t thread;
+	/** Next mapping with a running watcher. */
+	struct _xdgSharedCache * next;
+	/** Hashes of the watched parent directories, 0 for unused entries. */
+	unsigned long long watched[XDG_SHARED_WATCHES];
+	unsigned int watchedCount;
+#endif
+};
+
+/** Size of the mapping. */
+#define XDG_SHARED_SIZE (sizeof(xdgSharedHeader) + sizeof(xdgSharedSlot)*XDG_SHARED_SLOTS)
+
+unsigned long long xdgHashBytes(unsigned long long hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+	size_t i;
+	for (i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+#ifdef XDG_SHARED_WATCH
+
+/** Protects the list of mappings with a running watcher. */
+static pthread_mutex_t xdgWatchingMutex = PTHREAD_MUTEX_INITIALIZER;
+/** Mappings with a running watcher. */
+static xdgSharedCache * xdgWatching = 0;
+/** Whether the fork handlers were installed. */
+static int xdgWatchingForkHandlers = 0;
+
+static void xdgLockWatching(void) { pthread_mutex_lock(&xdgWatchingMutex); }
+static void xdgUnlockWatching(void) { pthread_mutex_unlock(&xdgWatchingMutex); }
+
+/** Forget the watchers in a forked child, which has none of their
+ * threads. They are started again by the next lookup which misses. */
+static void xdgResetWatching(void)
+{
+	xdgSharedCache *shared;
+	for (shared = xdgWatching; shared; shared = shared->next)
+	{
+		pthread_mutex_init(&shared->mutex, 0);
+		close(shared->inotify);
+		close(shared->wake[0]);
+		close(shared->wake[1]);
+		shared->inotify = -1;
+		memset(shared->watched, 0, sizeof(shared->watched));
+		shared->watchedCount = 0;
+	}
+	xdgWatching = 0;
+	pthread_mutex_init(&xdgWatchingMutex, 0);
+}
+
+/** Bump the generation of a mapping whenever a watched directory changes.
+ * Once a watched directory was removed, renamed, or got a subdirectory
+ * which may be a missing parent, the watched directories are forgotten,
+ * so that the next lookups watch the directories now at their paths. */
+static void * xdgSharedWatcherThread(void *arg)
+{
+	xdgSharedCache *shared = (xdgSharedCache*)arg;
+	union
+	{
+		struct inotify_event event;
+		char bytes[4096];
+	} buffer;
+	const struct inotify_event *event;
+	struct pollfd fds[2];
+	ssize_t got, offset;
+	int forget;
+
+	fds[0].fd = shared->inotify;
+	fds[0].events = POLLIN;
+	fds[1].fd = shared->wake[0];
+	fds[1].events = POLLIN;
+	for (;;)
+	{
+		if (poll(fds, 2, -1) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[1].revents)
+			break;
+		if ((got = read(shared->inotify, buffer.bytes, sizeof(buffer))) <= 0)
+			continue;
+		forget = 0;
+		for (offset = 0; offset < got; offset += sizeof(struct inotify_event) + event->len)
+		{
+			event = (const struct inotify_event*)(buffer.bytes + offset);
+			if ((event->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) ||
+				((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))))
+				forget = 1;
+		}
+		if (forget)
+		{
+			pthread_mutex_lock(&shared->mutex);
+			memset(shared->watched, 0, sizeof(shared->watched));
+			shared->watchedCount = 0;
+			pthread_mutex_unlock(&shared->mutex);
+		}
+		xdgSharedCacheInvalidate(shared);
+	}
+	return 0;
+}
+
+/** Start the watcher of a mapping if it is not running yet, with the mutex
+ * of the mapping held. The thread blocks all signals, so that they are
+ * still delivered to the threads of the application.
+ * @return Non-zero if the watcher is running. */
+static int xdgStartSharedWatcher(xdgSharedCache *shared)
+{
+	sigset_t all, old;
+	int started = 0;
+
+	if (shared->inotify != -1)
+		return 1;
+	pthread_mutex_lock(&xdgWatchingMutex);
+	if (!xdgWatchingForkHandlers)
+		xdgWatchingForkHandlers = pthread_atfork(xdgLockWatching, xdgUnlockWatching, xdgResetWatching) == 0;
+	if (xdgWatchingForkHandlers && (shared->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) != -1)
+	{
+		if (pipe(shared->wake) == 0)
+		{
+			fcntl(shared->wake[0], F_SETFD, FD_CLOEXEC);
+			fcntl(shared->wake[1], F_SETFD, FD_CLOEXEC);
+			sigfillset(&all);
+			pthread_sigmask(SIG_SETMASK, &all, &old);
+			started = pthread_create(&shared->thread, 0, xdgSharedWatcherThread, shared) == 0;
+			pthread_sigmask(SIG_SETMASK, &old, 0);
+			if (!started)
+			{
+				close(shared->wake[0]);
+				close(shared->wake[1]);
+			}
+		}
+		if (started)
+		{
+			shared->next = xdgWatching;
+			xdgWatching = shared;
+		}
+		else
+		{
+			close(shared->inotify);
+			shared->inotify = -1;
+		}
+	}
+	pthread_mutex_unlock(&xdgWatchingMutex);
+	return started;
+}
+
+/** Stop the watcher of a mapping which is no longer used. */
+static void xdgStopSharedWatcher(xdgSharedCache *shared)
+{
+	xdgSharedCache **link;
+	int running;
+
+	pthread_mutex_lock(&xdgWatchingMutex);
+	if ((running = shared->inotify != -1))
+	{
+		for (link = &xdgWatching; *link != shared; link = &(*link)->next) ;
+		*link = shared->next;
+	}
+	pthread_mutex_unlock(&xdgWatchingMutex);
+	if (!running)
+		return;
+	while (write(shared->wake[1], "", 1) == -1 && errno == EINTR) ;
+	pthread_join(shared->thread, 0);
+	close(shared->inotify);
+	close(shared->wake[0]);
+	close(shared->wake[1]);
+}
+
+#endif
+
+xdgSharedCache * xdgSharedCacheMap(int fd, const char *runtimeDirectory, unsigned int ttl)
+{
+#if defined(__GNUC__)
+	xdgSharedCache *shared;
+	struct stat st;
+	char *path;
+	void *base;
+	int ownfd = -1, err;
+
+	if (fd == -1)
+	{
+		if (!runtimeDirectory)
+		{
+			errno = ENOENT;
+			return 0;
+		}
+		if (!(path = (char*)malloc(strlen(runtimeDirectory) + sizeof(XDG_SHARED_FILE_NAME))))
+		{
+			errno = ENOMEM;
+			return 0;
+		}
+		strcpy(path, runtimeDirectory);
+		strcat(path, XDG_SHARED_FILE_NAME);
+		ownfd = fd = open(path, O_RDWR | O_CREAT | XDG_O_CLOEXEC, 0600);
+		free(path);
+		if (fd == -1)
+			return 0;
+	}
+
+	if (fstat(fd, &st) == -1)
+		goto fail;
+	/* A new cache is all zeroes, which is a valid empty table. Concurrent
+	 * creators extend it to the same size and write the same header. */
+	if (st.st_size == 0 && ftruncate(fd, XDG_SHARED_SIZE) == -1)
+		goto fail;
+	else if (st.st_size != 0 && (size_t)st.st_size != XDG_SHARED_SIZE)
+	{
+		errno = EINVAL;
+		goto fail;
+	}
+	if ((base = mmap(NULL, XDG_SHARED_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		goto fail;
+	if (!(shared = (xdgSharedCache*)malloc(sizeof(xdgSharedCache))))
+	{
+		munmap(base, XDG_SHARED_SIZE);
+		errno = ENOMEM;
+		goto fail;
+	}
+	if (ownfd != -1)
+		close(ownfd);
+
+	shared->header = (xdgSharedHeader*)base;
+	shared->slots = (xdgSharedSlot*)(shared->header + 1);
+	shared->size = XDG_SHARED_SIZE;
+	shared->ttl = ttl;
+	shared->references = 1;
+	shared->origin.fd = ownfd != -1 ? -1 : fd;
+	shared->origin.ttl = ttl;
+	shared->origin.device = st.st_dev;
+	shared->origin.inode = st.st_ino;
+#ifdef XDG_SHARED_WATCH
+	pthread_mutex_init(&shared->mutex, 0);
+	shared->inotify = -1;
+	memset(shared->watched, 0, sizeof(shared->watched));
+	shared->watchedCount = 0;
+#endif
+	if (__atomic_load_n(&shared->header->magic, __ATOMIC_ACQUIRE) != XDG_SHARED_MAGIC)
+	{
+		shared->header->slotCount = XDG_SHARED_SLOTS;
+		shared->header->slotSize = sizeof(xdgSharedSlot);
+		__atomic_store_n(&shared->header->magic, XDG_SHARED_MAGIC, __ATOMIC_RELEASE);
+	}
+	else if (shared->header->slotCount != XDG_SHARED_SLOTS || shared->header->slotSize != sizeof(xdgSharedSlot))
+	{
+		xdgSharedCacheUnmap(shared);
+		errno = EINVAL;
+		return 0;
+	}
+	return shared;
+
+fail:
+	err = errno;
+	if (ownfd != -1)
+		close(ownfd);
+	errno = err;
+	return 0;
+#else
+	errno = ENOSYS;
+	return 0;
+#endif
+}
+
+xdgSharedCache * xdgSharedCacheRetain(xdgSharedCache *shared)
+{
+#if defined(__GNUC__)
+	__atomic_add_fetch(&shared->references, 1, __ATOMIC_RELAXED);
+#endif
+	return shared;
+}
+
+void xdgSharedCacheGetOrigin(xdgSharedCache *shared, xdgSharedCacheOrigin *origin)
+{
+	*origin = shared->origin;
+}
+
+void xdgSharedCacheUnmap(xdgSharedCache *shared)
+{
+#if defined(__GNUC__)
+	if (__atomic_sub_fetch(&shared->references, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+#endif
+#ifdef XDG_SHARED_WATCH
+	xdgStopSharedWatcher(shared);
+	pthread_mutex_destroy(&shared->mutex);
+#endif
+	munmap(shared->header, shared->size);
+	free(shared);
+}
+
+#if defined(__GNUC__)
+
+/** Hash of a fingerprint and relative path, never 0. */
+static unsigned long long xdgSharedKey(unsigned long long fingerprint, const char *relativePath, size_t length)
+{
+	unsigned long long key = xdgHashBytes(fingerprint, relativePath, length);
+	return key ? key : 1;
+}
+
+int xdgSharedCacheWatch(xdgSharedCache *shared, const char *path, size_t baseLength, size_t parentLength)
+{
+#ifdef XDG_SHARED_WATCH
+	unsigned long long hash = xdgHashBytes(XDG_HASH_INIT, path, parentLength);
+	unsigned int entry;
+	char *directory;
+	size_t length;
+	int watched = 0, result = -1;
+
+	hash += !hash;
+	pthread_mutex_lock(&shared->mutex);
+	for (entry = hash & (XDG_SHARED_WATCHES - 1); shared->watched[entry]; entry = (entry + 1) & (XDG_SHARED_WATCHES - 1))
+	{
+		if (shared->watched[entry] == hash)
+		{
+			pthread_mutex_unlock(&shared->mutex);
+			return 1;
+		}
+	}
+	if (shared->watchedCount >= XDG_SHARED_WATCHES / 4 * 3 || !xdgStartSharedWatcher(shared) ||
+		!(directory = (char*)malloc(parentLength + 1)))
+		goto done;
+	memcpy(directory, path, parentLength);
+	/* Watch every directory from the parent up to the base directory, or
+	 * up to the nearest existing ancestor of a missing base directory, so
+	 * that renaming any of them and creating missing ones is noticed. */
+	for (length = parentLength; ; )
+	{
+		directory[length] = 0;
+		if (inotify_add_watch(shared->inotify, length ? directory : "/", XDG_SHARED_EVENTS) != -1)
+			watched = 1;
+		else if (errno != ENOENT && errno != ENOTDIR)
+		{
+			watched = 0;
+			break;
+		}
+		if ((watched && length <= baseLength) || length == 0)
+			break;
+		do --length; while (length > 0 && directory[length] != '/');
+	}
+	free(directory);
+	if (watched)
+	{
+		shared->watched[entry] = hash;
+		shared->watchedCount++;
+		result = 0;
+	}
+done:
+	pthread_mutex_unlock(&shared->mutex);
+	return result;
+#else
+	return 1;
+#endif
+}
+
+unsigned long long xdgSharedCacheGeneration(xdgSharedCache *shared)
+{
+	return __atomic_load_n(&shared->header->generation, __ATOMIC_ACQUIRE);
+}
+
+int xdgSharedCacheLookup(xdgSharedCache *shared, unsigned long long fingerprint,
+	const char *relativePath, size_t length, unsigned long long *known, unsigned long long *present)
+{
+	unsigned long long key, generation;
+	xdgSharedSlot *slot;
+	xdgSharedSlot copy;
+	unsigned int probe, sequence;
+	long long now;
+
+	if (length >= XDG_SHARED_PATH_MAX)
+		return 0;
+	key = xdgSharedKey(fingerprint, relativePath, length);
+	generation = __atomic_load_n(&shared->header->generation, __ATOMIC_ACQUIRE);
+	now = time(NULL);
+	for (probe = 0; probe < XDG_SHARED_PROBES; ++probe)
+	{
+		slot = &shared->slots[(key + probe) & (XDG_SHARED_SLOTS - 1)];
+		sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		if ((sequence & 1) || __atomic_load_n(&slot->key, __ATOMIC_RELAXED) != key)
+			continue;
+		memcpy(&copy, slot, sizeof(xdgSharedSlot));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence)
+			continue;
+		if (copy.key != key || copy.fingerprint != fingerprint || copy.pathLength != length ||
+			memcmp(copy.path, relativePath, length) != 0)
+			continue;
+		if (copy.generation != generation ||
+			now - copy.stamp >= shared->ttl || now < copy.stamp)
+			return 0;
+		*known = copy.known;
+		*present = copy.present;
+		return 1;
+	}
+	return 0;
+}
+
+void xdgSharedCacheStore(xdgSharedCache *shared, unsigned long long fingerprint, unsigned long long generation,
+	const char *relativePath, size_t length, unsigned long long known, unsigned long long present)
+{
+	unsigned long long key;
+	xdgSharedSlot *slot, *victim = 0;
+	unsigned int probe, sequence;
+
+	/* A result probed while a directory changed would never be valid. */
+	if (length >= XDG_SHARED_PATH_MAX || generation != xdgSharedCacheGeneration(shared))
+		return;
+	key = xdgSharedKey(fingerprint, relativePath, length);
+	/* Reuse the slot of the same key, else an empty slot, else the oldest. */
+	for (probe = 0; probe < XDG_SHARED_PROBES; ++probe)
+	{
+		slot = &shared->slots[(key + probe) & (XDG_SHARED_SLOTS - 1)];
+		if (__atomic_load_n(&slot->key, __ATOMIC_RELAXED) == key)
+		{
+			victim = slot;
+			break;
+		}
+		if (!victim || (victim->key && (!slot->key || slot->stamp < victim->stamp)))
+			victim = slot;
+	}
+
+	sequence = __atomic_load_n(&victim->sequence, __ATOMIC_RELAXED);
+	if ((sequence & 1) || !__atomic_compare_exchange_n(&victim->sequence, &sequence, sequence + 1,
+			0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+	victim->key = key;
+	victim->fingerprint = fingerprint;
+	victim->generation = generation;
+	victim->stamp = time(NULL);
+	victim->known = known;
+	victim->present = present;
+	victim->pathLength = length;
+	memcpy(victim->path, relativePath, length);
+	__atomic_store_n(&victim->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+void xdgSharedCacheInvalidate(xdgSharedCache *shared)
+{
+	__atomic_add_fetch(&shared->header->generation, 1, __ATOMIC_RELEASE);
+}
+
+#else
+
+int xdgSharedCacheWatch(xdgSharedCache *shared, const char *path, size_t baseLength, size_t parentLength)
+{
+	return -1;
+}
+
+unsigned long long xdgSharedCacheGeneration(xdgSharedCache *shared)
+{
+	return 0;
+}
+
+int xdgSharedCacheLookup(xdgSharedCache *shared, unsigned long long fingerprint,
+	const char *relativePath, size_t length, unsigned long long *known, unsigned long long *present)
+{
+	return 0;
+}
+
+void xdgSharedCacheStore(xdgSharedCache *shared, unsigned long long fingerprint, unsigned long long generation,
+	const char *relativePath, size_t length, unsigned long long known, unsigned long long present)
+{
+}
+
+void xdgSharedCacheInvalidate(xdgSharedCache *shared)
+{
+}
+
+#endif
@@ -0,0 +1,450 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file basedir_watch.c
+  * @brief Notifications of changes to the effective data and config files.
+  *
+  * Every location of a watched path gets an inotify watch on its parent
+  * directory, or on the nearest ancestor that exists, so that the creation
+  * of missing directories is noticed as well. Events only mark the watches
+  * of their directory; dispatching then re-arms those watches, looks up the
+  * effective file again and calls back only if its identity changed. */
+
+#if defined(HAVE_CONFIG_H) || defined(_DOXYGEN)
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_INOTIFY_INIT1)
+#  include <sys/inotify.h>
+#  define XDG_HAVE_INOTIFY 1
+#endif
+
+#include <basedir.h>
+#include <basedir_watch.h>
+#include "basedir_private.h"
+
+#ifdef XDG_HAVE_INOTIFY
+
+/** Events which may change the effective file below a directory. */
+#define XDG_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | \
+	IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/** A watched relative path. */
+typedef struct _xdgWatch
+{
+	int id;
+	char * relativePath;
+	/** Searchable directories with trailing separators, NULL-terminated. */
+	char ** prefixes;
+	unsigned int count;
+	/** Inotify watch of every location, -1 if there is none. */
+	int * wds;
+	xdgWatchCallback callback;
+	void * userData;
+	/** Whether an event arrived for one of the watches. */
+	int dirty;
+	/** Index of the effective file in prefixes, -1 if there is none. */
+	int effective;
+	/** Identity of the effective file. */
+	dev_t device;
+	ino_t inode;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+} xdgWatch;
+
+typedef struct _xdgWatcherData
+{
+	int fd;
+	xdgWatch ** watches;
+	unsigned int count;
+	unsigned int capacity;
+	int nextId;
+	/** Whether callbacks are running, in which case removed watches are
+	 * only marked and freed after dispatching. */
+	int dispatching;
+} xdgWatcherData;
+
+/** Compose the path of a location of a watch. */
+static char * xdgWatchPath(xdgWatch *watch, unsigned int i)
+{
+	size_t prefixLength = strlen(watch->prefixes[i]);
+	size_t relativeLength = strlen(watch->relativePath);
+	char * path = (char*)malloc(prefixLength + relativeLength + 1);
+	if (!path) return 0;
+	memcpy(path, watch->prefixes[i], prefixLength);
+	memcpy(path + prefixLength, watch->relativePath, relativeLength + 1);
+	return path;
+}
+
+/** Whether a watch descriptor is used by any watch of a watcher. */
+static int xdgIsWatchDescriptorUsed(xdgWatcherData *data, int wd)
+{
+	unsigned int i, j;
+	for (i = 0; i < data->count; ++i)
+		for (j = 0; j < data->watches[i]->count; ++j)
+			if (data->watches[i]->wds[j] == wd)
+				return 1;
+	return 0;
+}
+
+/** Watch the parent directory of every location of a watch, or the nearest
+ * ancestor which exists, and remove watches which are no longer used. */
+static void xdgArmWatch(xdgWatcherData *data, xdgWatch *watch)
+{
+	unsigned int i;
+	int old;
+	char * path;
+	char * sep;
+
+	for (i = 0; i < watch->count; ++i)
+	{
+		old = watch->wds[i];
+		watch->wds[i] = -1;
+		if ((path = xdgWatchPath(watch, i)))
+		{
+			while ((sep = strrchr(path, '/')))
+			{
+				sep[sep == path] = 0;
+				if ((watch->wds[i] = inotify_add_watch(data->fd, path, XDG_WATCH_MASK)) != -1 ||
+					(errno != ENOENT && errno != ENOTDIR) || sep == path)
+					break;
+			}
+			free(path);
+		}
+		if (old != -1 && old != watch->wds[i] && !xdgIsWatchDescriptorUsed(data, old))
+			inotify_rm_watch(data->fd, old);
+	}
+}
+
+/** Look up the effective file of a watch again.
+ * @param path Receives the path of the effective file if it changed, to
+ * 	be freed by the caller, or @c NULL if there is none.
+ * @return Non-zero if the effective file changed. */
+static int xdgEvaluateWatch(xdgWatch *watch, char **path)
+{
+	struct stat st;
+	unsigned int i;
+	int changed;
+
+	*path = 0;
+	for (i = 0; i < watch->count; ++i)
+	{
+		if (!(*path = xdgWatchPath(watch, i)))
+			continue;
+		if (stat(*path, &st) == 0 && !S_ISDIR(st.st_mode))
+			break;
+		free(*path);
+		*path = 0;
+	}
+	if (i == watch->count)
+	{
+		changed = watch->effective != -1;
+		watch->effective = -1;
+		return changed;
+	}
+	changed = watch->effective != (int)i || st.st_dev != watch->device || st.st_ino != watch->inode ||
+		st.st_size != watch->size ||
+		st.st_mtim.tv_sec != watch->mtime.tv_sec || st.st_mtim.tv_nsec != watch->mtime.tv_nsec ||
+		st.st_ctim.tv_sec != watch->ctime.tv_sec || st.st_ctim.tv_nsec != watch->ctime.tv_nsec;
+	watch->effective = i;
+	watch->device = st.st_dev;
+	watch->inode = st.st_ino;
+	watch->size = st.st_size;
+	watch->mtime = st.st_mtim;
+	watch->ctime = st.st_ctim;
+	if (!changed)
+	{
+		free(*path);
+		*path = 0;
+	}
+	return changed;
+}
+
+static void xdgFreeWatch(xdgWatch *watch)
+{
+	free(watch->prefixes);
+	free(watch);
+}
+
+/** Free the watches marked as removed, whose callback was cleared. */
+static void xdgCompactWatcher(xdgWatcherData *data)
+{
+	unsigned int i, j, count = data->count;
+	xdgWatch * watch;
+
+	/* Move the remaining watches to the front, keeping their order. */
+	for (i = data->count = 0; i < count; ++i)
+	{
+		watch = data->watches[i];
+		if (!watch->callback) continue;
+		data->watches[i] = data->watches[data->count];
+		data->watches[data->count++] = watch;
+	}
+	for (i = data->count; i < count; ++i)
+	{
+		watch = data->watches[i];
+		for (j = 0; j < watch->count; ++j)
+			if (watch->wds[j] != -1 && !xdgIsWatchDescriptorUsed(data, watch->wds[j]))
+				inotify_rm_watch(data->fd, watch->wds[j]);
+		xdgFreeWatch(watch);
+	}
+}
+
+#endif
+
+xdgWatcher * xdgInitWatcher(xdgWatcher *watcher)
+{
+#ifdef XDG_HAVE_INOTIFY
+	xdgWatcherData * data;
+	if (!watcher) return 0;
+	if (!(data = (xdgWatcherData*)calloc(1, sizeof(xdgWatcherData))))
+	{
+		errno = ENOMEM;
+		return 0;
+	}
+	if ((data->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+	{
+		free(data);
+		return 0;
+	}
+	watcher->reserved = data;
+	return watcher;
+#else
+	errno = ENOSYS;
+	return 0;
+#endif
+}
+
+void xdgWipeWatcher(xdgWatcher *watcher)
+{
+#ifdef XDG_HAVE_INOTIFY
+	xdgWatcherData * data = (xdgWatcherData*)watcher->reserved;
+	unsigned int i;
+	for (i = 0; i < data->count; ++i)
+		xdgFreeWatch(data->watches[i]);
+	free(data->watches);
+	close(data->fd);
+	free(data);
+	watcher->reserved = 0;
+#endif
+}
+
+int xdgWatcherFd(xdgWatcher *watcher)
+{
+#ifdef XDG_HAVE_INOTIFY
+	return ((xdgWatcherData*)watcher->reserved)->fd;
+#else
+	return -1;
+#endif
+}
+
+int xdgDispatchWatcher(xdgWatcher *watcher)
+{
+#ifdef XDG_HAVE_INOTIFY
+	xdgWatcherData * data = (xdgWatcherData*)watcher->reserved;
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event * event;
+	unsigned int i, j;
+	ssize_t got;
+	char * path;
+	xdgWatch * watch;
+	int called = 0;
+
+	for (;;)
+	{
+		if ((got = read(data->fd, buffer, sizeof(buffer))) == -1)
+		{
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+			return -1;
+		}
+		for (event = (const struct inotify_event*)buffer; (const char*)event < buffer + got;
+			event = (const struct inotify_event*)((const char*)event + sizeof(struct inotify_event) + event->len))
+		{
+			for (i = 0; i < data->count; ++i)
+				for (j = 0; j < data->watches[i]->count; ++j)
+					if ((event->mask & IN_Q_OVERFLOW) || data->watches[i]->wds[j] == event->wd)
+					{
+						data->watches[i]->dirty = 1;
+						/* The kernel already removed the watch. */
+						if (event->mask & IN_IGNORED)
+							data->watches[i]->wds[j] = -1;
+					}
+		}
+	}
+
+	data->dispatching = 1;
+	for (i = 0; i < data->count; ++i)
+	{
+		watch = data->watches[i];
+		if (!watch->dirty || !watch->callback)
+			continue;
+		watch->dirty = 0;
+		xdgArmWatch(data, watch);
+		if (xdgEvaluateWatch(watch, &path))
+		{
+			watch->callback(watch->relativePath, path, watch->userData);
+			free(path);
+			++called;
+		}
+	}
+	data->dispatching = 0;
+	xdgCompactWatcher(data);
+	return called;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/** Free a directory list returned for a @c NULL handle. */
+static void xdgFreeDirectories(const char * const * dirs)
+{
+	const char * const * item;
+	for (item = dirs; *item; ++item)
+		free((char*)*item);
+	free((char**)dirs);
+}
+
+/** Add a watch for a relative path in a list of searchable directories. */
+static int xdgAddWatch(const char *relativePath, xdgWatchCallback callback, void *userData,
+	xdgWatcher *watcher, const char * const * dirs)
+{
+#ifdef XDG_HAVE_INOTIFY
+	xdgWatcherData * data = (xdgWatcherData*)watcher->reserved;
+	xdgWatch * watch;
+	xdgWatch ** watches;
+	size_t size, length;
+	unsigned int i, count;
+	char * strings;
+	char * path;
+
+	for (count = 0, size = 0; dirs[count]; ++count)
+		size += strlen(dirs[count]) + 2;
+	size += strlen(relativePath) + 1;
+	/* The watch, prefixes, descriptors and strings share one allocation. */
+	if (!(watch = (xdgWatch*)malloc(sizeof(xdgWatch))) ||
+		!(watch->prefixes = (char**)malloc(sizeof(char*)*(count+1) + sizeof(int)*(count ? count : 1) + size)))
+	{
+		free(watch);
+		errno = ENOMEM;
+		return -1;
+	}
+	watch->wds = (int*)(watch->prefixes + count + 1);
+	strings = (char*)(watch->wds + (count ? count : 1));
+	for (i = 0; i < count; ++i)
+	{
+		length = strlen(dirs[i]);
+		watch->prefixes[i] = strings;
+		memcpy(strings, dirs[i], length);
+		if (length == 0 || strings[length-1] != '/')
+			strings[length++] = '/';
+		strings[length] = 0;
+		strings += length + 1;
+		watch->wds[i] = -1;
+	}
+	watch->prefixes[count] = 0;
+	while (*relativePath == '/') ++relativePath;
+	watch->relativePath = strings;
+	strcpy(strings, relativePath);
+	watch->count = count;
+	watch->callback = callback;
+	watch->userData = userData;
+	watch->dirty = 0;
+	watch->effective = -1;
+
+	if (data->count == data->capacity)
+	{
+		if (!(watches = (xdgWatch**)realloc(data->watches, sizeof(xdgWatch*)*(data->capacity ? data->capacity*2 : 8))))
+		{
+			xdgFreeWatch(watch);
+			errno = ENOMEM;
+			return -1;
+		}
+		data->watches = watches;
+		data->capacity = data->capacity ? data->capacity*2 : 8;
+	}
+	watch->id = data->nextId++;
+	data->watches[data->count++] = watch;
+	xdgArmWatch(data, watch);
+	/* Remember the current effective file without reporting it. */
+	xdgEvaluateWatch(watch, &path);
+	free(path);
+	return watch->id;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+int xdgWatchData(const char *relativePath, xdgWatchCallback callback, void *userData,
+	xdgWatcher *watcher, xdgHandle *handle)
+{
+	const char * const * dirs = xdgSearchableDataDirectories(handle);
+	int result;
+	if (!dirs) return -1;
+	result = xdgAddWatch(relativePath, callback, userData, watcher, dirs);
+	if (!handle) xdgFreeDirectories(dirs);
+	return result;
+}
+
+int xdgWatchConfig(const char *relativePath, xdgWatchCallback callback, void *userData,
+	xdgWatcher *watcher, xdgHandle *handle)
+{
+	const char * const * dirs = xdgSearchableConfigDirectories(handle);
+	int result;
+	if (!dirs) return -1;
+	result = xdgAddWatch(relativePath, callback, userData, watcher, dirs);
+	if (!handle) xdgFreeDirectories(dirs);
+	return result;
+}
+
+int xdgUnwatch(xdgWatcher *watcher, int id)
+{
+#ifdef XDG_HAVE_INOTIFY
+	xdgWatcherData * data = (xdgWatcherData*)watcher->reserved;
+	unsigned int i;
+	for (i = 0; i < data->count; ++i)
+	{
+		if (data->watches[i]->id != id || !data->watches[i]->callback)
+			continue;
+		/* Freed after dispatching if a callback removes a watch. */
+		data->watches[i]->callback = 0;
+		if (!data->dispatching)
+			xdgCompactWatcher(data);
+		return 0;
+	}
+	errno = EINVAL;
+	return -1;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
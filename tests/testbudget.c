@@ -0,0 +1,363 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Counts the calls into the C library made by public functions, to catch
+ * changes which make lookups do more system calls or allocations.
+ *
+ * The wrappers below interpose the C library functions which issue system
+ * calls or allocate, and are only counted while a case is measured. Each
+ * case runs against a synthetic tree created in testbudget.d. Without
+ * arguments the counts are printed in the format of the budgets file;
+ * with a budgets file the program fails if any count exceeds its budget. */
+
+#undef _FORTIFY_SOURCE
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <basedir.h>
+#include <basedir_fs.h>
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 33)
+int main(void)
+{
+	/* Interposing stat() and malloc() needs glibc 2.33 or newer. */
+	return 77;
+}
+#else
+
+#define ROOT "testbudget.d"
+
+static int counting = 0;
+static unsigned int syscalls = 0;
+static unsigned int allocations = 0;
+
+#define NEXT(name) ((__typeof__(&name))dlsym(RTLD_NEXT, #name))
+#define COUNT() (syscalls += counting)
+
+int open(const char *path, int flags, ...)
+{
+	va_list args;
+	mode_t mode;
+	va_start(args, flags);
+	mode = va_arg(args, mode_t);
+	va_end(args);
+	COUNT();
+	return NEXT(open)(path, flags, mode);
+}
+
+int openat(int dirfd, const char *path, int flags, ...)
+{
+	va_list args;
+	mode_t mode;
+	va_start(args, flags);
+	mode = va_arg(args, mode_t);
+	va_end(args);
+	COUNT();
+	return NEXT(openat)(dirfd, path, flags, mode);
+}
+
+FILE * fopen(const char *path, const char *mode) { COUNT(); return NEXT(fopen)(path, mode); }
+int fclose(FILE *file) { COUNT(); return NEXT(fclose)(file); }
+int close(int fd) { COUNT(); return NEXT(close)(fd); }
+int stat(const char *path, struct stat *st) { COUNT(); return NEXT(stat)(path, st); }
+int lstat(const char *path, struct stat *st) { COUNT(); return NEXT(lstat)(path, st); }
+int fstat(int fd, struct stat *st) { COUNT(); return NEXT(fstat)(fd, st); }
+int access(const char *path, int mode) { COUNT(); return NEXT(access)(path, mode); }
+int faccessat(int dirfd, const char *path, int mode, int flags) { COUNT(); return NEXT(faccessat)(dirfd, path, mode, flags); }
+int mkdir(const char *path, mode_t mode) { COUNT(); return NEXT(mkdir)(path, mode); }
+ssize_t read(int fd, void *buffer, size_t size) { COUNT(); return NEXT(read)(fd, buffer, size); }
+ssize_t write(int fd, const void *buffer, size_t size) { COUNT(); return NEXT(write)(fd, buffer, size); }
+ssize_t readlink(const char *path, char *buffer, size_t size) { COUNT(); return NEXT(readlink)(path, buffer, size); }
+int rename(const char *from, const char *to) { COUNT(); return NEXT(rename)(from, to); }
+int unlink(const char *path) { COUNT(); return NEXT(unlink)(path); }
+int fsync(int fd) { COUNT(); return NEXT(fsync)(fd); }
+DIR * opendir(const char *path) { COUNT(); return NEXT(opendir)(path); }
+struct dirent * readdir(DIR *dir) { COUNT(); return NEXT(readdir)(dir); }
+int closedir(DIR *dir) { COUNT(); return NEXT(closedir)(dir); }
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void *ptr, size_t size);
+
+void * malloc(size_t size) { allocations += counting; return __libc_malloc(size); }
+void * calloc(size_t count, size_t size) { allocations += counting; return __libc_calloc(count, size); }
+void * realloc(void *ptr, size_t size) { allocations += counting; return __libc_realloc(ptr, size); }
+
+static void begin(void)
+{
+	syscalls = allocations = 0;
+	counting = 1;
+}
+
+static void end(void)
+{
+	counting = 0;
+}
+
+static void makeFile(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (!file) exit(99);
+	fclose(file);
+}
+
+/** Set a variable to a list of directories of the synthetic tree. */
+static void setEnvironment(const char *name, const char *cwd, ...)
+{
+	char value[16384];
+	const char *dir;
+	size_t length = 0;
+	va_list args;
+
+	va_start(args, cwd);
+	while ((dir = va_arg(args, const char *)) && length + strlen(cwd) + strlen(dir) + 32 < sizeof(value))
+		length += sprintf(value + length, "%s%s/" ROOT "/%s", length ? ":" : "", cwd, dir);
+	va_end(args);
+	setenv(name, value, 1);
+}
+
+/** Create the synthetic tree and point the environment at it. */
+static void setup(void)
+{
+	static const char * const dirs[] = {
+		"home", "data-home", "data1", "data2", "data3", "data3/app",
+		"config-home", "config1", "config2", "config2/app", "cache", 0 };
+	char cwd[4096], path[64];
+	unsigned int i;
+
+	if (system("rm -rf " ROOT) == -1 || mkdir(ROOT, 0700) == -1 || !getcwd(cwd, sizeof(cwd)))
+		exit(99);
+	for (i = 0; dirs[i]; ++i)
+	{
+		snprintf(path, sizeof(path), ROOT "/%s", dirs[i]);
+		if (mkdir(path, 0700) == -1) exit(99);
+	}
+	makeFile(ROOT "/data3/app/file");
+	makeFile(ROOT "/config2/app/rc");
+	makeFile(ROOT "/config2/app/prefetched");
+
+	setEnvironment("HOME", cwd, "home", (char*)0);
+	setEnvironment("XDG_DATA_HOME", cwd, "data-home", (char*)0);
+	setEnvironment("XDG_DATA_DIRS", cwd, "data1", "data2", "data3", (char*)0);
+	setEnvironment("XDG_CONFIG_HOME", cwd, "config-home", (char*)0);
+	setEnvironment("XDG_CONFIG_DIRS", cwd, "config1", "config2", (char*)0);
+	setEnvironment("XDG_CACHE_HOME", cwd, "cache", (char*)0);
+	unsetenv("XDG_BASEDIR_PROFILE");
+}
+
+/** Look up the budget of a case.
+ * @return Non-zero if the case was found. */
+static int getBudget(FILE *budgets, const char *name, unsigned int *maxSyscalls, unsigned int *maxAllocations)
+{
+	char line[256], caseName[128];
+	rewind(budgets);
+	while (fgets(line, sizeof(line), budgets))
+	{
+		if (line[0] == '#') continue;
+		if (sscanf(line, "%127s %u %u", caseName, maxSyscalls, maxAllocations) == 3 &&
+			strcmp(caseName, name) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static FILE *budgets = 0;
+static int failed = 0;
+
+/** Compare the counts of the case just measured to its budget, or print them. */
+static void check(const char *name)
+{
+	unsigned int maxSyscalls, maxAllocations;
+	if (!budgets)
+		printf("%s %u %u\n", name, syscalls, allocations);
+	else if (!getBudget(budgets, name, &maxSyscalls, &maxAllocations))
+	{
+		printf("%s: no budget\n", name);
+		failed = 1;
+	}
+	else if (syscalls > maxSyscalls || allocations > maxAllocations)
+	{
+		printf("%s: %u syscalls, %u allocations exceed budget of %u, %u\n",
+			name, syscalls, allocations, maxSyscalls, maxAllocations);
+		failed = 1;
+	}
+}
+
+static void measureHandle(const char *suffix, xdgHandle *handle)
+{
+	char name[64];
+	char *result;
+	FILE *file;
+
+#define MEASURE(caseName, code) \
+	begin(); code; end(); \
+	sprintf(name, "%s%s", caseName, suffix); \
+	check(name)
+
+	MEASURE("xdgDataFind.hit", result = xdgDataFind("app/file", handle));
+	free(result);
+	MEASURE("xdgDataFind.miss", result = xdgDataFind("app/missing", handle));
+	free(result);
+	MEASURE("xdgConfigOpen.hit", file = xdgConfigOpen("app/rc", "r", handle));
+	if (file) fclose(file);
+	MEASURE("xdgConfigOpen.miss", file = xdgConfigOpen("app/missing", "r", handle));
+	if (file) fclose(file);
+#undef MEASURE
+}
+
+#define MEASURE_LISTING(caseName, relativePath) \
+	begin(); result = xdgDataFind(relativePath, &handle); end(); \
+	free(result); \
+	check(caseName)
+
+int main(int argc, char *argv[])
+{
+	static const char * const matrixPaths[] = { "app/file", "app/missing", "app/rc" };
+	static const char * const prefetchPaths[] = { "app/prefetched" };
+	xdgHandle handle, other;
+	xdgProbeMatrix matrix;
+	char *result, number[16];
+	FILE *file;
+	int fd;
+
+	if (argc > 2)
+		return 99;
+	if (argc == 2 && !(budgets = fopen(argv[1], "r")))
+	{
+		perror(argv[1]);
+		return 99;
+	}
+	setup();
+
+	begin();
+	if (!xdgInitHandle(&handle)) return 99;
+	end();
+	check("xdgInitHandle");
+	begin();
+	if (!xdgUpdateData(&handle)) return 99;
+	end();
+	check("xdgUpdateData");
+	measureHandle("", &handle);
+	xdgWipeHandle(&handle);
+
+	if (!xdgInitHandleWithFlags(&handle, XDG_HANDLE_DIRECTORY_FDS)) return 99;
+	measureHandle(".fds", &handle);
+	xdgWipeHandle(&handle);
+
+	measureHandle(".null", NULL);
+
+	begin();
+	if (!xdgInitHandleWithFlags(&handle, XDG_HANDLE_LAZY)) return 99;
+	end();
+	check("xdgInitHandle.lazy");
+	begin();
+	if (!xdgConfigHome(&handle)) return 99;
+	end();
+	check("xdgConfigHome.lazy");
+	xdgWipeHandle(&handle);
+
+	/* A snapshot inherited through the environment is used instead of
+	 * parsing the variables while they are unchanged. */
+	if (!xdgInitHandle(&handle) || (fd = xdgExportHandleFd(&handle)) == -1) return 99;
+	xdgWipeHandle(&handle);
+	snprintf(number, sizeof(number), "%d", fd);
+	setenv(XDG_HANDLE_FD_VARIABLE, number, 1);
+	begin();
+	if (!xdgInitHandle(&handle)) return 99;
+	end();
+	check("xdgInitHandle.inherited");
+	xdgWipeHandle(&handle);
+	unsetenv(XDG_HANDLE_FD_VARIABLE);
+	close(fd);
+
+	/* Listings are compared to the directories at most once per second,
+	 * so the budget allows for one comparison. */
+	if (!xdgInitHandle(&handle) || xdgDataCacheListing("app", &handle) != 0) return 99;
+	free(xdgDataFind("app/file", &handle));
+	MEASURE_LISTING("xdgDataFind.hit.listing", "app/file");
+	MEASURE_LISTING("xdgDataFind.miss.listing", "app/missing");
+	xdgWipeHandle(&handle);
+
+	/* Each parent directory is read once per data directory, whatever
+	 * the number of paths in it. */
+	if (!xdgInitHandle(&handle)) return 99;
+	begin();
+	if (xdgDataProbeMatrix(matrixPaths, 3, &matrix, &handle) != 0) return 99;
+	end();
+	xdgFreeProbeMatrix(&matrix);
+	check("xdgDataProbeMatrix");
+	xdgWipeHandle(&handle);
+
+	/* Published results are used without any system call once the parent
+	 * of the path in each directory is watched. */
+	if ((fd = xdgCreateSharedCache()) == -1 || !xdgInitHandle(&handle) ||
+		xdgAttachSharedCache(&handle, fd, 60) != 0)
+		return 99;
+	usleep(100000);
+	free(xdgDataFind("app/file", &handle));
+	MEASURE_LISTING("xdgDataFind.hit.shared", "app/file");
+	if ((file = xdgConfigOpen("app/rc", "r", &handle))) fclose(file);
+	begin();
+	file = xdgConfigOpen("app/rc", "r", &handle);
+	end();
+	if (!file) return 99;
+	fclose(file);
+	check("xdgConfigOpen.hit.shared");
+
+	/* Results published by a prefetch of another handle are used the same. */
+	if (!xdgInitHandle(&other) || xdgAttachSharedCache(&other, fd, 60) != 0 ||
+		xdgConfigPrefetch(prefetchPaths, 1, &other) != 0)
+		return 99;
+	xdgWipeHandle(&other);
+	usleep(500000);
+	begin();
+	file = xdgConfigOpen("app/prefetched", "r", &handle);
+	end();
+	if (!file) return 99;
+	fclose(file);
+	check("xdgConfigOpen.prefetched");
+	xdgWipeHandle(&handle);
+	close(fd);
+
+	begin();
+	if (xdgMakePath(ROOT "/made/a/b/c", 0700) == -1) return 99;
+	end();
+	check("xdgMakePath");
+
+	if (budgets) fclose(budgets);
+	return failed;
+}
+
+#endif
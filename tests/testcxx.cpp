@@ -0,0 +1,69 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Checks that the C++20 lookups of basedir.hpp compile and find the same
+ * files as the functions they wrap. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <basedir.h>
+#include <basedir.hpp>
+
+/** Compare two lists of strings as returned by the find functions, freeing both. */
+static bool sameStrings(char *first, char *second)
+{
+	bool same = first && second;
+	const char *a = first, *b = second;
+	for (; same && (*a || *b); a += std::strlen(a) + 1, b += std::strlen(b) + 1)
+		same = std::strcmp(a, b) == 0;
+	std::free(first);
+	std::free(second);
+	return same;
+}
+
+/** Check that two lookups both opened a file or both failed, closing the files. */
+static bool sameFile(FILE *first, FILE *second)
+{
+	bool same = !first == !second;
+	if (first) std::fclose(first);
+	if (second) std::fclose(second);
+	return same;
+}
+
+int main()
+{
+	xdgHandle handle;
+	bool ok = true;
+	if (!xdgInitHandle(&handle))
+		return 99;
+	ok = sameStrings(xdg::data_find<"applications">(&handle), xdgDataFind("applications", &handle)) && ok;
+	ok = sameStrings(xdg::config_find<"user-dirs.dirs">(&handle), xdgConfigFind("user-dirs.dirs", &handle)) && ok;
+	ok = sameFile(xdg::data_open<"missing/file">(&handle), xdgDataOpen("missing/file", "r", &handle)) && ok;
+	ok = sameFile(xdg::config_open<"missing/file">(&handle), xdgConfigOpen("missing/file", "r", &handle)) && ok;
+	xdgWipeHandle(&handle);
+	if (!ok)
+		std::printf("basedir.hpp: lookups differ from the C functions\n");
+	return !ok;
+}
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <basedir_fs.h>
 
 void printAndFreeStrings(char * strings)
@@ -39,10 +40,43 @@ void printAndFreeStrings(char * strings)
 	free(strings);
 }
 
+/* Prints the average time in microseconds of opening a file for reading
+ * with handles opening one directory after another and all at once. */
+int timeOpen(const char * type, const char * relativePath, unsigned int count)
+{
+	static const unsigned int flags[] = { 0, XDG_HANDLE_PARALLEL_OPEN };
+	static const char * const names[] = { "sequential", "parallel" };
+	xdgHandle handle;
+	struct timespec start, end;
+	unsigned int i, j;
+	int config = strcmp(type, "--config") == 0;
+	FILE * file;
+
+	if (!config && strcmp(type, "--data") != 0)
+		return 2;
+	for (i = 0; i < 2; ++i)
+	{
+		if (!xdgInitHandleWithFlags(&handle, flags[i])) return 1;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (j = 0; j < count; ++j)
+		{
+			file = config ? xdgConfigOpen(relativePath, "r", &handle) : xdgDataOpen(relativePath, "r", &handle);
+			if (file) fclose(file);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		xdgWipeHandle(&handle);
+		printf("%s: %.2f us\n", names[i],
+			((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e3 / (count ? count : 1));
+	}
+	return 0;
+}
+
 int main(int argc, char* argv[])
 {
 	int ret = 0;
 	xdgHandle handle;
+	if (argc == 5 && strcmp(argv[1], "--time") == 0)
+		return timeOpen(argv[2], argv[4], (unsigned int)atoi(argv[3]));
 	if (!xdgInitHandle(&handle)) return 1;
 	if (argc == 2)
 	{
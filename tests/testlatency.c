@@ -0,0 +1,277 @@
+/* Copyright (c) 2007 Mark Nevill
+ * 
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Checks that lookups with a deadline do not wait for a stalled base
+ * directory on a slow filesystem.
+ *
+ * The wrappers below make directories of the synthetic tree in
+ * testlatency.d whose name contains "slow" look like NFS to statfs(), and
+ * make opening or accessing files in them hang while stalling is set, as
+ * an unresponsive server would. */
+
+#undef _FORTIFY_SOURCE
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <basedir.h>
+#include <basedir_fs.h>
+
+#define ROOT "testlatency.d"
+/** Size of the working directory buffer. */
+#define CWD_SIZE 4096
+/** Size of the buffers holding paths below the working directory. */
+#define VALUE_SIZE (2 * CWD_SIZE + 2 * sizeof(ROOT) + 16)
+/** Seconds a stalled call hangs, far longer than the deadline. */
+#define STALL_SECONDS 5
+/** Deadline of the lookups in milliseconds. */
+#define DEADLINE 200
+
+static volatile int stalling = 0;
+static int stalls = 0;
+
+#define STALLS() __atomic_load_n(&stalls, __ATOMIC_RELAXED)
+
+#define NEXT(name) ((__typeof__(&name))dlsym(RTLD_NEXT, #name))
+
+static void stall(const char *path)
+{
+	if (stalling && strstr(path, "/slow/"))
+	{
+		__atomic_add_fetch(&stalls, 1, __ATOMIC_RELAXED);
+		sleep(STALL_SECONDS);
+	}
+}
+
+int statfs(const char *path, struct statfs *st)
+{
+	int result = NEXT(statfs)(path, st);
+	if (result == 0 && strstr(path, "/slow"))
+		st->f_type = 0x6969; /* NFS */
+	return result;
+}
+
+int open(const char *path, int flags, ...)
+{
+	va_list args;
+	mode_t mode;
+	va_start(args, flags);
+	mode = va_arg(args, mode_t);
+	va_end(args);
+	stall(path);
+	return NEXT(open)(path, flags, mode);
+}
+
+int access(const char *path, int mode) { stall(path); return NEXT(access)(path, mode); }
+int faccessat(int dirfd, const char *path, int mode, int flags) { stall(path); return NEXT(faccessat)(dirfd, path, mode, flags); }
+DIR * opendir(const char *path) { stall(path); return NEXT(opendir)(path); }
+
+static void makeFile(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (!file) exit(99);
+	fclose(file);
+}
+
+/** Create the synthetic tree and point the environment at it. */
+static void setup(char *cwd)
+{
+	static const char * const dirs[] = { "home", "slow", "slow/app", "fast", "fast/app", 0 };
+	char path[64], value[VALUE_SIZE];
+	unsigned int i;
+
+	if (system("rm -rf " ROOT) == -1 || mkdir(ROOT, 0700) == -1 || !getcwd(cwd, CWD_SIZE))
+		exit(99);
+	for (i = 0; dirs[i]; ++i)
+	{
+		snprintf(path, sizeof(path), ROOT "/%s", dirs[i]);
+		if (mkdir(path, 0700) == -1) exit(99);
+	}
+	makeFile(ROOT "/slow/rc");
+	makeFile(ROOT "/fast/rc");
+	makeFile(ROOT "/fast/app/rc");
+
+	snprintf(value, sizeof(value), "%s/" ROOT "/home", cwd);
+	setenv("HOME", value, 1);
+	setenv("XDG_CONFIG_HOME", value, 1);
+	snprintf(value, sizeof(value), "%s/" ROOT "/slow:%s/" ROOT "/fast", cwd, cwd);
+	setenv("XDG_CONFIG_DIRS", value, 1);
+	unsetenv("XDG_BASEDIR_PROFILE");
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Fail if a lookup waited for the stalled directory. */
+static int timely(const char *name, double start)
+{
+	double elapsed = now() - start;
+	if (elapsed < STALL_SECONDS / 2.0)
+		return 1;
+	printf("%s: took %.3f seconds\n", name, elapsed);
+	return 0;
+}
+
+int main(void)
+{
+	char cwd[CWD_SIZE], expected[VALUE_SIZE];
+	xdgHandle handle;
+	xdgFileSet files;
+	char *found;
+	FILE *file;
+	struct stat opened, st;
+	double start;
+	unsigned int i;
+	int ok = 1;
+
+	setup(cwd);
+	if (!xdgInitHandle(&handle))
+		return 99;
+	if (xdgSetLookupDeadline(&handle, DEADLINE) != 0)
+		return errno == ENOSYS ? 77 : 99;
+	snprintf(expected, sizeof(expected), "%s/" ROOT "/fast/rc", cwd);
+	stalling = 1;
+
+	/* The slow directory is given up on and then demoted. */
+	start = now();
+	found = xdgConfigFind("rc", &handle);
+	ok = timely("xdgConfigFind", start) && ok;
+	if (!found || strcmp(found, expected) != 0 || found[strlen(found)+1] != 0)
+	{
+		printf("xdgConfigFind: unexpected result\n");
+		ok = 0;
+	}
+	free(found);
+	if (STALLS() != 1)
+	{
+		printf("xdgConfigFind: %d stalled probes\n", STALLS());
+		ok = 0;
+	}
+
+	/* Demoted directories are skipped without probing them. */
+	start = now();
+	file = xdgConfigOpen("rc", "r", &handle);
+	ok = timely("xdgConfigOpen", start) && ok;
+	if (!file)
+	{
+		printf("xdgConfigOpen: not found\n");
+		ok = 0;
+	}
+	else
+		fclose(file);
+	start = now();
+	if (xdgConfigReadAll("rc", XDG_READ_PRIORITY_ORDER, &files, &handle) != 0 ||
+		files.count != 1 || files.files[0].directory != 2)
+	{
+		printf("xdgConfigReadAll: unexpected result\n");
+		ok = 0;
+	}
+	else
+		xdgFreeFileSet(&files);
+	ok = timely("xdgConfigReadAll", start) && ok;
+	if (STALLS() != 1)
+	{
+		printf("demoted: %d stalled probes\n", STALLS());
+		ok = 0;
+	}
+
+	/* The deadline and classification survive an update, which also
+	 * forgets the demotion, so the directory is given up on again. */
+	if (!xdgUpdateData(&handle))
+		return 99;
+	start = now();
+	file = xdgConfigOpen("rc", "r", &handle);
+	ok = timely("xdgConfigOpen after update", start) && ok;
+	if (file) fclose(file);
+	if (STALLS() != 2)
+	{
+		printf("after update: %d stalled probes\n", STALLS());
+		ok = 0;
+	}
+
+	xdgWipeHandle(&handle);
+
+	/* Opening in every directory at once still gives up on the slow one. */
+	if (!xdgInitHandleWithFlags(&handle, XDG_HANDLE_PARALLEL_OPEN) || xdgSetLookupDeadline(&handle, DEADLINE) != 0)
+		return 99;
+	start = now();
+	file = xdgConfigOpen("rc", "r", &handle);
+	ok = timely("parallel xdgConfigOpen", start) && ok;
+	if (!file || fstat(fileno(file), &opened) != 0 || stat(expected, &st) != 0 || opened.st_ino != st.st_ino)
+	{
+		printf("parallel xdgConfigOpen: unexpected result\n");
+		ok = 0;
+	}
+	if (file) fclose(file);
+
+	/* Forgetting the demotion each time leaves more opens stalled than the
+	 * pool has threads, which must not hold up the other directories. */
+	for (i = 0; i < 6; ++i)
+	{
+		if (!xdgUpdateData(&handle))
+			return 99;
+		start = now();
+		file = xdgConfigOpen("rc", "r", &handle);
+		ok = timely("parallel xdgConfigOpen with a busy pool", start) && ok;
+		if (!file || fstat(fileno(file), &opened) != 0 || opened.st_ino != st.st_ino)
+		{
+			printf("parallel xdgConfigOpen with a busy pool: unexpected result\n");
+			ok = 0;
+		}
+		if (file) fclose(file);
+	}
+	xdgWipeHandle(&handle);
+
+	/* Cached listings leave out slow directories instead of reading them. */
+	if (!xdgInitHandle(&handle) || xdgSetLookupDeadline(&handle, DEADLINE) != 0 ||
+		xdgConfigCacheListing("app", &handle) != 0)
+		return 99;
+	start = now();
+	found = xdgConfigFind("app/rc", &handle);
+	ok = timely("xdgConfigFind with a listing", start) && ok;
+	if (!found || !strstr(found, "/fast/app/rc"))
+	{
+		printf("xdgConfigFind with a listing: unexpected result\n");
+		ok = 0;
+	}
+	free(found);
+	xdgWipeHandle(&handle);
+	return !ok;
+}
@@ -27,6 +27,12 @@
 #include <string.h>
 #include <basedir.h>
 #include <basedir_fs.h>
+#include <basedir_cache.h>
+#include <basedir_watch.h>
+#include <basedir_keyfile.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
 
 void printAndFreeString(const char *string)
 {
@@ -45,8 +51,610 @@ void printAndFreeStringList(const char * const *strings)
 	free((const char **)strings);
 }
 
+int printFileSet(int result, xdgFileSet *files)
+{
+	unsigned int i;
+	if (result != 0)
+		return 1;
+	for (i = 0; i < files->count; ++i)
+		printf("%u %lu\n", files->files[i].directory, (unsigned long)files->files[i].length);
+	xdgFreeFileSet(files);
+	return 0;
+}
+
+int writeAndFind(const char *relativePath, const char *contents)
+{
+	xdgWriteBatch batch;
+	if (!xdgInitWriteBatch(&batch))
+		return 1;
+	if (xdgConfigWriteAtomic(relativePath, contents, strlen(contents), &batch, NULL) != 0)
+	{
+		xdgWipeWriteBatch(&batch);
+		return 1;
+	}
+	if (xdgCommitWriteBatch(&batch) != 0)
+		return 1;
+	printAndFreeString(xdgConfigFind(relativePath, NULL));
+	return 0;
+}
+
+int storeAndGet(const char *name, const char *key, const char *value)
+{
+	xdgCacheStore store;
+	xdgCacheItem item;
+	if (!xdgCacheStoreOpen(&store, name, 0, 0, NULL))
+		return 1;
+	if (xdgCacheStorePut(&store, key, strlen(key), value, strlen(value)) != 0)
+	{
+		xdgCacheStoreClose(&store);
+		return 1;
+	}
+	xdgCacheStoreClose(&store);
+	/* Reopen so that the value is found through the index. */
+	if (!xdgCacheStoreOpen(&store, name, 0, 0, NULL))
+		return 1;
+	if (xdgCacheStoreGet(&store, key, strlen(key), &item) != 0)
+	{
+		xdgCacheStoreClose(&store);
+		return 1;
+	}
+	printf("%.*s\n", (int)item.size, (const char*)item.data);
+	xdgCacheStoreRelease(&item);
+	xdgCacheStoreClose(&store);
+	return 0;
+}
+
+/* Stores a value of 5 bytes under a key of one character; with the
+ * header of 8 bytes every value takes up 14 bytes in the store. */
+int putKey(xdgCacheStore *store, const char *key)
+{
+	return xdgCacheStorePut(store, key, 1, "value", 5) == 0;
+}
+
+/* Prints which of the keys, one character each, are in a store. */
+void printStoredKeys(xdgCacheStore *store, const char *keys)
+{
+	xdgCacheItem item;
+	for (; *keys; ++keys)
+	{
+		if (xdgCacheStoreGet(store, keys, 1, &item) != 0)
+			continue;
+		printf("%c\n", *keys);
+		xdgCacheStoreRelease(&item);
+	}
+}
+
+/* Runs part of a test in a child process which exits without closing the
+ * store it opens, so that its changes are only in the journal. */
+int crashAfter(const char *name, const char *removeKeys, const char *getKeys, const char *putKeys)
+{
+	xdgCacheStore store;
+	xdgCacheItem item;
+	pid_t child;
+	int status, ok;
+	fflush(stdout);
+	if ((child = fork()) == -1)
+		return 0;
+	if (child == 0)
+	{
+		ok = xdgCacheStoreOpen(&store, name, 0, 0, NULL) != 0;
+		for (; ok && *removeKeys; ++removeKeys)
+			ok = xdgCacheStoreRemove(&store, removeKeys, 1) == 0;
+		for (; ok && *getKeys; ++getKeys)
+		{
+			ok = xdgCacheStoreGet(&store, getKeys, 1, &item) == 0;
+			xdgCacheStoreRelease(&item);
+		}
+		for (; ok && *putKeys; ++putKeys)
+			ok = putKey(&store, putKeys);
+		_exit(!ok);
+	}
+	return waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* Fills a store beyond its budget after a value was read by a process which
+ * did not close the store, then evicts the rest in steps. */
+int storeOverBudget(const char *name)
+{
+	xdgCacheStore store;
+	if (!xdgCacheStoreOpen(&store, name, 0, 0, NULL) || !putKey(&store, "a"))
+		return 1;
+	sleep(1);
+	if (!putKey(&store, "b"))
+		return 1;
+	xdgCacheStoreClose(&store);
+	sleep(1);
+	if (!crashAfter(name, "", "a", ""))
+		return 1;
+	/* Two values fit, so adding a third evicts the least recently used. */
+	if (!xdgCacheStoreOpen(&store, name, 30, 0, NULL) || !putKey(&store, "c"))
+		return 1;
+	printStoredKeys(&store, "abc");
+	printf("%llu\n", xdgCacheStoreSize(&store));
+	xdgCacheStoreClose(&store);
+	if (!xdgCacheStoreOpen(&store, name, 1, 0, NULL))
+		return 1;
+	printf("%u\n", xdgCacheStoreEvict(&store, 1));
+	printf("%u\n", xdgCacheStoreEvict(&store, 10));
+	printf("%llu\n", xdgCacheStoreSize(&store));
+	xdgCacheStoreClose(&store);
+	return 0;
+}
+
+/* Lets values outlive the maximum age of a store. */
+int storeExpired(const char *name)
+{
+	xdgCacheStore store;
+	if (!xdgCacheStoreOpen(&store, name, 0, 1, NULL) || !putKey(&store, "a"))
+		return 1;
+	sleep(2);
+	if (!putKey(&store, "b"))
+		return 1;
+	printStoredKeys(&store, "ab");
+	sleep(2);
+	printf("%u\n", xdgCacheStoreEvict(&store, 10));
+	printf("%llu\n", xdgCacheStoreSize(&store));
+	xdgCacheStoreClose(&store);
+	return 0;
+}
+
+/* Reopens a store after a process changed it without closing it, and after
+ * its index was corrupted. */
+int storeRecovered(const char *name)
+{
+	xdgCacheStore store;
+	char path[4096];
+	FILE *index;
+	if (!xdgCacheStoreOpen(&store, name, 0, 0, NULL) || !putKey(&store, "a") || !putKey(&store, "b"))
+		return 1;
+	xdgCacheStoreClose(&store);
+	if (!crashAfter(name, "a", "", "c"))
+		return 1;
+	if (!xdgCacheStoreOpen(&store, name, 0, 0, NULL))
+		return 1;
+	printStoredKeys(&store, "abc");
+	printf("%llu\n", xdgCacheStoreSize(&store));
+	xdgCacheStoreClose(&store);
+
+	snprintf(path, sizeof(path), "%s/%s/index", getenv("XDG_CACHE_HOME"), name);
+	if (!(index = fopen(path, "w")))
+		return 1;
+	fputs("corrupt", index);
+	fclose(index);
+	if (!xdgCacheStoreOpen(&store, name, 0, 0, NULL))
+		return 1;
+	printStoredKeys(&store, "abc");
+	printf("%llu\n", xdgCacheStoreSize(&store));
+	xdgCacheStoreClose(&store);
+	return 0;
+}
+
+int searchFromEnv(char **environment)
+{
+	const char * const *first;
+	const char * const *second;
+	xdgHandlePool pool;
+	xdgHandle handles[2];
+	int shared = 1;
+	if (!xdgInitHandlePool(&pool))
+		return 1;
+	if (!xdgInitHandleFromEnv(&handles[0], (const char * const *)environment, 0, &pool))
+		return 1;
+	if (!xdgInitHandleFromEnv(&handles[1], (const char * const *)environment, 0, &pool))
+		return 1;
+	first = xdgSearchableDataDirectories(&handles[0]);
+	second = xdgSearchableDataDirectories(&handles[1]);
+	for (; *second; ++first, ++second)
+	{
+		printf("%s\n", *second);
+		shared = shared && *first == *second;
+	}
+	if (shared)
+		printf("shared\n");
+	if (xdgSearchableDataDirectories(&handles[0]) == xdgSearchableDataDirectories(&handles[1]))
+		printf("shared list\n");
+	/* The first handle copies its prepared lists before classifying them. */
+	if (xdgSetLookupDeadline(&handles[0], 100) == 0)
+	{
+		free(xdgDataFind("missing", &handles[0]));
+		free(xdgDataFind("missing", &handles[1]));
+	}
+	xdgWipeHandle(&handles[0]);
+	xdgWipeHandle(&handles[1]);
+	xdgWipeHandlePool(&pool);
+	return 0;
+}
+
+void printWatchedDirectory(const char *relativePath, const char *path, void *dirs)
+{
+	const char * const *item;
+	if (!path)
+	{
+		printf("none\n");
+		return;
+	}
+	for (item = (const char * const *)dirs; *item; ++item)
+		if (strncmp(path, *item, strlen(*item)) == 0)
+		{
+			printf("%d\n", (int)(item - (const char * const *)dirs));
+			return;
+		}
+}
+
+int printClass(const char *path)
+{
+	xdgPathClass result;
+	if (xdgClassifyPath(path, &result, NULL) == XDG_BASE_NONE)
+		printf("none\n");
+	else
+		printf("%d %u %s\n", result.base, result.index, result.relativePath);
+	return 0;
+}
+
+int writeFile(const char *dir, const char *relativePath, const char *mode)
+{
+	char path[4096];
+	FILE *file;
+	snprintf(path, sizeof(path), "%s/%s", dir, relativePath);
+	if ((xdgMakePath(dir, 0700) == -1 && errno != EEXIST) || !(file = fopen(path, mode)))
+		return 0;
+	fputs("x", file);
+	fclose(file);
+	return 1;
+}
+
+int removeFile(const char *dir, const char *relativePath)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s", dir, relativePath);
+	return unlink(path) == 0;
+}
+
+/* Changes the file in the first two config directories and prints which
+ * directory the effective file is in after each reported change. */
+int watchAndChange(const char *relativePath)
+{
+	xdgHandle handle;
+	xdgWatcher watcher;
+	const char * const *dirs;
+	int ok;
+	if (!xdgInitHandle(&handle) || !xdgInitWatcher(&watcher))
+		return 1;
+	dirs = xdgSearchableConfigDirectories(&handle);
+	if (!dirs[0] || !dirs[1] ||
+		xdgWatchConfig(relativePath, printWatchedDirectory, (void*)dirs, &watcher, &handle) == -1)
+		return 1;
+	ok = writeFile(dirs[1], relativePath, "w") && xdgDispatchWatcher(&watcher) == 1 &&
+		writeFile(dirs[0], relativePath, "w") && xdgDispatchWatcher(&watcher) == 1 &&
+		writeFile(dirs[0], relativePath, "a") && xdgDispatchWatcher(&watcher) == 1 &&
+		writeFile(dirs[1], relativePath, "a") && xdgDispatchWatcher(&watcher) == 0 &&
+		removeFile(dirs[0], relativePath) && xdgDispatchWatcher(&watcher) == 1 &&
+		removeFile(dirs[1], relativePath) && xdgDispatchWatcher(&watcher) == 1;
+	xdgWipeWatcher(&watcher);
+	xdgWipeHandle(&handle);
+	return !ok;
+}
+
+/* Prints how the fingerprint of a config file changes when it is created
+ * in the config home and removed again. */
+int fingerprintAndChange(const char *relativePath)
+{
+	xdgHandle handle;
+	unsigned long long first, second;
+	const char * const paths[] = { relativePath };
+	const char *home;
+	int ok;
+	if (!xdgInitHandle(&handle))
+		return 1;
+	home = xdgConfigHome(&handle);
+	ok = xdgConfigFingerprint(paths, 1, &first, &handle) == 0 &&
+		xdgConfigFingerprint(paths, 1, &second, &handle) == 0;
+	if (ok) printf(first == second ? "stable\n" : "unstable\n");
+	ok = ok && writeFile(home, relativePath, "w") &&
+		xdgConfigFingerprint(paths, 1, &second, &handle) == 0;
+	if (ok) printf(first == second ? "unchanged\n" : "changed\n");
+	ok = ok && removeFile(home, relativePath) &&
+		xdgConfigFingerprint(paths, 1, &second, &handle) == 0;
+	if (ok) printf(first == second ? "restored\n" : "different\n");
+	xdgWipeHandle(&handle);
+	return !ok;
+}
+
+/* Exports a handle, changes the data directories and prints the
+ * directories of a handle imported from the snapshot, then of a handle
+ * initialized with the stale snapshot in the environment. */
+int exportAndImport(const char *dataDirectories)
+{
+	xdgHandle handle;
+	char number[16];
+	int fd;
+	if (!xdgInitHandle(&handle))
+		return 1;
+	fd = xdgExportHandleFd(&handle);
+	xdgWipeHandle(&handle);
+	if (fd == -1)
+		return 1;
+	snprintf(number, sizeof(number), "%d", fd);
+	setenv(XDG_HANDLE_FD_VARIABLE, number, 1);
+	setenv("XDG_DATA_DIRS", dataDirectories, 1);
+	if (!xdgImportHandleFd(&handle, fd, 0))
+		return 1;
+	printf("%s\n", xdgDataDirectories(&handle)[0]);
+	xdgWipeHandle(&handle);
+	if (!xdgInitHandle(&handle))
+		return 1;
+	printf("%s\n", xdgDataDirectories(&handle)[0]);
+	xdgWipeHandle(&handle);
+	close(fd);
+	return 0;
+}
+
+/* Prints which data directory a file is found in with a cached listing of
+ * its directory, before and after creating it in the last two directories.
+ * Waits for a second after each change so that the listing is compared. */
+int listAndChange(const char *relativePath)
+{
+	xdgHandle handle;
+	const char * const *dirs;
+	char directory[4096], *found;
+	const char *name = strrchr(relativePath, '/');
+	int i, ok = 1;
+	if (!name || !xdgInitHandle(&handle))
+		return 1;
+	snprintf(directory, sizeof(directory), "%.*s", (int)(name - relativePath), relativePath);
+	if (xdgDataCacheListing(directory, &handle) != 0)
+		return 1;
+	dirs = xdgSearchableDataDirectories(&handle);
+	for (i = 0; ok && i < 3; ++i)
+	{
+		if (i > 0)
+		{
+			ok = dirs[1] && dirs[2] && writeFile(dirs[3-i], relativePath, "w");
+			sleep(1);
+		}
+		found = xdgDataFind(relativePath, &handle);
+		printWatchedDirectory(relativePath, *found ? found : NULL, (void*)dirs);
+		free(found);
+	}
+	xdgWipeHandle(&handle);
+	return !ok;
+}
+
+/* Prints the config files found for a path followed by more characters,
+ * of which only the length of the path is passed. */
+int findPrefix(const char *relativePath)
+{
+	char buffer[4096];
+	size_t length = strlen(relativePath);
+	if (length + 4 >= sizeof(buffer))
+		return 1;
+	memcpy(buffer, relativePath, length);
+	strcpy(buffer + length, ".bak");
+	printAndFreeString(xdgConfigFindN(buffer, length, NULL));
+	return 0;
+}
+
+/* Prints which data directories contain each path, one digit per directory. */
+int printProbeMatrix(const char * const *relativePaths, unsigned int count)
+{
+	xdgProbeMatrix matrix;
+	unsigned int p, d;
+	if (xdgDataProbeMatrix(relativePaths, count, &matrix, NULL) != 0)
+		return 1;
+	for (p = 0; p < matrix.count; ++p)
+	{
+		for (d = 0; d < matrix.directories; ++d)
+			putchar(XDG_PROBE_MATRIX_HAS(&matrix, p, d) ? '1' : '0');
+		putchar('\n');
+	}
+	xdgFreeProbeMatrix(&matrix);
+	return 0;
+}
+
+/* Prints the merged entries of a config key file, then the value of the
+ * key given as group and key. */
+int printKeyFile(const char *relativePath, const char *group, const char *key)
+{
+	xdgKeyFile keyFile;
+	const xdgKeyFileEntry *entries, *entry;
+	unsigned int count, i;
+	if (xdgConfigOpenKeyFile(relativePath, &keyFile, NULL) != 0)
+		return 1;
+	entries = xdgKeyFileEntries(&keyFile, &count);
+	for (i = 0; i < count; ++i)
+		printf("[%.*s] %.*s=%.*s %u\n", (int)entries[i].group.length, entries[i].group.data,
+			(int)entries[i].key.length, entries[i].key.data,
+			(int)entries[i].value.length, entries[i].value.data, entries[i].directory);
+	if ((entry = xdgKeyFileLookup(&keyFile, group, key)))
+		printf("%.*s\n", (int)entry->value.length, entry->value.data);
+	else
+		printf("none\n");
+	xdgCloseKeyFile(&keyFile);
+	return 0;
+}
+
+/* Prints the first line of each config file opened with a handle which
+ * opens files in every directory at once, or "none" if it is missing. */
+int openParallel(char * const *relativePaths)
+{
+	xdgHandle handle;
+	char line[256];
+	FILE *file;
+	if (!xdgInitHandleWithFlags(&handle, XDG_HANDLE_PARALLEL_OPEN))
+		return 1;
+	for (; *relativePaths; ++relativePaths)
+	{
+		if (!(file = xdgConfigOpen(*relativePaths, "r", &handle)))
+			printf("none\n");
+		else
+		{
+			printf("%s", fgets(line, sizeof(line), file) ? line : "\n");
+			fclose(file);
+		}
+	}
+	xdgWipeHandle(&handle);
+	return 0;
+}
+
+/* Prints the directory in which a handle with directory descriptors
+ * finds a config file as the config home is created, written to,
+ * replaced, removed and created again, and how many descriptors each
+ * revalidation changes. */
+int revalidateAndChange(const char *relativePath)
+{
+	xdgHandle handle;
+	const char * const *dirs;
+	char *found, old[4096];
+	FILE *file;
+	int ok;
+	if (!xdgInitHandleWithFlags(&handle, XDG_HANDLE_DIRECTORY_FDS))
+		return 1;
+	dirs = xdgSearchableConfigDirectories(&handle);
+	snprintf(old, sizeof(old), "%s.old", dirs[0]);
+	ok = (found = xdgConfigFind(relativePath, &handle)) != 0;
+	if (ok)
+	{
+		printWatchedDirectory(relativePath, *found ? found : NULL, (void*)dirs);
+		free(found);
+	}
+	/* Files are created in the new config home before revalidating. */
+	ok = ok && xdgMakePath(dirs[0], 0700) == 0 && (file = xdgConfigOpen(relativePath, "w", &handle)) != 0;
+	if (ok)
+	{
+		fclose(file);
+		ok = (found = xdgConfigFind(relativePath, &handle)) != 0;
+	}
+	if (ok)
+	{
+		printWatchedDirectory(relativePath, *found ? found : NULL, (void*)dirs);
+		free(found);
+		printf("%d\n", xdgRevalidateHandle(&handle));
+		ok = (found = xdgConfigFind(relativePath, &handle)) != 0;
+	}
+	if (ok)
+	{
+		printWatchedDirectory(relativePath, *found ? found : NULL, (void*)dirs);
+		free(found);
+		ok = rename(dirs[0], old) == 0 && xdgMakePath(dirs[0], 0700) == 0;
+	}
+	if (ok)
+	{
+		printf("%d\n", xdgRevalidateHandle(&handle));
+		ok = (found = xdgConfigFind(relativePath, &handle)) != 0;
+	}
+	if (ok)
+	{
+		printWatchedDirectory(relativePath, *found ? found : NULL, (void*)dirs);
+		free(found);
+		printf("%d\n", xdgRevalidateHandle(&handle));
+		/* The config home is removed, then created again with the file. */
+		ok = rmdir(dirs[0]) == 0;
+	}
+	if (ok)
+	{
+		printf("%d\n", xdgRevalidateHandle(&handle));
+		ok = (found = xdgConfigFind(relativePath, &handle)) != 0;
+	}
+	if (ok)
+	{
+		printWatchedDirectory(relativePath, *found ? found : NULL, (void*)dirs);
+		free(found);
+		ok = xdgMakePath(dirs[0], 0700) == 0 && (file = xdgConfigOpen(relativePath, "w", &handle)) != 0;
+	}
+	if (ok)
+	{
+		fclose(file);
+		printf("%d\n", xdgRevalidateHandle(&handle));
+		ok = (found = xdgConfigFind(relativePath, &handle)) != 0;
+	}
+	if (ok)
+	{
+		printWatchedDirectory(relativePath, *found ? found : NULL, (void*)dirs);
+		free(found);
+	}
+	xdgWipeHandle(&handle);
+	return !ok;
+}
+
+/* Prints the directory in which a handle finds a config file, after
+ * waiting for changes to leave the timestamp tick of the directories. */
+int findShared(const char *relativePath, xdgHandle *handle)
+{
+	char *found;
+	usleep(100000);
+	if (!(found = xdgConfigFind(relativePath, handle)))
+		return 0;
+	printWatchedDirectory(relativePath, *found ? found : NULL, (void*)xdgSearchableConfigDirectories(handle));
+	free(found);
+	return 1;
+}
+
+/* Attaches an anonymous shared resolution cache to two handles and prints
+ * where they find a config file while it is created and removed in the
+ * config home, and after the cache is invalidated. */
+int shareAndChange(const char *relativePath)
+{
+	xdgHandle first, second;
+	const char *home;
+	int fd, ok;
+	if ((fd = xdgCreateSharedCache()) == -1 || !xdgInitHandle(&first) || !xdgInitHandle(&second))
+		return 1;
+	home = xdgConfigHome(&first);
+	ok = xdgAttachSharedCache(&first, fd, 60) == 0 && xdgAttachSharedCache(&second, fd, 60) == 0 &&
+		findShared(relativePath, &first) && findShared(relativePath, &second) &&
+		writeFile(home, relativePath, "w") && findShared(relativePath, &second) &&
+		findShared(relativePath, &first) &&
+		removeFile(home, relativePath) && findShared(relativePath, &first);
+	if (ok)
+	{
+		xdgInvalidateSharedCache(&first);
+		ok = findShared(relativePath, &second);
+	}
+	xdgWipeHandle(&first);
+	xdgWipeHandle(&second);
+	close(fd);
+	return !ok;
+}
+
+/* Initializes a lazy handle, changes the config home in the environment
+ * before the first query, and prints the config home of the handle. */
+int lazyAfterSetenv(const char *configHome)
+{
+	xdgHandle handle;
+	if (!xdgInitHandleWithFlags(&handle, XDG_HANDLE_LAZY))
+		return 1;
+	setenv("XDG_CONFIG_HOME", configHome, 1);
+	printf("%s\n", xdgConfigHome(&handle));
+	xdgWipeHandle(&handle);
+	return 0;
+}
+
+/* Prefetches config files with a handle attached to an anonymous shared
+ * resolution cache, then prints where a second handle attached to it
+ * finds them. */
+int prefetchShared(char * const *relativePaths, unsigned int count)
+{
+	xdgHandle first, second;
+	unsigned int i;
+	int fd, ok;
+	if ((fd = xdgCreateSharedCache()) == -1 || !xdgInitHandle(&first) || !xdgInitHandle(&second))
+		return 1;
+	usleep(100000);
+	ok = xdgAttachSharedCache(&first, fd, 60) == 0 && xdgAttachSharedCache(&second, fd, 60) == 0 &&
+		xdgConfigPrefetch((const char * const *)relativePaths, count, &first) == 0;
+	/* The prefetch handle may go away before the lookups finish. */
+	xdgWipeHandle(&first);
+	usleep(500000);
+	for (i = 0; ok && i < count; ++i)
+		ok = findShared(relativePaths[i], &second);
+	xdgWipeHandle(&second);
+	close(fd);
+	return !ok;
+}
+
 int main(int argc, char *argv[])
 {
+	xdgFileSet files;
 	if (argc < 3)
 		return 1;
 	char *datatype = argv[1];
@@ -61,6 +669,19 @@ int main(int argc, char *argv[])
 			printAndFreeStringList(xdgSearchableDataDirectories(NULL));
 		else if (strcmp(querytype, "find") == 0 && argc == 4)
 			printAndFreeString(xdgDataFind(argv[3], NULL));
+		else if (strcmp(querytype, "envsearch") == 0)
+			return searchFromEnv(argv+3);
+		else if (strcmp(querytype, "import") == 0 && argc == 4)
+			return exportAndImport(argv[3]);
+		else if (strcmp(querytype, "listing") == 0 && argc == 4)
+			return listAndChange(argv[3]);
+		else if (strcmp(querytype, "matrix") == 0 && argc > 3)
+			return printProbeMatrix((const char * const *)argv+3, argc-3);
+		else if (strcmp(querytype, "classify") == 0 && argc > 3)
+		{
+			for (argv += 3; *argv; ++argv)
+				printClass(*argv);
+		}
 		else
 			return 1;
 	}
@@ -68,12 +689,34 @@ int main(int argc, char *argv[])
 	{
 		if (strcmp(querytype, "home") == 0)
 			printAndFreeString(xdgConfigHome(NULL));
+		else if (strcmp(querytype, "lazy") == 0 && argc == 4)
+			return lazyAfterSetenv(argv[3]);
 		else if (strcmp(querytype, "dirs") == 0)
 			printAndFreeStringList(xdgConfigDirectories(NULL));
 		else if (strcmp(querytype, "search") == 0)
 			printAndFreeStringList(xdgSearchableConfigDirectories(NULL));
 		else if (strcmp(querytype, "find") == 0 && argc == 4)
 			printAndFreeString(xdgConfigFind(argv[3], NULL));
+		else if (strcmp(querytype, "findn") == 0 && argc == 4)
+			return findPrefix(argv[3]);
+		else if (strcmp(querytype, "keyfile") == 0 && argc == 6)
+			return printKeyFile(argv[3], argv[4], argv[5]);
+		else if (strcmp(querytype, "readall") == 0 && argc == 4)
+			return printFileSet(xdgConfigReadAll(argv[3], XDG_READ_OVERRIDE_ORDER, &files, NULL), &files);
+		else if (strcmp(querytype, "watch") == 0 && argc == 4)
+			return watchAndChange(argv[3]);
+		else if (strcmp(querytype, "fingerprint") == 0 && argc == 4)
+			return fingerprintAndChange(argv[3]);
+		else if (strcmp(querytype, "parallel") == 0 && argc > 3)
+			return openParallel(argv+3);
+		else if (strcmp(querytype, "prefetch") == 0 && argc > 3)
+			return prefetchShared(argv+3, argc-3);
+		else if (strcmp(querytype, "revalidate") == 0 && argc == 4)
+			return revalidateAndChange(argv[3]);
+		else if (strcmp(querytype, "shared") == 0 && argc == 4)
+			return shareAndChange(argv[3]);
+		else if (strcmp(querytype, "write") == 0 && argc == 5)
+			return writeAndFind(argv[3], argv[4]);
 		else
 			return 1;
 	}
@@ -81,6 +724,14 @@ int main(int argc, char *argv[])
 	{
 		if (strcmp(querytype, "home") == 0)
 			printAndFreeString(xdgCacheHome(NULL));
+		else if (strcmp(querytype, "store") == 0 && argc == 6)
+			return storeAndGet(argv[3], argv[4], argv[5]);
+		else if (strcmp(querytype, "budget") == 0 && argc == 4)
+			return storeOverBudget(argv[3]);
+		else if (strcmp(querytype, "age") == 0 && argc == 4)
+			return storeExpired(argv[3]);
+		else if (strcmp(querytype, "recover") == 0 && argc == 4)
+			return storeRecovered(argv[3]);
 		else
 			return 1;
 	}